@@ -1,5 +1,9 @@
 -- Some functions to calculate pi digits using mpz integers.
 --
+-- pgmp also provides pi_digits(), computing the digits natively with the
+-- Chudnovsky series: it is much faster than these functions, which are kept
+-- as an example of PL/pgSQL programming with mpz.
+--
 -- Reference:
 -- https://web.archive.org/web/20111211140154/http://en.literateprograms.org/Pi_with_Machin's_formula_(Python)
 --
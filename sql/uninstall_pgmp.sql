@@ -27,9 +27,18 @@
 -- Drop the data types: this will rip off all the functions defined on them.
 DROP TYPE mpz CASCADE;
 DROP TYPE mpq CASCADE;
+DROP TYPE mpzvec CASCADE;
+DROP TYPE mpd CASCADE;
 
 -- Drop the remaining objects.
 DROP FUNCTION gmp_version();
+DROP FUNCTION mpz_support(internal);
+DROP FUNCTION mpz_plan_support(internal);
+DROP FUNCTION pgmp_cache_stats();
+DROP FUNCTION pgmp_cache_reset();
+DROP FUNCTION _mpz_agg_crt_combine(internal, internal);
+DROP FUNCTION _mpz_agg_crt_serialize(internal);
+DROP FUNCTION _mpz_agg_crt_deserialize(bytea, internal);
 
 DROP FUNCTION randinit();
 DROP FUNCTION randinit_mt();
@@ -39,4 +48,6 @@ DROP OPERATOR FAMILY mpz_ops USING btree CASCADE;
 DROP OPERATOR FAMILY mpz_ops USING hash CASCADE;
 DROP OPERATOR FAMILY mpq_ops USING btree CASCADE;
 DROP OPERATOR FAMILY mpq_ops USING hash CASCADE;
+DROP OPERATOR FAMILY mpd_ops USING btree CASCADE;
+DROP OPERATOR FAMILY mpd_ops USING hash CASCADE;
 
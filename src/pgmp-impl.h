@@ -63,6 +63,24 @@
 extern const mp_limb_t _pgmp_limb_0;
 extern const mp_limb_t _pgmp_limb_1;
 
+/* Limit to the size of the results of the expensive functions.
+ *
+ * Defined in pgmp.c, set by the pgmp.max_bits GUC. */
+extern int pgmp_max_bits;
+void pgmp_check_result_bits(double nbits);
+
+/* Size in kB of the cache of the sequence functions.
+ *
+ * Defined in pgmp.c, set by the pgmp.cache_size GUC. */
+extern int pgmp_cache_size;
+void pgmp_cache_assign_size(int newval, void *extra);
+
+/* Largest prime in the table of the small primes.
+ *
+ * Defined in pgmp.c, set by the pgmp.trial_division_limit GUC. */
+extern int pgmp_trial_division_limit;
+void pgmp_trial_assign_limit(int newval, void *extra);
+
 /*
  * Macros equivalent to the ones defimed in gmp-impl.h
  */
@@ -22,11 +22,13 @@
 #include <gmp.h>
 #include "postgres.h"
 #include "fmgr.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"         /* for MaxAllocSize */
 
 #include "pgmp-impl.h"
 
-#if PG_VERSION_NUM < 90400
-#error This pgmp version requires PostgreSQL 9.4 or above
+#if PG_VERSION_NUM < 90500
+#error This pgmp version requires PostgreSQL 9.5 or above
 #endif
 
 PG_MODULE_MAGIC;
@@ -44,6 +46,15 @@ static void     _pgmp_free(void *ptr, size_t size);
 const mp_limb_t _pgmp_limb_0 = 0;
 const mp_limb_t _pgmp_limb_1 = 1;
 
+/* Maximum size in bits of the results (pgmp.max_bits), 0 if unlimited */
+int pgmp_max_bits = 0;
+
+/* Size in kB of the cache of the sequence functions (pgmp.cache_size) */
+int pgmp_cache_size = 4096;
+
+/* Largest prime of the table used for trial division */
+int pgmp_trial_division_limit = 65536;
+
 
 /*
  * Module initialization and cleanup
@@ -55,6 +66,33 @@ _PG_init(void)
     /* A vow to the gods of the memory allocation */
     mp_set_memory_functions(
         _pgmp_alloc, _pgmp_realloc, _pgmp_free);
+
+    DefineCustomIntVariable("pgmp.max_bits",
+        "Maximum size in bits of the results of the expensive functions.",
+        "The functions fail before the computation if the result would be "
+        "larger. Zero means limited only by the maximum size of a value.",
+        &pgmp_max_bits, 0, 0, INT_MAX,
+        PGC_SUSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgmp.cache_size",
+        "Memory used to cache the results of the sequence functions.",
+        "The large results of fac, fib, lucnum and bin are kept for reuse "
+        "in the session. Zero disables the cache.",
+        &pgmp_cache_size, 4096, 0, MAX_KILOBYTES,
+        PGC_USERSET, GUC_UNIT_KB, NULL, pgmp_cache_assign_size, NULL);
+
+    DefineCustomIntVariable("pgmp.trial_division_limit",
+        "Largest prime tried as a factor before a probabilistic prime test.",
+        "The candidates of probab_prime and nextprime with a factor up to "
+        "this limit are rejected cheaply. Zero disables the table.",
+        &pgmp_trial_division_limit, 65536, 0, 1 << 24,
+        PGC_USERSET, 0, NULL, pgmp_trial_assign_limit, NULL);
+
+#if PG_VERSION_NUM >= 150000
+    MarkGUCPrefixReserved("pgmp");
+#else
+    EmitWarningsOnPlaceholders("pgmp");
+#endif
 }
 
 void
@@ -63,6 +101,32 @@ _PG_fini(void)
 }
 
 
+/*
+ * Raise an error if a result of about nbits bits can't be computed.
+ *
+ * Called before the expensive functions, to fail before allocating and
+ * computing a result that would exceed pgmp.max_bits or the maximum size of
+ * a value.
+ */
+void
+pgmp_check_result_bits(double nbits)
+{
+    if (pgmp_max_bits > 0 && nbits > pgmp_max_bits) {
+        ereport(ERROR, (
+            errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("result too large: about %.0f bits", nbits),
+            errhint("the maximum size is set by pgmp.max_bits (%d)",
+                pgmp_max_bits)));
+    }
+
+    if (nbits > (double)MaxAllocSize * 8) {
+        ereport(ERROR, (
+            errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("result too large: about %.0f bits", nbits)));
+    }
+}
+
+
 /*
  * GMP custom allocation functions using PostgreSQL memory management.
  *
@@ -0,0 +1,694 @@
+/* pmpd -- PostgreSQL data type for exact decimals on GMP mpz
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpd.h"
+#include "pmpq.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+
+#include <ctype.h>                  /* for isspace */
+
+
+/*
+ * Create a pmpd structure from the content of a mpz and a scale.
+ *
+ * As pmpz_from_mpz(), the header is written in front of the limbs, which
+ * must have been allocated by GMP.
+ */
+pmpd *
+pmpd_from_coeff(mpz_srcptr z, int scale)
+{
+    pmpd *res;
+
+    res = pmpz_from_mpz(z);
+    res->mdata = PMPD_SET_SCALE(res->mdata, scale);
+    return res;
+}
+
+/*
+ * Return a new pmpd with a copy of a mpz, which can be any.
+ */
+pmpd *
+pmpd_copy_coeff(mpz_srcptr z, int scale)
+{
+    pmpd *res;
+
+    res = pmpz_copy_mpz(z);
+    res->mdata = PMPD_SET_SCALE(res->mdata, scale);
+    return res;
+}
+
+/*
+ * Initialize a mpz from the coefficient of a pmpd, return its scale.
+ *
+ * As in mpz_from_pmpz() the mpz doesn't own the data, which must not be
+ * changed nor cleared.
+ */
+int
+mpz_from_pmpd(mpz_srcptr z, const pmpd *pd)
+{
+    if (UNLIKELY(0 != (PMPZ_VERSION(pd)))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_DATA_EXCEPTION),
+            errmsg("unsupported mpd version: %d", PMPZ_VERSION(pd))));
+    }
+
+    mpz_from_pmpz(z, pd);
+    return PMPD_SCALE(pd);
+}
+
+
+/*
+ * Operations on the coefficients.
+ */
+
+/* Largest power of 10 fitting in an unsigned long */
+#if PGMP_LONG_64
+#define PMPD_POW10_UI_MAX 19
+#else
+#define PMPD_POW10_UI_MAX 9
+#endif
+
+static unsigned long
+_pow10_ui(int n)
+{
+    unsigned long p = 1;
+
+    while (n-- > 0) {
+        p *= 10;
+    }
+    return p;
+}
+
+/* Set res = z * 10^n, with n >= 0 */
+void
+mpz_mul_10exp(mpz_ptr res, mpz_srcptr z, int n)
+{
+    mpz_t       p;
+
+    if (n <= PMPD_POW10_UI_MAX) {
+        mpz_mul_ui(res, z, _pow10_ui(n));
+        return;
+    }
+
+    mpz_init(p);
+    mpz_ui_pow_ui(p, 10, n);
+    mpz_mul(res, z, p);
+    mpz_clear(p);
+}
+
+/*
+ * Set res = z / 10^n, with n >= 0.
+ *
+ * The result is truncated if trunc, else rounded half away from zero, as
+ * numeric does.
+ */
+void
+mpz_round_10exp(mpz_ptr res, mpz_srcptr z, int n, bool trunc)
+{
+    int         sgn = mpz_sgn(z);
+    bool        up;
+
+    if (n <= PMPD_POW10_UI_MAX)
+    {
+        unsigned long   d = _pow10_ui(n);
+        unsigned long   r;
+
+        r = mpz_tdiv_q_ui(res, z, d);
+        up = !trunc && r >= d - r;
+    }
+    else
+    {
+        mpz_t       p, r;
+
+        mpz_init(p);
+        mpz_init(r);
+        mpz_ui_pow_ui(p, 10, n);
+        mpz_tdiv_qr(res, r, z, p);
+        if ((up = !trunc && SIZ(r) != 0)) {
+            mpz_mul_2exp(r, r, 1);
+            up = mpz_cmpabs(r, p) >= 0;
+        }
+        mpz_clear(p);
+        mpz_clear(r);
+    }
+
+    if (up) {
+        if (sgn > 0) {
+            mpz_add_ui(res, res, 1);
+        }
+        else {
+            mpz_sub_ui(res, res, 1);
+        }
+    }
+}
+
+/* Set res to the coefficient of c * 10^-s with the given scale */
+void
+mpd_rescale(mpz_ptr res, mpz_srcptr c, int s, int scale, bool trunc)
+{
+    if (scale >= s) {
+        mpz_mul_10exp(res, c, scale - s);
+    }
+    else {
+        mpz_round_10exp(res, c, s - scale, trunc);
+    }
+}
+
+/* Compare c1 * 10^-s1 with c2 * 10^-s2 */
+int
+mpd_cmp(mpz_srcptr c1, int s1, mpz_srcptr c2, int s2)
+{
+    mpz_t       t;
+    int         rv;
+
+    if (LIKELY(s1 == s2)) {
+        return mpz_cmp(c1, c2);
+    }
+    if (mpz_sgn(c1) != mpz_sgn(c2)) {
+        return mpz_sgn(c1) - mpz_sgn(c2);
+    }
+
+    mpz_init(t);
+    if (s1 < s2) {
+        mpz_mul_10exp(t, c1, s2 - s1);
+        rv = mpz_cmp(t, c2);
+    }
+    else {
+        mpz_mul_10exp(t, c2, s1 - s2);
+        rv = mpz_cmp(c1, t);
+    }
+    mpz_clear(t);
+    return rv;
+}
+
+void
+mpd_check_scale(int scale)
+{
+    if (UNLIKELY(scale > PMPD_MAX_SCALE)) {
+        ereport(ERROR, (
+            errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+            errmsg("mpd scale %d exceeds the maximum allowed (%d)",
+                scale, PMPD_MAX_SCALE)));
+    }
+}
+
+
+/*
+ * Type modifier: (precision, scale), encoded as in numeric.
+ */
+
+#define PMPD_TYPMOD_PRECISION(t)    ((((t) - VARHDRSZ) >> 16) & 0xffff)
+#define PMPD_TYPMOD_SCALE(t)        (((t) - VARHDRSZ) & 0xffff)
+
+PGMP_PG_FUNCTION(pmpd_typmod_in)
+{
+    ArrayType   *ta = PG_GETARG_ARRAYTYPE_P(0);
+    int32       *tl;
+    int         n;
+    int         precision, scale = 0;
+
+    tl = ArrayGetIntegerTypmods(ta, &n);
+    if (n < 1 || n > 2) {
+        ereport(ERROR, (
+            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("invalid mpd type modifier")));
+    }
+
+    precision = tl[0];
+    if (n == 2) {
+        scale = tl[1];
+    }
+
+    if (precision < 1 || precision > PMPD_MAX_PRECISION) {
+        ereport(ERROR, (
+            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("mpd precision %d must be between 1 and %d",
+                precision, PMPD_MAX_PRECISION)));
+    }
+    if (scale < 0 || scale > precision) {
+        ereport(ERROR, (
+            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("mpd scale %d must be between 0 and precision %d",
+                scale, precision)));
+    }
+
+    PG_RETURN_INT32(((precision << 16) | scale) + VARHDRSZ);
+}
+
+PGMP_PG_FUNCTION(pmpd_typmod_out)
+{
+    int32       typmod = PG_GETARG_INT32(0);
+
+    if (typmod < VARHDRSZ) {
+        PG_RETURN_CSTRING(pstrdup(""));
+    }
+
+    PG_RETURN_CSTRING(psprintf("(%d,%d)",
+        PMPD_TYPMOD_PRECISION(typmod), PMPD_TYPMOD_SCALE(typmod)));
+}
+
+/*
+ * Round c * 10^-s to the scale of typmod and check its precision.
+ *
+ * Write the coefficient into res and return its scale. If there is no
+ * typmod res is not written and s is returned.
+ */
+static int
+_mpd_apply_typmod(mpz_ptr res, mpz_srcptr c, int s, int32 typmod)
+{
+    int         precision, scale;
+    size_t      ndigits;
+
+    if (typmod < VARHDRSZ) {
+        return s;
+    }
+
+    precision = PMPD_TYPMOD_PRECISION(typmod);
+    scale = PMPD_TYPMOD_SCALE(typmod);
+    mpd_rescale(res, c, s, scale, false);
+
+    /* sizeinbase may exceed the number of digits by one */
+    ndigits = mpz_sizeinbase(res, 10);
+    if (ndigits > precision && SIZ(res) != 0)
+    {
+        mpz_t       p;
+        bool        over = true;
+
+        if (ndigits == precision + 1) {
+            mpz_init_set_ui(p, 1);
+            mpz_mul_10exp(p, p, precision);
+            over = mpz_cmpabs(res, p) >= 0;
+            mpz_clear(p);
+        }
+
+        if (over) {
+            ereport(ERROR, (
+                errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                errmsg("mpd field overflow"),
+                errdetail("A field with precision %d, scale %d must round "
+                    "to an absolute value less than 10^%d.",
+                    precision, scale, precision - scale)));
+        }
+    }
+
+    return scale;
+}
+
+/* Length coercion to the type modifier: mpd(mpd, int4, bool) */
+PGMP_PG_FUNCTION(pmpd_apply_typmod)
+{
+    const mpz_t     c = {0};
+    int             s;
+    int32           typmod;
+    mpz_t           cf;
+
+    PGMP_GETARG_MPD(c, s, 0);
+    typmod = PG_GETARG_INT32(1);
+
+    /* Return the same value if it doesn't change */
+    if (typmod < VARHDRSZ || (s == PMPD_TYPMOD_SCALE(typmod)
+            && mpz_sizeinbase(c, 10) <= PMPD_TYPMOD_PRECISION(typmod))) {
+        PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+    }
+
+    mpz_init(cf);
+    s = _mpd_apply_typmod(cf, c, s, typmod);
+    PGMP_RETURN_MPD(cf, s);
+}
+
+
+/*
+ * Input/Output functions
+ */
+
+#define PMPD_INVALID_INPUT(str) \
+do { \
+    const char *ell; \
+    const int maxchars = 50; \
+    ell = (strlen(str) > maxchars) ? "..." : ""; \
+ \
+    ereport(ERROR, ( \
+        errcode(ERRCODE_INVALID_TEXT_REPRESENTATION), \
+        errmsg("invalid input for mpd: \"%.*s%s\"", \
+            maxchars, str, ell))); \
+} while (0)
+
+/* Largest exponent accepted in input, to avoid overflows */
+#define PMPD_MAX_EXPONENT 1000000
+
+/*
+ * Parse a decimal number in the format [+-]digits[.digits][e[+-]digits]
+ *
+ * Set c to the coefficient and return the scale. If the number has at most
+ * PGMP_SMALL_DIGITS digits c is a view on limbs, which must have room for
+ * PGMP_SMALL_LIMBS, else it is allocated by GMP.
+ */
+static int
+_mpd_parse(mpz_ptr c, mp_limb_t *limbs, const char *str)
+{
+    const char  *p = str;
+    char        *digits, *d;
+    bool        neg = false;
+    int         nfrac = 0;
+    long        exp = 0;
+    int         scale;
+
+    while (isspace((unsigned char)*p)) { p++; }
+    if (*p == '-' || *p == '+') {
+        neg = (*p++ == '-');
+    }
+
+    d = digits = palloc(strlen(p) + 1);
+    while ((unsigned)(*p - '0') < 10) {
+        *d++ = *p++;
+    }
+    if (*p == '.') {
+        p++;
+        while ((unsigned)(*p - '0') < 10) {
+            *d++ = *p++;
+            nfrac++;
+        }
+    }
+    if (d == digits) {
+        PMPD_INVALID_INPUT(str);
+    }
+    *d = '\0';
+
+    if (*p == 'e' || *p == 'E')
+    {
+        bool    eneg = false;
+
+        p++;
+        if (*p == '-' || *p == '+') {
+            eneg = (*p++ == '-');
+        }
+        if ((unsigned)(*p - '0') >= 10) {
+            PMPD_INVALID_INPUT(str);
+        }
+        while ((unsigned)(*p - '0') < 10) {
+            exp = exp * 10 + (*p++ - '0');
+            if (exp > PMPD_MAX_EXPONENT) {
+                ereport(ERROR, (
+                    errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                    errmsg("mpd exponent out of range: \"%s\"", str)));
+            }
+        }
+        if (eneg) {
+            exp = -exp;
+        }
+    }
+
+    while (isspace((unsigned char)*p)) { p++; }
+    if (*p) {
+        PMPD_INVALID_INPUT(str);
+    }
+
+    if (d - digits <= PGMP_SMALL_DIGITS)
+    {
+        pgmp_small  v = 0;
+        int         n;
+
+        for (d = digits; *d; d++) {
+            v = v * 10 + (*d - '0');
+        }
+        n = pgmp_small_to_limbs(v, limbs);
+        ALLOC(c) = PGMP_SMALL_LIMBS;
+        SIZ(c) = n;
+        LIMBS(c) = limbs;
+    }
+    else {
+        mpz_init_set_str(c, digits, 10);
+    }
+    pfree(digits);
+
+    if (neg) {
+        SIZ(c) = -SIZ(c);
+    }
+
+    scale = nfrac - exp;
+    mpd_check_scale(scale);
+    return scale;
+}
+
+PGMP_PG_FUNCTION(pmpd_in)
+{
+    char        *str;
+    int32       typmod;
+    mp_limb_t   limbs[PGMP_SMALL_LIMBS];
+    mpz_t       c, cf;
+    int         s;
+
+    str = PG_GETARG_CSTRING(0);
+    typmod = PG_GETARG_INT32(2);
+
+    s = _mpd_parse(c, limbs, str);
+    if (s >= 0 && typmod < VARHDRSZ) {
+        /* the coefficient may be on the stack */
+        PG_RETURN_POINTER(pmpd_copy_coeff(c, s));
+    }
+
+    /* negative exponent: 1e3 is 1000 with scale 0 */
+    mpz_init(cf);
+    if (s < 0) {
+        mpz_mul_10exp(cf, c, -s);
+        s = 0;
+    }
+    else {
+        mpz_set(cf, c);
+    }
+
+    s = _mpd_apply_typmod(cf, cf, s, typmod);
+    PGMP_RETURN_MPD(cf, s);
+}
+
+PGMP_PG_FUNCTION(pmpd_out)
+{
+    const mpz_t     c = {0};
+    int             s;
+    char            *buf, *digits, *p;
+    size_t          len;
+    pgmp_small      v;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    /* Allocate the output buffer manually - see pmpz_out to know why */
+    len = mpz_sizeinbase(c, 10);
+    buf = palloc(len + s + 5);      /* sign, "0.", mpz_get_str sign, null */
+    digits = buf + s + 3;
+    if (mpz_get_small(c, &v)) {
+        len = pgmp_small_format(digits, v) - digits;
+    }
+    else {
+        mpz_get_str(digits, 10, c);
+        if (*digits == '-') { digits++; }
+        len = strlen(digits);
+    }
+
+    p = buf;
+    if (SIZ(c) < 0) {
+        *p++ = '-';
+    }
+    if (s == 0) {
+        memmove(p, digits, len + 1);
+    }
+    else if (len > s) {
+        memmove(p, digits, len - s);
+        p += len - s;
+        *p++ = '.';
+        memmove(p, digits + len - s, s + 1);
+    }
+    else {
+        char    *frac = p + 2 + s - len;
+
+        memmove(frac, digits, len + 1);
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', frac - p);
+    }
+
+    PG_RETURN_CSTRING(buf);
+}
+
+
+/*
+ * Cast functions
+ *
+ * The integers are converted with the pmpz functions, as they have the same
+ * representation of the decimals with scale 0.
+ */
+
+PGMP_PG_FUNCTION(pmpd_from_mpz)
+{
+    const mpz_t     z = {0};
+
+    PGMP_GETARG_MPZ(z, 0);
+    PG_RETURN_POINTER(pmpd_copy_coeff(z, 0));
+}
+
+PGMP_PG_FUNCTION(pmpd_to_mpz)
+{
+    const mpz_t     c = {0};
+    int             s;
+    mpz_t           z;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    if (s == 0) {
+        PG_RETURN_POINTER(pmpz_copy_mpz(c));
+    }
+
+    mpz_init(z);
+    mpz_round_10exp(z, c, s, true);
+    PGMP_RETURN_MPZ(z);
+}
+
+PGMP_PG_FUNCTION(pmpd_to_mpq)
+{
+    const mpz_t     c = {0};
+    int             s;
+    mpq_t           q;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    mpq_init(q);
+    mpz_set(mpq_numref(q), c);
+    if (s > 0) {
+        mpz_ui_pow_ui(mpq_denref(q), 10, s);
+        mpq_canonicalize(q);
+    }
+
+    PGMP_RETURN_MPQ(q);
+}
+
+/* Round the mpq q to the decimal with the given scale */
+PGMP_PG_FUNCTION(pmpd_from_mpq)
+{
+    const mpq_t     q = {0};
+    int             s;
+    mpz_t           c, r;
+
+    PGMP_GETARG_MPQ(q, 0);
+    s = PG_GETARG_INT32(1);
+    if (s < 0) {
+        ereport(ERROR, (
+            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("mpd scale can't be negative: %d", s)));
+    }
+    mpd_check_scale(s);
+
+    /* round num * 10^s / den half away from zero */
+    mpz_init(c);
+    mpz_init(r);
+    mpz_mul_10exp(c, mpq_numref(q), s);
+    mpz_tdiv_qr(c, r, c, mpq_denref(q));
+    mpz_mul_2exp(r, r, 1);
+    if (mpz_cmpabs(r, mpq_denref(q)) >= 0) {
+        if (SIZ(r) > 0) {
+            mpz_add_ui(c, c, 1);
+        }
+        else {
+            mpz_sub_ui(c, c, 1);
+        }
+    }
+    mpz_clear(r);
+
+    PGMP_RETURN_MPD(c, s);
+}
+
+PGMP_PG_FUNCTION(pmpd_to_float8)
+{
+    const mpz_t     c = {0};
+    int             s;
+    mpq_t           q;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    if (s == 0) {
+        PG_RETURN_FLOAT8(mpz_get_d(c));
+    }
+
+    mpq_init(q);
+    mpz_set(mpq_numref(q), c);
+    mpz_ui_pow_ui(mpq_denref(q), 10, s);
+    PG_RETURN_FLOAT8(mpq_get_d(q));
+}
+
+PGMP_PG_FUNCTION(pmpd_from_numeric)
+{
+    pgmp_numeric    num;
+    int             e;
+    mpz_t           c;
+
+    pgmp_numeric_unpack(&num, PG_GETARG_DATUM(0));
+
+    if (UNLIKELY(num.sign != PGMP_NUMERIC_POS
+            && num.sign != PGMP_NUMERIC_NEG)) {
+        ereport(ERROR, (
+            errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+            errmsg("can't convert numeric value to mpd: \"%s\"",
+                DatumGetCString(DirectFunctionCall1(numeric_out,
+                    PG_GETARG_DATUM(0))))));
+    }
+    mpd_check_scale(num.dscale);
+
+    /* value = digits * 10^e; the digits after dscale are zeros */
+    mpz_init(c);
+    mpz_set_numeric_digits(c, num.digits, num.ndigits);
+    if (num.sign == PGMP_NUMERIC_NEG) {
+        mpz_neg(c, c);
+    }
+
+    e = 4 * (num.weight + 1 - num.ndigits) + num.dscale;
+    if (e >= 0) {
+        mpz_mul_10exp(c, c, e);
+    }
+    else {
+        mpz_round_10exp(c, c, -e, true);
+    }
+
+    PGMP_RETURN_MPD(c, num.dscale);
+}
+
+PGMP_PG_FUNCTION(pmpd_to_numeric)
+{
+    const mpz_t     c = {0};
+    int             s, pad;
+    mpz_t           z;
+    pgmp_numeric    num;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    /* align the coefficient to the base 10000 digits */
+    pad = (4 - s % 4) % 4;
+    mpz_init(z);
+    mpz_mul_10exp(z, c, pad);
+
+    num.digits = mpz_get_numeric_digits(z, &num.ndigits);
+    num.weight = num.ndigits - 1 - (s + pad) / 4;
+    num.sign = SIZ(z) < 0 ? PGMP_NUMERIC_NEG : PGMP_NUMERIC_POS;
+    num.dscale = s;
+
+    return pgmp_numeric_pack(&num, -1);
+}
@@ -0,0 +1,75 @@
+/* pmpd -- PostgreSQL data type for exact decimals on GMP mpz
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#ifndef __PMPD_H__
+#define __PMPD_H__
+
+#include "pmpz.h"
+
+/* A decimal number, stored as an integer coefficient c and a scale s, whose
+ * value is c * 10^-s.
+ *
+ * The structure is the same of a pmpz: the scale is stored in the upper bits
+ * of mdata, left free by the pmpz version and sign. A decimal with scale 0
+ * has the same representation of the mpz of its coefficient, so the mpz
+ * functions can be used to read and write the coefficients.
+ */
+typedef pmpz pmpd;
+
+#define PMPD_SCALE_SHIFT    16
+#define PMPD_SCALE_MASK     0xFFFF0000U
+
+#define PMPD_SCALE(md) ((int)(((md)->mdata & PMPD_SCALE_MASK) >> PMPD_SCALE_SHIFT))
+#define PMPD_SET_SCALE(mdata,s) \
+    (((mdata) & ~PMPD_SCALE_MASK) | ((unsigned)(s) << PMPD_SCALE_SHIFT))
+
+/* Limits of the scale and of the precision in the typmod, as numeric */
+#define PMPD_MAX_SCALE      1000
+#define PMPD_MAX_PRECISION  1000
+
+/* Minimum scale of the result of a division */
+#define PMPD_DIV_MIN_SCALE  16
+
+
+/* Macros to convert mpd arguments and return values */
+
+#define PGMP_GETARG_PMPD(n) \
+    ((pmpd*)(PG_DETOAST_DATUM(PG_GETARG_DATUM(n))))
+
+#define PGMP_GETARG_MPD(z,s,n) \
+    ((s) = mpz_from_pmpd(z, PGMP_GETARG_PMPD(n)))
+
+#define PGMP_RETURN_MPD(z,s) \
+    PG_RETURN_POINTER(pmpd_from_coeff(z, s))
+
+
+pmpd * pmpd_from_coeff(mpz_srcptr z, int scale);
+pmpd * pmpd_copy_coeff(mpz_srcptr z, int scale);
+int mpz_from_pmpd(mpz_srcptr z, const pmpd *pd);
+
+/* Operations on the coefficients */
+void mpz_mul_10exp(mpz_ptr res, mpz_srcptr z, int n);
+void mpz_round_10exp(mpz_ptr res, mpz_srcptr z, int n, bool trunc);
+int mpd_cmp(mpz_srcptr c1, int s1, mpz_srcptr c2, int s2);
+void mpd_rescale(mpz_ptr res, mpz_srcptr c, int s, int scale, bool trunc);
+void mpd_check_scale(int scale);
+
+#endif  /* __PMPD_H__ */
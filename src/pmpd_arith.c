@@ -0,0 +1,477 @@
+/* pmpd_arith -- mpd arithmetic, comparison and aggregate functions
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpd.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "access/hash.h"            /* for hash_uint32 */
+
+
+/*
+ * Unary operators
+ */
+
+PGMP_PG_FUNCTION(pmpd_uplus)
+{
+    const pmpd      *pd;
+    pmpd            *res;
+
+    pd = PGMP_GETARG_PMPD(0);
+
+    res = (pmpd *)palloc(VARSIZE(pd));
+    memcpy(res, pd, VARSIZE(pd));
+
+    PG_RETURN_POINTER(res);
+}
+
+PGMP_PG_FUNCTION(pmpd_neg)
+{
+    const mpz_t     c = {0};
+    int             s;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    mpz_init_set(zf, c);
+    mpz_neg(zf, zf);
+
+    PGMP_RETURN_MPD(zf, s);
+}
+
+PGMP_PG_FUNCTION(pmpd_abs)
+{
+    const mpz_t     c = {0};
+    int             s;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    mpz_init_set(zf, c);
+    mpz_abs(zf, zf);
+
+    PGMP_RETURN_MPD(zf, s);
+}
+
+
+/*
+ * Binary operators
+ */
+
+/* Addition and subtraction: the result has the largest scale of the
+ * arguments. */
+#define PMPD_ADDSUB(op) \
+ \
+PGMP_PG_FUNCTION(pmpd_ ## op) \
+{ \
+    const mpz_t     c1 = {0}; \
+    const mpz_t     c2 = {0}; \
+    int             s1, s2; \
+    mpz_t           zf; \
+ \
+    PGMP_GETARG_MPD(c1, s1, 0); \
+    PGMP_GETARG_MPD(c2, s2, 1); \
+ \
+    mpz_init(zf); \
+    if (s1 == s2) { \
+        mpz_ ## op (zf, c1, c2); \
+    } \
+    else if (s1 < s2) { \
+        mpz_mul_10exp(zf, c1, s2 - s1); \
+        mpz_ ## op (zf, zf, c2); \
+        s1 = s2; \
+    } \
+    else { \
+        mpz_mul_10exp(zf, c2, s1 - s2); \
+        mpz_ ## op (zf, c1, zf); \
+    } \
+ \
+    PGMP_RETURN_MPD(zf, s1); \
+}
+
+PMPD_ADDSUB(add)
+PMPD_ADDSUB(sub)
+
+/* Multiplication: the result scale is the sum of the scales, rounded to the
+ * maximum scale if larger. */
+PGMP_PG_FUNCTION(pmpd_mul)
+{
+    const mpz_t     c1 = {0};
+    const mpz_t     c2 = {0};
+    int             s1, s2, s;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPD(c1, s1, 0);
+    PGMP_GETARG_MPD(c2, s2, 1);
+
+    mpz_init(zf);
+    mpz_mul(zf, c1, c2);
+    s = s1 + s2;
+    if (s > PMPD_MAX_SCALE) {
+        mpz_round_10exp(zf, zf, s - PMPD_MAX_SCALE, false);
+        s = PMPD_MAX_SCALE;
+    }
+
+    PGMP_RETURN_MPD(zf, s);
+}
+
+/*
+ * Set res to the coefficient of (c1 * 10^-s1) / (c2 * 10^-s2) with scale
+ * rscale, rounding half away from zero.
+ */
+static void
+_mpd_div(mpz_ptr res, mpz_srcptr c1, int s1, mpz_srcptr c2, int s2,
+    int rscale)
+{
+    int         e = rscale - s1 + s2;
+    mpz_t       d, r;
+
+    if (UNLIKELY(MPZ_IS_ZERO(c2))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_DIVISION_BY_ZERO),
+            errmsg("division by zero")));
+    }
+
+    mpz_init(d);
+    mpz_init(r);
+    if (e >= 0) {
+        mpz_mul_10exp(res, c1, e);
+        mpz_set(d, c2);
+    }
+    else {
+        mpz_set(res, c1);
+        mpz_mul_10exp(d, c2, -e);
+    }
+
+    mpz_tdiv_qr(res, r, res, d);
+    mpz_mul_2exp(r, r, 1);
+    if (mpz_cmpabs(r, d) >= 0) {
+        if (mpz_sgn(r) == mpz_sgn(d)) {
+            mpz_add_ui(res, res, 1);
+        }
+        else {
+            mpz_sub_ui(res, res, 1);
+        }
+    }
+
+    mpz_clear(d);
+    mpz_clear(r);
+}
+
+/* Division: the result has the largest scale of the arguments, at least
+ * PMPD_DIV_MIN_SCALE. */
+PGMP_PG_FUNCTION(pmpd_div)
+{
+    const mpz_t     c1 = {0};
+    const mpz_t     c2 = {0};
+    int             s1, s2, s;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPD(c1, s1, 0);
+    PGMP_GETARG_MPD(c2, s2, 1);
+
+    s = Max(Max(s1, s2), PMPD_DIV_MIN_SCALE);
+    s = Min(s, PMPD_MAX_SCALE);
+
+    mpz_init(zf);
+    _mpd_div(zf, c1, s1, c2, s2, s);
+
+    PGMP_RETURN_MPD(zf, s);
+}
+
+/* Division with an explicit result scale: div(mpd, mpd, int4) */
+PGMP_PG_FUNCTION(pmpd_div_scale)
+{
+    const mpz_t     c1 = {0};
+    const mpz_t     c2 = {0};
+    int             s1, s2, s;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPD(c1, s1, 0);
+    PGMP_GETARG_MPD(c2, s2, 1);
+    s = PG_GETARG_INT32(2);
+
+    if (s < 0) {
+        ereport(ERROR, (
+            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("mpd scale can't be negative: %d", s)));
+    }
+    mpd_check_scale(s);
+
+    mpz_init(zf);
+    _mpd_div(zf, c1, s1, c2, s2, s);
+
+    PGMP_RETURN_MPD(zf, s);
+}
+
+
+/*
+ * Rounding functions
+ */
+
+/* Round or truncate c * 10^-s to n decimal digits; n can be negative to
+ * round to the tens, hundreds... */
+static int
+_mpd_round(mpz_ptr res, mpz_srcptr c, int s, int64 n, bool trunc)
+{
+    if (n < -PMPD_MAX_SCALE) {
+        n = -PMPD_MAX_SCALE;
+    }
+    mpd_check_scale((int)Min(n, PG_INT32_MAX));
+
+    mpd_rescale(res, c, s, (int)n, trunc);
+    if (n < 0) {
+        mpz_mul_10exp(res, res, (int)-n);
+        n = 0;
+    }
+    return (int)n;
+}
+
+#define PMPD_ROUND(name, trunc) \
+ \
+PGMP_PG_FUNCTION(pmpd_ ## name) \
+{ \
+    const mpz_t     c = {0}; \
+    int             s; \
+    mpz_t           zf; \
+ \
+    PGMP_GETARG_MPD(c, s, 0); \
+ \
+    mpz_init(zf); \
+    s = _mpd_round(zf, c, s, 0, trunc); \
+    PGMP_RETURN_MPD(zf, s); \
+} \
+ \
+PGMP_PG_FUNCTION(pmpd_ ## name ## _n) \
+{ \
+    const mpz_t     c = {0}; \
+    int             s; \
+    mpz_t           zf; \
+ \
+    PGMP_GETARG_MPD(c, s, 0); \
+ \
+    mpz_init(zf); \
+    s = _mpd_round(zf, c, s, PG_GETARG_INT64(1), trunc); \
+    PGMP_RETURN_MPD(zf, s); \
+}
+
+PMPD_ROUND(round, false)
+PMPD_ROUND(trunc, true)
+
+
+/*
+ * Comparison operators
+ */
+
+PGMP_PG_FUNCTION(pmpd_cmp)
+{
+    const mpz_t     c1 = {0};
+    const mpz_t     c2 = {0};
+    int             s1, s2;
+
+    PGMP_GETARG_MPD(c1, s1, 0);
+    PGMP_GETARG_MPD(c2, s2, 1);
+
+    PG_RETURN_INT32(mpd_cmp(c1, s1, c2, s2));
+}
+
+
+#define PMPD_CMP(op, rel) \
+ \
+PGMP_PG_FUNCTION(pmpd_ ## op) \
+{ \
+    const mpz_t     c1 = {0}; \
+    const mpz_t     c2 = {0}; \
+    int             s1, s2; \
+ \
+    PGMP_GETARG_MPD(c1, s1, 0); \
+    PGMP_GETARG_MPD(c2, s2, 1); \
+ \
+    PG_RETURN_BOOL(mpd_cmp(c1, s1, c2, s2) rel 0); \
+}
+
+PMPD_CMP(eq, ==)
+PMPD_CMP(ne, !=)
+PMPD_CMP(gt, >)
+PMPD_CMP(ge, >=)
+PMPD_CMP(lt, <)
+PMPD_CMP(le, <=)
+
+
+/* Equal values with different scales must have the same hash, so the
+ * trailing zeros of the coefficient are dropped. An integer has the same
+ * hash of the same number as mpz.
+ */
+PGMP_PG_FUNCTION(pmpd_hash)
+{
+    const mpz_t     c = {0};
+    int             s, k;
+    mpz_t           t, ten;
+    Datum           h;
+
+    PGMP_GETARG_MPD(c, s, 0);
+
+    if (s == 0 || MPZ_IS_ZERO(c)) {
+        return pmpz_get_hash(c);
+    }
+
+    mpz_init(t);
+    mpz_init_set_ui(ten, 10);
+    k = mpz_remove(t, c, ten);
+    mpz_clear(ten);
+    if (k >= s) {
+        mpz_mul_10exp(t, t, k - s);
+        h = pmpz_get_hash(t);
+    }
+    else {
+        h = pmpz_get_hash(t);
+        h = Int32GetDatum(DatumGetInt32(h)
+            ^ DatumGetInt32(hash_uint32((uint32)(s - k))));
+    }
+    mpz_clear(t);
+
+    return h;
+}
+
+
+/*
+ * Aggregation functions
+ *
+ * The state is a coefficient with its scale and the number of the values
+ * accumulated, used by avg.
+ */
+
+typedef struct {
+    mpz_t       c;
+    int         scale;
+    int64       n;
+} pmpd_agg_state;
+
+PGMP_PG_FUNCTION(_pmpd_from_agg)
+{
+    pmpd_agg_state  *a;
+
+    a = (pmpd_agg_state *)PG_GETARG_POINTER(0);
+    PG_RETURN_POINTER(pmpd_copy_coeff(a->c, a->scale));
+}
+
+PGMP_PG_FUNCTION(_pmpd_agg_avg_final)
+{
+    pmpd_agg_state  *a;
+    mpz_t           n, zf;
+    int             s;
+
+    a = (pmpd_agg_state *)PG_GETARG_POINTER(0);
+
+    s = Max(a->scale, PMPD_DIV_MIN_SCALE);
+    mpz_init_set_si(n, a->n);
+    mpz_init(zf);
+    _mpd_div(zf, a->c, a->scale, n, 0, s);
+    mpz_clear(n);
+
+    PGMP_RETURN_MPD(zf, s);
+}
+
+/* Macro to create an accumulation function.
+ *
+ * This function can't be strict because the internal state is not compatible
+ * with the base type.
+ */
+#define PMPD_AGG(op, BLOCK, rel) \
+ \
+PGMP_PG_FUNCTION(_pmpd_agg_ ## op) \
+{ \
+    pmpd_agg_state  *a; \
+    const mpz_t     c = {0}; \
+    int             s; \
+    MemoryContext   oldctx; \
+    MemoryContext   aggctx; \
+ \
+    if (UNLIKELY(!AggCheckCallContext(fcinfo, &aggctx))) \
+    { \
+        ereport(ERROR, \
+            (errcode(ERRCODE_DATA_EXCEPTION), \
+            errmsg("_mpd_agg_" #op " can only be called in accumulation"))); \
+    } \
+ \
+    if (PG_ARGISNULL(1)) { \
+        if (PG_ARGISNULL(0)) { \
+            PG_RETURN_NULL(); \
+        } \
+        else { \
+            PG_RETURN_POINTER(PG_GETARG_POINTER(0)); \
+        } \
+    } \
+ \
+    PGMP_GETARG_MPD(c, s, 1); \
+ \
+    oldctx = MemoryContextSwitchTo(aggctx); \
+ \
+    if (LIKELY(!PG_ARGISNULL(0))) { \
+        a = (pmpd_agg_state *)PG_GETARG_POINTER(0); \
+        BLOCK(op, rel); \
+    } \
+    else {                      /* uninitialized */ \
+        a = (pmpd_agg_state *)palloc(sizeof(pmpd_agg_state)); \
+        mpz_init_set(a->c, c); \
+        a->scale = s; \
+        a->n = 0; \
+    } \
+    a->n++; \
+ \
+    MemoryContextSwitchTo(oldctx); \
+ \
+    PG_RETURN_POINTER(a); \
+}
+
+
+#define PMPD_AGG_ADD(op, rel) \
+do { \
+    if (s == a->scale) { \
+        mpz_add(a->c, a->c, c); \
+    } \
+    else if (s < a->scale) { \
+        mpz_t t; \
+        mpz_init(t); \
+        mpz_mul_10exp(t, c, a->scale - s); \
+        mpz_add(a->c, a->c, t); \
+        mpz_clear(t); \
+    } \
+    else { \
+        mpz_mul_10exp(a->c, a->c, s - a->scale); \
+        mpz_add(a->c, a->c, c); \
+        a->scale = s; \
+    } \
+} while (0)
+
+PMPD_AGG(add, PMPD_AGG_ADD, 0)
+
+
+#define PMPD_AGG_REL(op, rel) \
+do { \
+    if (mpd_cmp(a->c, a->scale, c, s) rel 0) { \
+        mpz_set(a->c, c); \
+        a->scale = s; \
+    } \
+} while (0)
+
+PMPD_AGG(min, PMPD_AGG_REL, >)
+PMPD_AGG(max, PMPD_AGG_REL, <)
@@ -85,6 +85,157 @@ pmpq_from_mpq(mpq_ptr q)
 }
 
 
+/*
+ * Write the pmpq representation of a mpq into a buffer.
+ *
+ * The buffer must be PMPQ_SIZE(q) bytes long. Unlike pmpq_from_mpq() the mpq
+ * is not changed, so it can be one read from the database.
+ */
+void
+pmpq_write_mpq(pmpq *res, mpq_srcptr q)
+{
+    mpz_srcptr  num = mpq_numref(q);
+    mpz_srcptr  den = mpq_denref(q);
+    int         nsize = NLIMBS(num);
+    int         dsize = NLIMBS(den);
+
+    SET_VARSIZE(res, PMPQ_SIZE(q));
+
+    if (UNLIKELY(nsize == 0)) {
+        /* zero is represented without limbs */
+        res->mdata = 0;
+        return;
+    }
+
+    /* Set the number of limbs and order and implicitly version 0 */
+    res->mdata = PMPQ_SET_SIZE_FIRST(PMPQ_SET_NUMER_FIRST(0), nsize);
+    if (SIZ(num) < 0) { res->mdata = PMPQ_SET_NEGATIVE(res->mdata); }
+
+    memcpy(res->data, LIMBS(num), nsize * sizeof(mp_limb_t));
+    memcpy(res->data + nsize, LIMBS(den), dsize * sizeof(mp_limb_t));
+}
+
+/*
+ * Return a new pmpq with a copy of the content of a mpq.
+ *
+ * Unlike pmpq_from_mpq() the mpq is not changed, so it can be a value read
+ * from the database or one made of the parts of other values. The mpq is
+ * trusted to be canonical: it is not checked.
+ */
+pmpq *
+pmpq_copy_mpq(mpq_srcptr q)
+{
+    pmpq *res;
+
+    res = (pmpq *)palloc(PMPQ_SIZE(q));
+    pmpq_write_mpq(res, q);
+    return res;
+}
+
+
+/*
+ * Allocate a pmpq to receive a result computed in place.
+ *
+ * The numer of q is set to write directly into the data of the pmpq, which
+ * has room for nalloc + dalloc limbs. Once the numer is final call
+ * pmpq_result_den() to place the denom right after it, then
+ * pmpq_result_finish() to get the datum: the value needs no realloc and no
+ * copy to be stored.
+ *
+ * nalloc and dalloc must be upper bounds of the limbs the mpz functions
+ * require for the numer and the denom, so that GMP never tries to grow them.
+ * The mpq doesn't own its limbs, so it must not be cleared.
+ */
+pmpq *
+pmpq_result_init(mpq_ptr q, int nalloc, int dalloc)
+{
+    pmpq        *res;
+    mpz_ptr     num = mpq_numref(q);
+    size_t      size;
+
+    size = PMPQ_HDRSIZE + (size_t)(nalloc + dalloc) * sizeof(mp_limb_t);
+    res = (pmpq *)palloc(size);
+
+    /* the full capacity, until pmpq_result_finish() is called */
+    SET_VARSIZE(res, size);
+
+    ALLOC(num) = nalloc + dalloc;
+    SIZ(num) = 0;
+    LIMBS(num) = res->data;
+
+    return res;
+}
+
+/*
+ * Set the denom of q to write into the pmpq after the limbs of the numer.
+ */
+void
+pmpq_result_den(pmpq *res, mpq_ptr q)
+{
+    mpz_ptr     den = mpq_denref(q);
+    int         nsize = NLIMBS(mpq_numref(q));
+
+    Assert(LIMBS(mpq_numref(q)) == res->data);
+
+    ALLOC(den) = PMPQ_NLIMBS(res) - nsize;
+    SIZ(den) = 0;
+    LIMBS(den) = res->data + nsize;
+}
+
+/*
+ * Complete the pmpq whose limbs were written by q.
+ */
+pmpq *
+pmpq_result_finish(pmpq *res, mpq_srcptr q)
+{
+    mpz_srcptr  num = mpq_numref(q);
+    int         nsize = NLIMBS(num);
+
+    /* GMP must have never moved the limbs */
+    Assert(LIMBS(num) == res->data);
+
+    if (UNLIKELY(nsize == 0)) {
+        /* zero is represented without limbs */
+        SET_VARSIZE(res, PMPQ_HDRSIZE);
+        res->mdata = 0;
+        return res;
+    }
+
+    Assert(LIMBS(mpq_denref(q)) == res->data + nsize);
+
+    /* Set the number of limbs and order and implicitly version 0 */
+    res->mdata = PMPQ_SET_SIZE_FIRST(PMPQ_SET_NUMER_FIRST(0), nsize);
+    if (SIZ(num) < 0) { res->mdata = PMPQ_SET_NEGATIVE(res->mdata); }
+
+    SET_VARSIZE(res, PMPQ_HDRSIZE
+        + (nsize + NLIMBS(mpq_denref(q))) * sizeof(mp_limb_t));
+
+    return res;
+}
+
+/*
+ * Build a pmpq from a canonical fraction of native words.
+ *
+ * With the __int128 type a pgmp_small can hold the product of two limbs.
+ */
+pmpq *
+pmpq_from_small(pgmp_small num, pgmp_small den, bool neg)
+{
+    mpq_t       q;
+    pmpq        *res;
+    int         n;
+
+    res = pmpq_result_init(q, PGMP_SMALL_LIMBS, PGMP_SMALL_LIMBS);
+
+    n = pgmp_small_to_limbs(num, LIMBS(mpq_numref(q)));
+    SIZ(mpq_numref(q)) = neg ? -n : n;
+    pmpq_result_den(res, q);
+    SIZ(mpq_denref(q)) = pgmp_small_to_limbs(den, LIMBS(mpq_denref(q)));
+
+    return pmpq_result_finish(res, q);
+}
+
+
 /*
  * Initialize a mpq from the content of a datum
  *
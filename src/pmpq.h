@@ -27,6 +27,7 @@
 #if PG_VERSION_NUM >= 160000
 #include "varatt.h"
 #endif
+#include "pmpz.h"               /* for pgmp_small */
 
 typedef struct
 {
@@ -81,7 +82,19 @@ typedef struct
     PG_RETURN_POINTER(pmpq_from_mpq(q))
 
 
+/* Size of the pmpq representation of a mpq */
+#define PMPQ_SIZE(q) \
+    (PMPQ_HDRSIZE + (SIZ(mpq_numref(q)) == 0 ? 0 : \
+        (NLIMBS(mpq_numref(q)) + NLIMBS(mpq_denref(q))) * sizeof(mp_limb_t)))
+
+
 pmpq * pmpq_from_mpq(mpq_ptr q);
+void pmpq_write_mpq(pmpq *res, mpq_srcptr q);
+pmpq * pmpq_copy_mpq(mpq_srcptr q);
+pmpq * pmpq_result_init(mpq_ptr q, int nalloc, int dalloc);
+void pmpq_result_den(pmpq *res, mpq_ptr q);
+pmpq * pmpq_result_finish(pmpq *res, mpq_srcptr q);
+pmpq * pmpq_from_small(pgmp_small num, pgmp_small den, bool neg);
 void mpq_from_pmpq(mpq_srcptr q, const pmpq *pq);
 
 
@@ -44,6 +44,9 @@ PGMP_PG_FUNCTION(pmpq_uplus)
     PG_RETURN_POINTER(res);
 }
 
+/* The unary operators only move the sign and the parts of the argument:
+ * the result is a copy of a view on the argument limbs. */
+
 #define PMPQ_UN(op, CHECK) \
  \
 PGMP_PG_FUNCTION(pmpq_ ## op) \
@@ -54,10 +57,37 @@ PGMP_PG_FUNCTION(pmpq_ ## op) \
     PGMP_GETARG_MPQ(q, 0); \
     CHECK(q); \
  \
-    mpq_init(qf); \
-    mpq_ ## op (qf, q); \
+    _mpq_view_ ## op (qf, q); \
  \
-    PGMP_RETURN_MPQ(qf); \
+    PG_RETURN_POINTER(pmpq_copy_mpq(qf)); \
+}
+
+static void
+_mpq_view_neg(mpq_ptr qf, mpq_srcptr q)
+{
+    *mpq_numref(qf) = *mpq_numref(q);
+    *mpq_denref(qf) = *mpq_denref(q);
+    SIZ(mpq_numref(qf)) = -SIZ(mpq_numref(qf));
+}
+
+static void
+_mpq_view_abs(mpq_ptr qf, mpq_srcptr q)
+{
+    *mpq_numref(qf) = *mpq_numref(q);
+    *mpq_denref(qf) = *mpq_denref(q);
+    SIZ(mpq_numref(qf)) = ABS(SIZ(mpq_numref(qf)));
+}
+
+static void
+_mpq_view_inv(mpq_ptr qf, mpq_srcptr q)
+{
+    /* the sign moves from the denom to the numer */
+    *mpq_numref(qf) = *mpq_denref(q);
+    *mpq_denref(qf) = *mpq_numref(q);
+    SIZ(mpq_denref(qf)) = ABS(SIZ(mpq_denref(qf)));
+    if (SIZ(mpq_numref(q)) < 0) {
+        SIZ(mpq_numref(qf)) = -SIZ(mpq_numref(qf));
+    }
 }
 
 PMPQ_UN(neg, PMPQ_NO_CHECK)
@@ -67,8 +97,382 @@ PMPQ_UN(inv, PMPQ_CHECK_DIV0)
 
 /*
  * Binary operators
+ *
+ * The results are computed in place into the pmpq returned (see
+ * pmpq_result_init()): the numer first, then the denom after it. The limbs
+ * allocated are upper bounds of what the mpz functions require to write
+ * them: the numer can take max(n1 + d2, n2 + d1) + 1 limbs in a sum and
+ * n1 + n2 in a product; the denom d1 + d2.
  */
 
+/*
+ * Fast paths of the binary operators.
+ *
+ * The mpq functions compute gcds and cross products which are not needed if
+ * the operands are integers or have the same denominator, which are the most
+ * common cases. If all the components fit in a limb the result is computed
+ * on native words, skipping the mpz functions overhead.
+ *
+ * The functions return the result, or NULL if no fast path applies.
+ */
+
+#define MPQ_IS_INTEGER(q) (mpz_cmp_ui(mpq_denref(q), 1) == 0)
+
+/* Return the integer n1 op n2, with room for nalloc limbs */
+#define PMPQ_INTEGER_RESULT(mpz_op, n1, n2, nalloc) \
+do { \
+    mpq_t       qf; \
+    pmpq        *res; \
+ \
+    res = pmpq_result_init(qf, nalloc, 1); \
+    mpz_op(mpq_numref(qf), n1, n2); \
+    pmpq_result_den(res, qf); \
+    mpz_set_ui(mpq_denref(qf), 1); \
+    return pmpq_result_finish(res, qf); \
+} while (0)
+
+/* Limbs required by the sum of n1 and n2 */
+#define ADD_NLIMBS(n1, n2) (Max(NLIMBS(n1), NLIMBS(n2)) + 1)
+
+#ifdef __SIZEOF_INT128__
+
+/* Operands with numerator and denominator of at most one limb */
+#define MPQ_IS_SMALL(q) \
+    (NLIMBS(mpq_numref(q)) <= 1 && NLIMBS(mpq_denref(q)) == 1)
+
+/* Read the components of a small mpq */
+#define MPQ_GET_SMALL(q, n, d, neg) \
+do { \
+    n = SIZ(mpq_numref(q)) ? LIMBS(mpq_numref(q))[0] : 0; \
+    d = LIMBS(mpq_denref(q))[0]; \
+    neg = SIZ(mpq_numref(q)) < 0; \
+} while (0)
+
+/* Multiply n1/d1 by n2/d2, both canonical and with limbs not 0 */
+static pmpq *
+_pmpq_mul_small(mp_limb_t n1, mp_limb_t d1, mp_limb_t n2, mp_limb_t d2,
+    bool neg)
+{
+    mp_limb_t   g1, g2;
+
+    /* cross-reduce, so the result is canonical */
+    g1 = d2 > 1 ? mpn_gcd_1(&n1, 1, d2) : 1;
+    g2 = d1 > 1 ? mpn_gcd_1(&n2, 1, d1) : 1;
+
+    return pmpq_from_small(
+        (pgmp_small)(n1 / g1) * (n2 / g2),
+        (pgmp_small)(d1 / g2) * (d2 / g1), neg);
+}
+
+#endif  /* __SIZEOF_INT128__ */
+
+/* Set z to a + b, or a - b if sub */
+static void
+_mpz_addsub(mpz_ptr z, mpz_srcptr a, mpz_srcptr b, bool sub)
+{
+    if (sub) {
+        mpz_sub(z, a, b);
+    }
+    else {
+        mpz_add(z, a, b);
+    }
+}
+
+/* Return q1 + q2, or q1 - q2 if sub */
+static pmpq *
+_pmpq_addsub_fast(mpq_srcptr q1, mpq_srcptr q2, bool sub)
+{
+    mpz_srcptr  d1 = mpq_denref(q1);
+    mpz_srcptr  d2 = mpq_denref(q2);
+
+#ifdef __SIZEOF_INT128__
+    if (MPQ_IS_SMALL(q1) && MPQ_IS_SMALL(q2))
+    {
+        mp_limb_t   n1, l1, n2, l2, g, g2;
+        pgmp_small  a, b, t;
+        bool        neg1, neg2, neg;
+
+        MPQ_GET_SMALL(q1, n1, l1, neg1);
+        MPQ_GET_SMALL(q2, n2, l2, neg2);
+        neg2 ^= sub;
+
+        if (n2 == 0 || n1 == 0) {
+            return n2 == 0 ? pmpq_copy_mpq(q1)
+                : pmpq_from_small(n2, l2, neg2);
+        }
+
+        /* n1 (l2/g) +/- n2 (l1/g), over l1 l2 / g */
+        g = l1 == l2 ? l1 : mpn_gcd_1(&l1, 1, l2);
+        a = (pgmp_small)n1 * (l2 / g);
+        b = (pgmp_small)n2 * (l1 / g);
+        if (neg1 == neg2) {
+            if ((t = a + b) < a) {
+                goto general;       /* overflow */
+            }
+            neg = neg1;
+        }
+        else if (a >= b) {
+            t = a - b;
+            neg = neg1;
+        }
+        else {
+            t = b - a;
+            neg = neg2;
+        }
+
+        if (t == 0) {
+            return pmpq_from_small(0, 1, false);
+        }
+
+        /* the only common factors of t and the denominator are in g */
+        if (g > 1)
+        {
+            mp_limb_t   tl[PGMP_SMALL_LIMBS];
+
+            g2 = mpn_gcd_1(tl, pgmp_small_to_limbs(t, tl), g);
+            return pmpq_from_small(
+                t / g2, (pgmp_small)(l1 / g) * (l2 / g2), neg);
+        }
+        return pmpq_from_small(t, (pgmp_small)l1 * l2, neg);
+    }
+general:
+#endif
+
+    if (MPQ_IS_INTEGER(q1) && MPQ_IS_INTEGER(q2))
+    {
+        int     nalloc = ADD_NLIMBS(mpq_numref(q1), mpq_numref(q2));
+
+        if (sub) {
+            PMPQ_INTEGER_RESULT(mpz_sub,
+                mpq_numref(q1), mpq_numref(q2), nalloc);
+        }
+        else {
+            PMPQ_INTEGER_RESULT(mpz_add,
+                mpq_numref(q1), mpq_numref(q2), nalloc);
+        }
+    }
+
+    if (mpz_cmp(d1, d2) == 0)
+    {
+        /* (n1 +/- n2) / d, reduced by a single gcd */
+        mpq_t       qf;
+        mpz_t       g;
+        pmpq        *res;
+
+        res = pmpq_result_init(qf,
+            ADD_NLIMBS(mpq_numref(q1), mpq_numref(q2)), NLIMBS(d1));
+        _mpz_addsub(mpq_numref(qf), mpq_numref(q1), mpq_numref(q2), sub);
+        if (SIZ(mpq_numref(qf)))
+        {
+            mpz_init(g);
+            mpz_gcd(g, mpq_numref(qf), d1);
+            if (mpz_cmp_ui(g, 1) == 0) {
+                pmpq_result_den(res, qf);
+                mpz_set(mpq_denref(qf), d1);
+            }
+            else {
+                mpz_divexact(mpq_numref(qf), mpq_numref(qf), g);
+                pmpq_result_den(res, qf);
+                mpz_divexact(mpq_denref(qf), d1, g);
+            }
+            mpz_clear(g);
+        }
+        return pmpq_result_finish(res, qf);
+    }
+
+    return NULL;
+}
+
+static pmpq *
+_pmpq_add_fast(mpq_srcptr q1, mpq_srcptr q2)
+{
+    return _pmpq_addsub_fast(q1, q2, false);
+}
+
+static pmpq *
+_pmpq_sub_fast(mpq_srcptr q1, mpq_srcptr q2)
+{
+    return _pmpq_addsub_fast(q1, q2, true);
+}
+
+static pmpq *
+_pmpq_mul_fast(mpq_srcptr q1, mpq_srcptr q2)
+{
+#ifdef __SIZEOF_INT128__
+    if (MPQ_IS_SMALL(q1) && MPQ_IS_SMALL(q2))
+    {
+        mp_limb_t   n1, d1, n2, d2;
+        bool        neg1, neg2;
+
+        MPQ_GET_SMALL(q1, n1, d1, neg1);
+        MPQ_GET_SMALL(q2, n2, d2, neg2);
+        if (n1 == 0 || n2 == 0) {
+            return pmpq_from_small(0, 1, false);
+        }
+        return _pmpq_mul_small(n1, d1, n2, d2, neg1 != neg2);
+    }
+#endif
+
+    if (MPQ_IS_INTEGER(q1) && MPQ_IS_INTEGER(q2)) {
+        PMPQ_INTEGER_RESULT(mpz_mul, mpq_numref(q1), mpq_numref(q2),
+            NLIMBS(mpq_numref(q1)) + NLIMBS(mpq_numref(q2)));
+    }
+
+    return NULL;
+}
+
+static pmpq *
+_pmpq_div_fast(mpq_srcptr q1, mpq_srcptr q2)
+{
+#ifdef __SIZEOF_INT128__
+    if (MPQ_IS_SMALL(q1) && MPQ_IS_SMALL(q2))
+    {
+        mp_limb_t   n1, d1, n2, d2;
+        bool        neg1, neg2;
+
+        /* q2 is not zero: multiply by its inverse */
+        MPQ_GET_SMALL(q1, n1, d1, neg1);
+        MPQ_GET_SMALL(q2, n2, d2, neg2);
+        if (n1 == 0) {
+            return pmpq_from_small(0, 1, false);
+        }
+        return _pmpq_mul_small(n1, d1, d2, n2, neg1 != neg2);
+    }
+#endif
+
+    return NULL;
+}
+
+/* Return n / g, or n itself if g is 1, using t as storage */
+static mpz_srcptr
+_mpz_divexact_gcd(mpz_ptr t, mpz_srcptr n, mpz_srcptr g)
+{
+    if (mpz_cmp_ui(g, 1) == 0) {
+        return n;
+    }
+    mpz_divexact(t, n, g);
+    return t;
+}
+
+/* Return q1 + q2, or q1 - q2 if sub, in the general case */
+static pmpq *
+_pmpq_addsub(mpq_srcptr q1, mpq_srcptr q2, bool sub)
+{
+    mpz_srcptr  n1 = mpq_numref(q1);
+    mpz_srcptr  d1 = mpq_denref(q1);
+    mpz_srcptr  n2 = mpq_numref(q2);
+    mpz_srcptr  d2 = mpq_denref(q2);
+    mpq_t       qf;
+    mpz_ptr     num = mpq_numref(qf);
+    mpz_srcptr  rp;
+    mpz_t       g, s, r, t;
+    pmpq        *res;
+
+    mpz_init(g);
+    mpz_init(s);
+    mpz_init(r);
+    mpz_init(t);
+
+    /* n1 (d2/g) +/- n2 (d1/g), over d1 d2 / g */
+    mpz_gcd(g, d1, d2);
+    mpz_mul(s, n1, _mpz_divexact_gcd(s, d2, g));
+    rp = _mpz_divexact_gcd(r, d1, g);
+    mpz_mul(t, n2, rp);
+
+    res = pmpq_result_init(qf, ADD_NLIMBS(s, t), NLIMBS(d1) + NLIMBS(d2));
+    _mpz_addsub(num, s, t, sub);
+    if (LIKELY(SIZ(num) != 0))
+    {
+        /* the only common factors of the numer and the denom are in g */
+        if (mpz_cmp_ui(g, 1) != 0)
+        {
+            mpz_gcd(g, num, g);
+            if (mpz_cmp_ui(g, 1) != 0) {
+                mpz_divexact(num, num, g);
+            }
+        }
+
+        pmpq_result_den(res, qf);
+        mpz_mul(mpq_denref(qf), rp, _mpz_divexact_gcd(s, d2, g));
+    }
+
+    mpz_clear(g);
+    mpz_clear(s);
+    mpz_clear(r);
+    mpz_clear(t);
+
+    return pmpq_result_finish(res, qf);
+}
+
+static pmpq *
+_pmpq_add(mpq_srcptr q1, mpq_srcptr q2)
+{
+    return _pmpq_addsub(q1, q2, false);
+}
+
+static pmpq *
+_pmpq_sub(mpq_srcptr q1, mpq_srcptr q2)
+{
+    return _pmpq_addsub(q1, q2, true);
+}
+
+/* Return n1/d1 * n2/d2, both canonical, but with d2 possibly negative */
+static pmpq *
+_pmpq_mul_parts(mpz_srcptr n1, mpz_srcptr d1, mpz_srcptr n2, mpz_srcptr d2)
+{
+    mpq_t       qf;
+    mpz_t       g1, g2, a, b;
+    pmpq        *res;
+
+    res = pmpq_result_init(qf,
+        NLIMBS(n1) + NLIMBS(n2), NLIMBS(d1) + NLIMBS(d2));
+    if (UNLIKELY(SIZ(n1) == 0 || SIZ(n2) == 0)) {
+        return pmpq_result_finish(res, qf);
+    }
+
+    /* cross-reduce, so the result is canonical */
+    mpz_init(g1);
+    mpz_init(g2);
+    mpz_init(a);
+    mpz_init(b);
+    mpz_gcd(g1, n1, d2);
+    mpz_gcd(g2, n2, d1);
+
+    mpz_mul(mpq_numref(qf),
+        _mpz_divexact_gcd(a, n1, g1), _mpz_divexact_gcd(b, n2, g2));
+    pmpq_result_den(res, qf);
+    mpz_mul(mpq_denref(qf),
+        _mpz_divexact_gcd(a, d1, g2), _mpz_divexact_gcd(b, d2, g1));
+
+    /* move the sign of d2 to the numer */
+    if (SIZ(d2) < 0) {
+        SIZ(mpq_numref(qf)) = -SIZ(mpq_numref(qf));
+        SIZ(mpq_denref(qf)) = -SIZ(mpq_denref(qf));
+    }
+
+    mpz_clear(g1);
+    mpz_clear(g2);
+    mpz_clear(a);
+    mpz_clear(b);
+
+    return pmpq_result_finish(res, qf);
+}
+
+static pmpq *
+_pmpq_mul(mpq_srcptr q1, mpq_srcptr q2)
+{
+    return _pmpq_mul_parts(
+        mpq_numref(q1), mpq_denref(q1), mpq_numref(q2), mpq_denref(q2));
+}
+
+static pmpq *
+_pmpq_div(mpq_srcptr q1, mpq_srcptr q2)
+{
+    /* multiply by the inverse of q2 */
+    return _pmpq_mul_parts(
+        mpq_numref(q1), mpq_denref(q1), mpq_denref(q2), mpq_numref(q2));
+}
+
 /* Template to generate binary operators */
 
 #define PMPQ_OP(op, CHECK2) \
@@ -77,16 +481,17 @@ PGMP_PG_FUNCTION(pmpq_ ## op) \
 { \
     const mpq_t     q1 = {0}; \
     const mpq_t     q2 = {0}; \
-    mpq_t           qf; \
+    pmpq            *res; \
  \
     PGMP_GETARG_MPQ(q1, 0); \
     PGMP_GETARG_MPQ(q2, 1); \
     CHECK2(q2); \
  \
-    mpq_init(qf); \
-    mpq_ ## op (qf, q1, q2); \
+    if (!(res = _pmpq_ ## op ## _fast(q1, q2))) { \
+        res = _pmpq_ ## op (q1, q2); \
+    } \
  \
-    PGMP_RETURN_MPQ(qf); \
+    PG_RETURN_POINTER(res); \
 }
 
 PMPQ_OP(add, PMPQ_NO_CHECK)
@@ -97,32 +502,99 @@ PMPQ_OP(div, PMPQ_CHECK_DIV0)
 
 /* Functions defined on bit count */
 
-#define PMPQ_BIT(op) \
+/* Return q * 2^b, or q / 2^b if div, simplifying the powers of 2 */
+static pmpq *
+_pmpq_shift(mpq_srcptr q, mp_bitcnt_t b, bool div)
+{
+    mpz_srcptr  n = mpq_numref(q);
+    mpz_srcptr  d = mpq_denref(q);
+    mp_bitcnt_t z;
+    mpq_t       qf;
+    pmpq        *res;
+
+    if (UNLIKELY(MPZ_IS_ZERO(n))) {
+        return pmpq_copy_mpq(q);
+    }
+
+    /* the part of the shift removing the factors 2 from the other term */
+    z = mpz_scan1(div ? n : d, 0);
+    if (z > b) { z = b; }
+
+    pgmp_check_result_bits((double)mpz_sizeinbase(div ? d : n, 2) + (b - z));
+    res = pmpq_result_init(qf,
+        NLIMBS(n) + (div ? 0 : (b - z) / GMP_NUMB_BITS + 1),
+        NLIMBS(d) + (div ? (b - z) / GMP_NUMB_BITS + 1 : 0));
+
+    if (div) {
+        mpz_tdiv_q_2exp(mpq_numref(qf), n, z);
+        pmpq_result_den(res, qf);
+        mpz_mul_2exp(mpq_denref(qf), d, b - z);
+    }
+    else {
+        mpz_mul_2exp(mpq_numref(qf), n, b - z);
+        pmpq_result_den(res, qf);
+        mpz_tdiv_q_2exp(mpq_denref(qf), d, z);
+    }
+
+    return pmpq_result_finish(res, qf);
+}
+
+#define PMPQ_BIT(op, div) \
  \
 PGMP_PG_FUNCTION(pmpq_ ## op) \
 { \
     const mpq_t     q = {0}; \
     unsigned long   b; \
-    mpq_t           qf; \
  \
     PGMP_GETARG_MPQ(q, 0); \
     PGMP_GETARG_ULONG(b, 1); \
  \
-    mpq_init(qf); \
-    mpq_ ## op (qf, q, b); \
- \
-    PGMP_RETURN_MPQ(qf); \
+    PG_RETURN_POINTER(_pmpq_shift(q, b, div)); \
 }
 
 
-PMPQ_BIT(mul_2exp)
-PMPQ_BIT(div_2exp)
+PMPQ_BIT(mul_2exp, false)
+PMPQ_BIT(div_2exp, true)
 
 
 /*
  * Comparison operators
  */
 
+/* Compare q1 and q2 avoiding the cross products where possible */
+static int
+_mpq_cmp_fast(mpq_srcptr q1, mpq_srcptr q2)
+{
+#ifdef __SIZEOF_INT128__
+    if (MPQ_IS_SMALL(q1) && MPQ_IS_SMALL(q2))
+    {
+        mp_limb_t   n1, d1, n2, d2;
+        bool        neg1, neg2;
+        pgmp_small  a, b;
+        int         s1, s2, c;
+
+        MPQ_GET_SMALL(q1, n1, d1, neg1);
+        MPQ_GET_SMALL(q2, n2, d2, neg2);
+        s1 = n1 ? (neg1 ? -1 : 1) : 0;
+        s2 = n2 ? (neg2 ? -1 : 1) : 0;
+        if (s1 != s2 || s1 == 0) {
+            return s1 - s2;
+        }
+
+        a = (pgmp_small)n1 * d2;
+        b = (pgmp_small)n2 * d1;
+        c = (a > b) - (a < b);
+        return neg1 ? -c : c;
+    }
+#endif
+
+    if (mpz_cmp(mpq_denref(q1), mpq_denref(q2)) == 0) {
+        return mpz_cmp(mpq_numref(q1), mpq_numref(q2));
+    }
+
+    return mpq_cmp(q1, q2);
+}
+
 PGMP_PG_FUNCTION(pmpq_cmp)
 {
     const mpq_t     q1 = {0};
@@ -131,7 +603,7 @@ PGMP_PG_FUNCTION(pmpq_cmp)
     PGMP_GETARG_MPQ(q1, 0);
     PGMP_GETARG_MPQ(q2, 1);
 
-    PG_RETURN_INT32(mpq_cmp(q1, q2));
+    PG_RETURN_INT32(_mpq_cmp_fast(q1, q2));
 }
 
 
@@ -162,7 +634,7 @@ PGMP_PG_FUNCTION(pmpq_ ## op) \
     PGMP_GETARG_MPQ(q1, 0); \
     PGMP_GETARG_MPQ(q2, 1); \
  \
-    PG_RETURN_BOOL(mpq_cmp(q1, q2) rel 0); \
+    PG_RETURN_BOOL(_mpq_cmp_fast(q1, q2) rel 0); \
 }
 
 PMPQ_CMP(gt, >)
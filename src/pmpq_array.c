@@ -0,0 +1,243 @@
+/* pmpq_array -- functions operating on arrays of mpq
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpq.h"
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "utils/array.h"
+
+#include <stdlib.h>                 /* for qsort */
+
+
+/*
+ * Same as in pmpz_array.c: the elements are unpacked without copying the
+ * limbs and the result is built in a single allocation.
+ */
+
+static int
+_mpq_array_unpack(FunctionCallInfo fcinfo, ArrayType *arr,
+    mpq_t **qs, bool **nulls)
+{
+    pgmp_array_meta *meta = pgmp_array_get_meta(fcinfo, ARR_ELEMTYPE(arr));
+    Datum           *elems;
+    int             n, i;
+
+    deconstruct_array(arr, meta->elemtype,
+        meta->typlen, meta->typbyval, meta->typalign,
+        &elems, nulls, &n);
+
+    *qs = (mpq_t *)palloc(n * sizeof(mpq_t));
+    for (i = 0; i < n; i++) {
+        if (!(*nulls)[i]) {
+            mpq_from_pmpq((*qs)[i], (pmpq *)PG_DETOAST_DATUM(elems[i]));
+        }
+    }
+
+    pfree(elems);
+    return n;
+}
+
+static Size
+_pmpq_elem_size(const void *values, int i)
+{
+    return PMPQ_SIZE(((mpq_t *)values)[i]);
+}
+
+static void
+_pmpq_elem_write(void *dest, const void *values, int i)
+{
+    pmpq_write_mpq((pmpq *)dest, ((mpq_t *)values)[i]);
+}
+
+static ArrayType *
+_pmpq_array_build(FunctionCallInfo fcinfo, Oid elemtype,
+    mpq_t *qs, bool *nulls, int n, int ndims, const int *dims, const int *lbs)
+{
+    return pgmp_array_build(fcinfo, elemtype,
+        qs, _pmpq_elem_size, _pmpq_elem_write,
+        nulls, n, ndims, dims, lbs);
+}
+
+
+/* Element-wise operators (mpq[], mpq[]) -> mpq[] */
+
+#define PMPQ_ARRAY_OP(op) \
+ \
+PGMP_PG_FUNCTION(pmpq_array_ ## op) \
+{ \
+    ArrayType       *a1 = PG_GETARG_ARRAYTYPE_P(0); \
+    ArrayType       *a2 = PG_GETARG_ARRAYTYPE_P(1); \
+    mpq_t           *qs1, *qs2, *qf; \
+    bool            *nulls1, *nulls2, *nulls; \
+    int             n, i; \
+ \
+    PGMP_ARRAY_CHECK_DIMS(a1, a2); \
+    n = _mpq_array_unpack(fcinfo, a1, &qs1, &nulls1); \
+    _mpq_array_unpack(fcinfo, a2, &qs2, &nulls2); \
+ \
+    qf = (mpq_t *)palloc(n * sizeof(mpq_t)); \
+    nulls = (bool *)palloc(n * sizeof(bool)); \
+    for (i = 0; i < n; i++) { \
+        if ((nulls[i] = (nulls1[i] || nulls2[i]))) { \
+            continue; \
+        } \
+        mpq_init(qf[i]); \
+        mpq_ ## op (qf[i], qs1[i], qs2[i]); \
+    } \
+ \
+    PG_RETURN_ARRAYTYPE_P(_pmpq_array_build(fcinfo, ARR_ELEMTYPE(a1), \
+        qf, nulls, n, ARR_NDIM(a1), ARR_DIMS(a1), ARR_LBOUND(a1))); \
+}
+
+PMPQ_ARRAY_OP(add)
+PMPQ_ARRAY_OP(sub)
+PMPQ_ARRAY_OP(mul)
+
+
+PGMP_PG_FUNCTION(pmpq_array_scale)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    const mpq_t     k = {0};
+    mpq_t           *qs, *qf;
+    bool            *nulls;
+    int             n, i;
+
+    PGMP_GETARG_MPQ(k, 1);
+    n = _mpq_array_unpack(fcinfo, a, &qs, &nulls);
+
+    qf = (mpq_t *)palloc(n * sizeof(mpq_t));
+    for (i = 0; i < n; i++) {
+        if (nulls[i]) {
+            continue;
+        }
+        mpq_init(qf[i]);
+        mpq_mul(qf[i], qs[i], k);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(_pmpq_array_build(fcinfo, ARR_ELEMTYPE(a),
+        qf, nulls, n, ARR_NDIM(a), ARR_DIMS(a), ARR_LBOUND(a)));
+}
+
+
+/* Reductions: nulls are ignored, return NULL if there are no values */
+
+PGMP_PG_FUNCTION(pmpq_array_dot)
+{
+    ArrayType       *a1 = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType       *a2 = PG_GETARG_ARRAYTYPE_P(1);
+    mpq_t           *qs1, *qs2;
+    bool            *nulls1, *nulls2;
+    bool            found = false;
+    int             n, i;
+    mpq_t           qf, tmp;
+
+    PGMP_ARRAY_CHECK_DIMS(a1, a2);
+    n = _mpq_array_unpack(fcinfo, a1, &qs1, &nulls1);
+    _mpq_array_unpack(fcinfo, a2, &qs2, &nulls2);
+
+    mpq_init(qf);
+    mpq_init(tmp);
+    for (i = 0; i < n; i++) {
+        if (nulls1[i] || nulls2[i]) {
+            continue;
+        }
+        mpq_mul(tmp, qs1[i], qs2[i]);
+        mpq_add(qf, qf, tmp);
+        found = true;
+    }
+
+    if (!found) {
+        PG_RETURN_NULL();
+    }
+
+    PGMP_RETURN_MPQ(qf);
+}
+
+
+#define PMPQ_ARRAY_REDUCE(name, op, init) \
+ \
+PGMP_PG_FUNCTION(pmpq_array_ ## name) \
+{ \
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0); \
+    mpq_t           *qs; \
+    bool            *nulls; \
+    bool            found = false; \
+    int             n, i; \
+    mpq_t           qf; \
+ \
+    n = _mpq_array_unpack(fcinfo, a, &qs, &nulls); \
+ \
+    mpq_init(qf); \
+    mpq_set_si(qf, init, 1); \
+    for (i = 0; i < n; i++) { \
+        if (nulls[i]) { \
+            continue; \
+        } \
+        mpq_ ## op (qf, qf, qs[i]); \
+        found = true; \
+    } \
+ \
+    if (!found) { \
+        PG_RETURN_NULL(); \
+    } \
+ \
+    PGMP_RETURN_MPQ(qf); \
+}
+
+PMPQ_ARRAY_REDUCE(sum, add, 0)
+PMPQ_ARRAY_REDUCE(prod, mul, 1)
+
+
+/* Sort an array in a one-dimensional array with the nulls last */
+
+static int
+_mpq_qsort_cmp(const void *a, const void *b)
+{
+    return mpq_cmp(*(const mpq_t *)a, *(const mpq_t *)b);
+}
+
+PGMP_PG_FUNCTION(pmpq_array_sort)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    mpq_t           *qs;
+    bool            *nulls;
+    int             n, nvals, i;
+    int             lb = 1;
+
+    n = _mpq_array_unpack(fcinfo, a, &qs, &nulls);
+
+    for (i = 0, nvals = 0; i < n; i++) {
+        if (!nulls[i]) {
+            *(qs[nvals++]) = *(qs[i]);
+        }
+    }
+
+    qsort(qs, nvals, sizeof(mpq_t), _mpq_qsort_cmp);
+
+    for (i = 0; i < n; i++) {
+        nulls[i] = (i >= nvals);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(_pmpq_array_build(fcinfo, ARR_ELEMTYPE(a),
+        qs, nulls, n, 1, &n, &lb));
+}
@@ -33,13 +33,44 @@
  * Input/Output functions
  */
 
+static pgmp_small
+_pgmp_small_gcd(pgmp_small a, pgmp_small b)
+{
+    pgmp_small  t;
+
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
 PGMP_PG_FUNCTION(pmpq_in)
 {
-    char    *str;
-    mpq_t   q;
+    char        *str;
+    const char  *end;
+    pgmp_small  num, den = 1, g;
+    bool        neg, dneg = false;
+    mpq_t       q;
 
     str = PG_GETARG_CSTRING(0);
 
+    /* Fast path for small values: see pmpz_in */
+    if ((end = pgmp_small_parse(str, &num, &neg))
+        && (*end == '\0' || (*end == '/'
+            && (end = pgmp_small_parse(end + 1, &den, &dneg))
+            && *end == '\0'))
+        && !dneg && den != 0)
+    {
+        if (den != 1) {
+            g = _pgmp_small_gcd(num, den);
+            num /= g;
+            den /= g;
+        }
+        PG_RETURN_POINTER(pmpq_from_small(num, den, neg));
+    }
+
     mpq_init(q);
     if (0 != mpq_set_str(q, str, 0))
     {
@@ -96,9 +127,26 @@ PGMP_PG_FUNCTION(pmpq_out)
 {
     const mpq_t     q = {0};
     char            *buf;
+    pgmp_small      num, den;
+    char            *p;
 
     PGMP_GETARG_MPQ(q, 0);
 
+    if (mpz_get_small(mpq_numref(q), &num)
+        && mpz_get_small(mpq_denref(q), &den))
+    {
+        p = buf = palloc(2 * PGMP_SMALL_BUFSIZE);
+        if (SIZ(mpq_numref(q)) < 0) {
+            *p++ = '-';
+        }
+        p = pgmp_small_format(p, num);
+        if (den != 1) {
+            *p++ = '/';
+            pgmp_small_format(p, den);
+        }
+        PG_RETURN_CSTRING(buf);
+    }
+
     /* Allocate the output buffer manually - see mpmz_out to know why */
     buf = palloc(3             /* add sign, slash and null */
         + mpz_sizeinbase(mpq_numref(q), 10)
@@ -211,54 +259,87 @@ PGMP_PG_FUNCTION(pmpq_from_int8)
 }
 
 
-/* To convert from numeric we convert the numeric in str, then work on that */
+/* Return 10^n.
+ *
+ * The conversions usually work with the same scale for many calls (e.g.
+ * the scale of a column type) so the last power is cached in fn_extra.
+ * The returned value must not be modified.
+ */
+typedef struct
+{
+    int         n;
+    mpz_t       p;
 
-PGMP_PG_FUNCTION(pmpq_from_numeric)
+} pmpq_pow10_cache;
+
+static mpz_srcptr
+_pmpq_pow10(FunctionCallInfo fcinfo, int n)
 {
-    mpq_t       q;
-    char        *sn, *pn;
+    pmpq_pow10_cache    *c;
+    MemoryContext       oldctx;
+
+    if (UNLIKELY(!fcinfo->flinfo)) {
+        mpz_ptr p = (mpz_ptr)palloc(sizeof(mpz_t));
+        mpz_init(p);
+        mpz_ui_pow_ui(p, 10, n);
+        return p;
+    }
 
-    sn = DatumGetCString(DirectFunctionCall1(numeric_out,
-            PG_GETARG_DATUM(0)));
+    c = (pmpq_pow10_cache *)fcinfo->flinfo->fn_extra;
+    if (LIKELY(c != NULL && c->n == n)) {
+        return c->p;
+    }
 
-    if ((pn = strchr(sn, '.')))
-    {
-        char    *sd, *pd;
+    oldctx = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    if (c == NULL) {
+        c = (pmpq_pow10_cache *)palloc(sizeof(pmpq_pow10_cache));
+        mpz_init(c->p);
+        fcinfo->flinfo->fn_extra = c;
+    }
+    mpz_ui_pow_ui(c->p, 10, n);
+    c->n = n;
+    MemoryContextSwitchTo(oldctx);
 
-        /* Convert "123.45" into "12345" and produce "100" in the process. */
-        pd = sd = (char *)palloc(strlen(sn));
-        *pd++ = '1';
-        while (pn[1])
-        {
-            pn[0] = pn[1];
-            ++pn;
-            *pd++ = '0';
-        }
-        *pd = *pn = '\0';
+    return c->p;
+}
 
-        if (0 != mpz_init_set_str(mpq_numref(q), sn, 10)) {
-            goto error;
-        }
+/* To convert from numeric we build the fraction from its base 10000 digits */
 
-        mpz_init_set_str(mpq_denref(q), sd, 10);
-        mpq_canonicalize(q);
-    }
-    else {
-        /* just an integer */
-        if (0 != mpz_init_set_str(mpq_numref(q), sn, 10)) {
-            goto error;
-        }
-        mpz_init_set_si(mpq_denref(q), 1L);
+PGMP_PG_FUNCTION(pmpq_from_numeric)
+{
+    pgmp_numeric    num;
+    int             e;
+    mpq_t           q;
+
+    pgmp_numeric_unpack(&num, PG_GETARG_DATUM(0));
+
+    if (UNLIKELY(num.sign != PGMP_NUMERIC_POS
+            && num.sign != PGMP_NUMERIC_NEG)) {
+        ereport(ERROR, (
+            errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+            errmsg("can't convert numeric value to mpq: \"%s\"",
+                DatumGetCString(DirectFunctionCall1(numeric_out,
+                    PG_GETARG_DATUM(0))))));
     }
 
-    PGMP_RETURN_MPQ(q);
+    /* value = digits * 10000^e */
+    mpz_init(mpq_numref(q));
+    mpz_init_set_si(mpq_denref(q), 1L);
+    mpz_set_numeric_digits(mpq_numref(q), num.digits, num.ndigits);
+    if (num.sign == PGMP_NUMERIC_NEG) {
+        mpz_neg(mpq_numref(q), mpq_numref(q));
+    }
 
-error:
-    ereport(ERROR, (
-        errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
-        errmsg("can't convert numeric value to mpq: \"%s\"", sn)));
+    e = num.weight + 1 - num.ndigits;
+    if (e > 0) {
+        mpz_mul(mpq_numref(q), mpq_numref(q), _pmpq_pow10(fcinfo, 4 * e));
+    }
+    else if (e < 0) {
+        mpz_set(mpq_denref(q), _pmpq_pow10(fcinfo, -4 * e));
+        mpq_canonicalize(q);
+    }
 
-    PG_RETURN_NULL();
+    PGMP_RETURN_MPQ(q);
 }
 
 PGMP_PG_FUNCTION(pmpq_from_mpz)
@@ -326,14 +407,17 @@ PGMP_PG_FUNCTION(pmpq_to_float8)
 }
 
 
+/* Convert q to a numeric truncating it at the scale specified in typmod (or
+ * to 15 digits, without trailing zeros, if there is no typmod). The
+ * precision of the result is checked by numeric_recv.
+ */
 PGMP_PG_FUNCTION(pmpq_to_numeric)
 {
     const mpq_t     q = {0};
     int32           typmod;
-    long            scale;
+    int             scale, pad, nfrac, i;
     mpz_t           z;
-    char            *buf;
-    int             sbuf, snum;
+    pgmp_numeric    num;
 
     PGMP_GETARG_MPQ(q, 0);
     typmod = PG_GETARG_INT32(1);
@@ -346,77 +430,57 @@ PGMP_PG_FUNCTION(pmpq_to_numeric)
         scale = 15;
     }
 
-    if (scale) {
-        /* Convert q into a scaled z */
-        char *cmult;
-        mpz_t mult;
-
-        /* create 10000... with as many 0s as the scale */
-        cmult = (char *)palloc(scale + 2);
-        memset(cmult + 1, '0', scale);
-        cmult[0] = '1';
-        cmult[scale + 1] = '\0';
-        mpz_init_set_str(mult, cmult, 10);
-        pfree(cmult);
-
-        mpz_init(z);
-        mpz_mul(z, mpq_numref(q), mult);
-        sbuf = mpz_sizeinbase(z, 10);       /* size of the output buffer */
-        mpz_tdiv_q(z, z, mpq_denref(q));
-        snum = mpz_sizeinbase(z, 10);       /* size of the number */
+    mpz_init(z);
+    if (mpz_cmp_ui(mpq_denref(q), 1) == 0) {
+        /* An integer: no scaling needed, the decimals are all zero and are
+         * not stored */
+        mpz_set(z, mpq_numref(q));
+        pad = 0;
+        nfrac = 0;
+        if (typmod < VARHDRSZ) {
+            scale = 0;
+        }
     }
     else {
-        /* Just truncate q into an integer */
-        mpz_init(z);
-        mpz_set_q(z, q);
-        sbuf = snum = mpz_sizeinbase(z, 10);
-    }
-
-    /* If the numer is 0, everything is a special case: bail out */
-    if (mpz_cmp_si(z, 0) == 0) {
-        return DirectFunctionCall3(numeric_in,
-            CStringGetDatum("0"),
-            ObjectIdGetDatum(0),            /* unused 2nd value */
-            Int32GetDatum(typmod));
-    }
-
-    /* convert z into a string */
-    buf = palloc(sbuf + 3);                 /* add sign, point and null */
-    mpz_get_str(buf, 10, z);
-    if (scale) {
-        char *end, *p;
-
-        /* Left pad with 0s the number if smaller than the buffer */
-        if (snum < sbuf) {
-            char *num0 = buf + (buf[0] == '-'); /* start of the num w/o sign */
-            memmove(num0 + (sbuf - snum), num0, snum + 1);
-            memset(num0, '0', sbuf - snum);
+        /* Truncate q * 10^scale, then align it to the base 10000 digits */
+        pad = (4 - scale % 4) % 4;
+        nfrac = (scale + pad) / 4;
+        mpz_mul(z, mpq_numref(q), _pmpq_pow10(fcinfo, scale));
+        mpz_tdiv_q(z, z, mpq_denref(q));
+        if (pad) {
+            mpz_mul_ui(z, z, pad == 1 ? 10 : pad == 2 ? 100 : 1000);
         }
+    }
 
-        end = buf + strlen(buf);
+    /* nfrac is the number of digits after the decimal point in z */
+    num.digits = mpz_get_numeric_digits(z, &num.ndigits);
+    num.weight = num.ndigits - 1 - nfrac;
+    num.sign = SIZ(z) < 0 ? PGMP_NUMERIC_NEG : PGMP_NUMERIC_POS;
+    num.dscale = scale;
 
-        /* Add the decimal point in the right place */
-        memmove(end - scale + 1, end - scale, scale + 1);
-        end[-scale] = '.';
+    /* Without typmod, drop the trailing zeros from the decimal digits */
+    if (typmod < VARHDRSZ)
+    {
+        num.dscale += pad;
+        for (i = num.ndigits - 1; i >= 0 && num.dscale > 0; i--)
+        {
+            int16   d = num.digits[i];
 
-        /* delete trailing 0s or they will be used to add extra precision */
-        if (typmod < VARHDRSZ) {        /* scale was not specified */
-            for (p = end; p > (end - scale) && *p == '0'; --p) {
-                *p = '\0';
+            if (d == 0) {
+                num.dscale -= 4;
+                continue;
             }
-            /* Don't leave a traliling point */
-            if (*p == '.') {
-                *p = '\0';
+            while (d % 10 == 0) {
+                num.dscale--;
+                d /= 10;
             }
+            break;
         }
+        /* i < 0 if there are no non-zero digits */
+        num.dscale = i < 0 ? 0 : Max(num.dscale, 0);
     }
 
-    /* use numeric_in to build the value from the string and to apply the
-     * typemod (which may result in overflow) */
-    return DirectFunctionCall3(numeric_in,
-        CStringGetDatum(buf),
-        ObjectIdGetDatum(0),    /* unused 2nd value */
-        Int32GetDatum(typmod));
+    return pgmp_numeric_pack(&num, typmod);
 }
 
 
@@ -430,13 +494,21 @@ PGMP_PG_FUNCTION(pmpq_mpz_mpz)
     const mpz_t     den = {0};
     mpq_t           q;
 
-    /* We must take a copy of num and den because they may be modified by
-     * canonicalize */
     PGMP_GETARG_MPZ(num, 0);
     PGMP_GETARG_MPZ(den, 1);
     ERROR_IF_DENOM_ZERO(den);
 
-    /* Put together the input and canonicalize */
+    /* A fraction with denominator 1 is already canonical: copy the parts
+     * straight into the result */
+    if (mpz_cmp_ui(den, 1) == 0)
+    {
+        *mpq_numref(q) = *num;
+        *mpq_denref(q) = *den;
+        PG_RETURN_POINTER(pmpq_copy_mpq(q));
+    }
+
+    /* Put together the input and canonicalize. We must take a copy of num
+     * and den because they may be modified by canonicalize */
     mpz_init_set(mpq_numref(q), num);
     mpz_init_set(mpq_denref(q), den);
     mpq_canonicalize(q);
@@ -69,6 +69,37 @@ pmpz_from_mpz(mpz_srcptr z)
 }
 
 
+/*
+ * Write the pmpz representation of a mpz into a buffer.
+ *
+ * The buffer must be PMPZ_SIZE(z) bytes long. Unlike pmpz_from_mpz() the mpz
+ * can be any, e.g. one read from the database.
+ */
+void
+pmpz_write_mpz(pmpz *res, mpz_srcptr z)
+{
+    SET_VARSIZE(res, PMPZ_SIZE(z));
+    res->mdata = SIZ(z) < 0 ? PMPZ_SIGN_MASK : 0;   /* version: 0 */
+    memcpy(res->data, LIMBS(z), NLIMBS(z) * sizeof(mp_limb_t));
+}
+
+/*
+ * Return a new pmpz with a copy of the content of a mpz.
+ *
+ * Unlike pmpz_from_mpz() the mpz is not changed, so it can be a value read
+ * from the database or one that will be used again.
+ */
+pmpz *
+pmpz_copy_mpz(mpz_srcptr z)
+{
+    pmpz *res;
+
+    res = (pmpz *)palloc(PMPZ_SIZE(z));
+    pmpz_write_mpz(res, z);
+    return res;
+}
+
+
 /*
  * Initialize a mpz from the content of a datum
  *
@@ -27,6 +27,9 @@
 #if PG_VERSION_NUM >= 160000
 #include "varatt.h"
 #endif
+#include "fmgr.h"
+#include "utils/array.h"
+#include "utils/expandeddatum.h"
 
 typedef struct
 {
@@ -40,13 +43,30 @@ typedef struct
 #define PMPZ_HDRSIZE   MAXALIGN(offsetof(pmpz,data))
 
 
+/* Expanded representation of an mpz, holding a live mpz_t.
+ *
+ * The limbs are allocated in the object memory context, so the value can be
+ * updated in place by the functions receiving a read-write pointer to it.
+ * See pmpz_expanded.c for details.
+ */
+typedef struct
+{
+    ExpandedObjectHeader    hdr;
+    int                     magic;
+    mpz_t                   z;
+
+} pmpz_expanded;
+
+#define PMPZ_EXPANDED_MAGIC 0x2d506d7a
+
+
 /* Macros to convert mpz arguments and return values */
 
 #define PGMP_GETARG_PMPZ(n) \
     ((pmpz*)(PG_DETOAST_DATUM(PG_GETARG_DATUM(n))))
 
 #define PGMP_GETARG_MPZ(z,n) \
-    mpz_from_pmpz(z, PGMP_GETARG_PMPZ(n));
+    mpz_from_datum(z, PG_GETARG_DATUM(n));
 
 #define PGMP_RETURN_MPZ(z) \
     PG_RETURN_POINTER(pmpz_from_mpz(z))
@@ -107,16 +127,191 @@ do { \
 #define PMPZ_NEGATIVE(mz) (((mz)->mdata) & PMPZ_SIGN_MASK)
 
 
+/* Size of the pmpz representation of a mpz */
+#define PMPZ_SIZE(z) (PMPZ_HDRSIZE + NLIMBS(z) * sizeof(mp_limb_t))
+
+
+/* A divisor classified by the division functions.
+ *
+ * Divisors whose absolute value is a power of 2 or fits in an unsigned long
+ * can be handled by the faster GMP functions _2exp and _ui.
+ */
+typedef enum
+{
+    PMPZ_DIVISOR_MPZ,
+    PMPZ_DIVISOR_UI,
+    PMPZ_DIVISOR_2EXP
+
+} pmpz_divisor_kind;
+
+typedef struct
+{
+    pmpz_divisor_kind   kind;       /* kind of abs(d) */
+    unsigned long       ui;         /* abs(d), if kind is UI */
+    unsigned long       exp;        /* log2(abs(d)), if kind is 2EXP */
+
+} pmpz_divisor;
+
+
+/* Information about the elements of an array, used by the array functions */
+typedef struct
+{
+    Oid         elemtype;
+    int16       typlen;
+    bool        typbyval;
+    char        typalign;
+
+} pgmp_array_meta;
+
+/* Size and writer of the i-th value of a vector, to build arrays from it */
+typedef Size (*pgmp_array_size_f)(const void *values, int i);
+typedef void (*pgmp_array_write_f)(void *dest, const void *values, int i);
+
+/* Raise an error if two arrays don't have the same shape */
+#define PGMP_ARRAY_CHECK_DIMS(a1, a2) \
+do { \
+    if (ARR_NDIM(a1) != ARR_NDIM(a2) \
+        || memcmp(ARR_DIMS(a1), ARR_DIMS(a2), \
+            ARR_NDIM(a1) * sizeof(int)) != 0) \
+    { \
+        ereport(ERROR, ( \
+            errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), \
+            errmsg("arrays must have the same dimensions"))); \
+    } \
+} while (0)
+
+
+/* A numeric value unpacked into its base 10000 digits.
+ *
+ * The digits are the most significant first; the value is
+ * sum(digits[i] * 10000^(weight - i)). See pmpz_numeric.c.
+ */
+typedef struct
+{
+    int         ndigits;
+    int         weight;
+    int         sign;
+    int         dscale;
+    int16       *digits;
+
+} pgmp_numeric;
+
+#define PGMP_NUMERIC_POS    0x0000
+#define PGMP_NUMERIC_NEG    0x4000
+
+
+/* Unsigned integers handled by the fast paths of the input/output functions.
+ * See pmpz_io.c. */
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 pgmp_small;
+#define PGMP_SMALL_DIGITS 38
+#else
+typedef uint64 pgmp_small;
+#define PGMP_SMALL_DIGITS 19
+#endif
+
+/* Max number of limbs in a pgmp_small */
+#define PGMP_SMALL_LIMBS \
+    ((sizeof(pgmp_small) * 8 + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS)
+
+/* Size of a buffer to print a pgmp_small with sign and terminator */
+#define PGMP_SMALL_BUFSIZE (PGMP_SMALL_DIGITS + 3)
+
+
 /* Definitions useful for internal use in mpz-related modules */
 
 pmpz * pmpz_from_mpz(mpz_srcptr z);
+void pmpz_write_mpz(pmpz *res, mpz_srcptr z);
+pmpz * pmpz_copy_mpz(mpz_srcptr z);
 void mpz_from_pmpz(mpz_srcptr z, const pmpz *pz);
+void mpz_from_datum(mpz_srcptr z, Datum d);
+pmpz_expanded * pmpz_expanded_target(FunctionCallInfo fcinfo, int n);
+struct Node * pmpz_support_plan(struct Node *rawreq);
+
+/* Interruptible and size-checked versions of the GMP functions */
+void mpz_fac_ui_intr(mpz_ptr res, unsigned long n);
+void mpz_fib_ui_intr(mpz_ptr fn, unsigned long n);
+void mpz_fib2_ui_intr(mpz_ptr fn, mpz_ptr fnsub1, unsigned long n);
+void mpz_lucnum_ui_intr(mpz_ptr ln, unsigned long n);
+void mpz_lucnum2_ui_intr(mpz_ptr ln, mpz_ptr lnsub1, unsigned long n);
+void mpz_pow_ui_intr(mpz_ptr res, mpz_srcptr base, unsigned long exp);
+void mpz_bin_ui_intr(mpz_ptr res, mpz_srcptr n, unsigned long k);
+void mpz_mul_2exp_intr(mpz_ptr res, mpz_srcptr z, mp_bitcnt_t b);
+void mpz_powm_intr(mpz_ptr res, mpz_srcptr base, mpz_srcptr exp,
+    mpz_srcptr mod);
+void mpz_nextprime_intr(mpz_ptr res, mpz_srcptr z);
+void mpz_prod_ui_intr(mpz_ptr res, const unsigned long *v, size_t n);
+uint8 * pmpz_odd_sieve(unsigned long n);
+
+/* Trial division by the table of the small primes */
+unsigned long pmpz_trial_limit(size_t nbits);
+const uint32 * pmpz_small_primes(unsigned long limit, int *n);
+unsigned long pmpz_small_factor(mpz_srcptr z, unsigned long limit);
+int mpz_bpsw_prime_p(mpz_srcptr z, int reps);
+int mpz_probab_prime_p_table(mpz_srcptr z, int reps);
+int mpz_factor(mpz_srcptr n, mpz_t **primes, int **exps);
+
+/* Number of bits of the n-th Fibonacci number, log2 of the golden ratio */
+#define PMPZ_FIB_BITS(n) (0.6942419 * (n))
+
+/* Versions of the sequence functions using the results cache */
+void mpz_fac_ui_cached(mpz_ptr res, unsigned long n);
+void mpz_fib_ui_cached(mpz_ptr fn, unsigned long n);
+void mpz_fib2_ui_cached(mpz_ptr fn, mpz_ptr fnsub1, unsigned long n);
+void mpz_lucnum_ui_cached(mpz_ptr ln, unsigned long n);
+void mpz_lucnum2_ui_cached(mpz_ptr ln, mpz_ptr lnsub1, unsigned long n);
+void mpz_bin_ui_cached(mpz_ptr res, mpz_srcptr n, unsigned long k);
+void pmpz_const_reset(void);
+void pmpz_get_divisor(pmpz_divisor *dv, mpz_srcptr d);
+pgmp_array_meta * pgmp_array_get_meta(FunctionCallInfo fcinfo, Oid elemtype);
+int mpz_array_unpack(FunctionCallInfo fcinfo, ArrayType *arr,
+    mpz_t **zs, bool **nulls);
+ArrayType * pgmp_array_build(FunctionCallInfo fcinfo, Oid elemtype,
+    const void *values, pgmp_array_size_f size, pgmp_array_write_f write,
+    bool *nulls, int n, int ndims, const int *dims, const int *lbs);
+ArrayType * pmpz_array_build(FunctionCallInfo fcinfo, Oid elemtype,
+    mpz_t *zs, bool *nulls, int n, int ndims, const int *dims, const int *lbs);
+void mpz_array_invert(mpz_t *res, bool *resnulls, mpz_t *zs,
+    const bool *nulls, int n, mpz_srcptr m);
 int pmpz_get_int64(mpz_srcptr z, int64 *out);
+void pgmp_numeric_unpack(pgmp_numeric *num, Datum d);
+Datum pgmp_numeric_pack(const pgmp_numeric *num, int32 typmod);
+void mpz_set_numeric_digits(mpz_ptr z, const int16 *digits, int n);
+int16 * mpz_get_numeric_digits(mpz_srcptr z, int *n);
 Datum pmpz_get_hash(mpz_srcptr z);
+const char * pgmp_small_parse(const char *str, pgmp_small *v, bool *neg);
+char * pgmp_small_format(char *buf, pgmp_small v);
+int pgmp_small_to_limbs(pgmp_small v, mp_limb_t *limbs);
+bool mpz_get_small(mpz_srcptr z, pgmp_small *v);
 
 #define MPZ_IS_ZERO(z) (SIZ(z) == 0)
 
 
+/* Macros to write a function result into an expanded mpz.
+ *
+ * PGMP_EXPANDED_TARGET(n) returns the object to write the result into if the
+ * function can work in place on its n-th argument, else NULL. The result must
+ * be computed with the object memory context set as current, and an argument
+ * aliasing the target must be passed to GMP as the target itself (GMP only
+ * supports aliasing on the same mpz_t structure): PGMP_EXPANDED_SRC() takes
+ * care of it.
+ */
+#define PGMP_EXPANDED_TARGET(n) pmpz_expanded_target(fcinfo, n)
+
+#define PGMP_EXPANDED_SRC(ez,src) \
+    (LIMBS(src) == LIMBS((ez)->z) ? (mpz_srcptr)(ez)->z : (mpz_srcptr)(src))
+
+#define PGMP_EXPANDED_EVAL(ez,expr) \
+do { \
+    MemoryContext _oldctx = MemoryContextSwitchTo((ez)->hdr.eoh_context); \
+    expr; \
+    MemoryContextSwitchTo(_oldctx); \
+} while (0)
+
+#define PGMP_RETURN_EXPANDED(ez) \
+    PG_RETURN_DATUM(EOHPGetRWDatum(&(ez)->hdr))
+
+
 /* Macros to be used in functions wrappers to limit the arguments domain */
 
 #define PMPZ_NO_CHECK(arg)
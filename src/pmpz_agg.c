@@ -23,6 +23,8 @@
 #include "pgmp-impl.h"
 
 #include "fmgr.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"        /* for get_element_type */
 
 
 /* Convert an inplace accumulator into a pmpz structure.
@@ -107,3 +109,101 @@ do { \
 PMPZ_AGG(min, PMPZ_AGG_REL, >)
 PMPZ_AGG(max, PMPZ_AGG_REL, <)
 
+
+/*
+ * invert_agg(z, m) aggregate: the array of the inverses of z modulo m, in the
+ * order of the input rows, computed at the end by mpz_array_invert().
+ *
+ * The modulus must be the same in all the rows. The elements are null where
+ * z is null or has no inverse.
+ */
+
+typedef struct
+{
+    int             n;
+    int             size;
+    mpz_t           *zs;
+    bool            *nulls;
+    mpz_t           m;
+
+} pmpz_invert_state;
+
+PGMP_PG_FUNCTION(_pmpz_agg_invert)
+{
+    pmpz_invert_state   *s;
+    const mpz_t         z = {0};
+    const mpz_t         m = {0};
+    MemoryContext       oldctx;
+    MemoryContext       aggctx;
+
+    if (UNLIKELY(!AggCheckCallContext(fcinfo, &aggctx)))
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_DATA_EXCEPTION),
+            errmsg("_mpz_agg_invert can only be called in accumulation")));
+    }
+
+    if (UNLIKELY(PG_ARGISNULL(2))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+            errmsg("invert_agg modulus cannot be null")));
+    }
+    PGMP_GETARG_MPZ(m, 2);
+
+    oldctx = MemoryContextSwitchTo(aggctx);
+
+    if (LIKELY(!PG_ARGISNULL(0))) {
+        s = (pmpz_invert_state *)PG_GETARG_POINTER(0);
+        if (UNLIKELY(mpz_cmp(s->m, m) != 0)) {
+            ereport(ERROR, (
+                errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("invert_agg modulus must be the same in all the rows")));
+        }
+    }
+    else {                      /* uninitialized */
+        s = (pmpz_invert_state *)palloc(sizeof(pmpz_invert_state));
+        s->n = 0;
+        s->size = 8;
+        s->zs = (mpz_t *)palloc(s->size * sizeof(mpz_t));
+        s->nulls = (bool *)palloc(s->size * sizeof(bool));
+        mpz_init_set(s->m, m);
+    }
+
+    if (s->n >= s->size) {
+        s->size *= 2;
+        s->zs = (mpz_t *)repalloc(s->zs, s->size * sizeof(mpz_t));
+        s->nulls = (bool *)repalloc(s->nulls, s->size * sizeof(bool));
+    }
+    if (!(s->nulls[s->n] = PG_ARGISNULL(1))) {
+        PGMP_GETARG_MPZ(z, 1);
+        mpz_init_set(s->zs[s->n], z);
+    }
+    s->n++;
+
+    MemoryContextSwitchTo(oldctx);
+
+    PG_RETURN_POINTER(s);
+}
+
+PGMP_PG_FUNCTION(_pmpz_agg_invert_final)
+{
+    pmpz_invert_state   *s = (pmpz_invert_state *)PG_GETARG_POINTER(0);
+    Oid                 elemtype;
+    mpz_t               *zf;
+    bool                *nulls;
+    int                 lb = 1;
+
+    elemtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+    if (UNLIKELY(!OidIsValid(elemtype))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_DATATYPE_MISMATCH),
+            errmsg("could not determine the mpz array type")));
+    }
+
+    zf = (mpz_t *)palloc(s->n * sizeof(mpz_t));
+    nulls = (bool *)palloc(s->n * sizeof(bool));
+    mpz_array_invert(zf, nulls, s->zs, s->nulls, s->n, s->m);
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, elemtype,
+        zf, nulls, s->n, 1, &s->n, &lb));
+}
@@ -49,17 +49,28 @@ PGMP_PG_FUNCTION(pmpz_uplus)
 }
 
 
-/* Template to generate unary functions */
+/* Template to generate unary functions
+ *
+ * The functions generated by this and the following templates can work in
+ * place on an expanded first argument (see pmpz_expanded.c).
+ */
 
 #define PMPZ_UN(op, CHECK) \
  \
 PGMP_PG_FUNCTION(pmpz_ ## op) \
 { \
     const mpz_t     z1 = {0}; \
+    pmpz_expanded   *ez; \
     mpz_t           zf; \
  \
     PGMP_GETARG_MPZ(z1, 0); \
     CHECK(z1); \
+ \
+    if ((ez = PGMP_EXPANDED_TARGET(0))) { \
+        PGMP_EXPANDED_EVAL(ez, \
+            mpz_ ## op (ez->z, PGMP_EXPANDED_SRC(ez, z1))); \
+        PGMP_RETURN_EXPANDED(ez); \
+    } \
  \
     mpz_init(zf); \
     mpz_ ## op (zf, z1); \
@@ -88,11 +99,18 @@ PGMP_PG_FUNCTION(pmpz_ ## op) \
 { \
     const mpz_t     z1 = {0}; \
     const mpz_t     z2 = {0}; \
+    pmpz_expanded   *ez; \
     mpz_t           zf; \
  \
     PGMP_GETARG_MPZ(z1, 0); \
     PGMP_GETARG_MPZ(z2, 1); \
     CHECK2(z2); \
+ \
+    if ((ez = PGMP_EXPANDED_TARGET(0))) { \
+        PGMP_EXPANDED_EVAL(ez, \
+            mpz_ ## op (ez->z, PGMP_EXPANDED_SRC(ez, z1), z2)); \
+        PGMP_RETURN_EXPANDED(ez); \
+    } \
  \
     mpz_init(zf); \
     mpz_ ## op (zf, z1, z2); \
@@ -103,13 +121,6 @@ PGMP_PG_FUNCTION(pmpz_ ## op) \
 PMPZ_OP(add,        PMPZ_NO_CHECK)
 PMPZ_OP(sub,        PMPZ_NO_CHECK)
 PMPZ_OP(mul,        PMPZ_NO_CHECK)
-PMPZ_OP(tdiv_q,     PMPZ_CHECK_DIV0)
-PMPZ_OP(tdiv_r,     PMPZ_CHECK_DIV0)
-PMPZ_OP(cdiv_q,     PMPZ_CHECK_DIV0)
-PMPZ_OP(cdiv_r,     PMPZ_CHECK_DIV0)
-PMPZ_OP(fdiv_q,     PMPZ_CHECK_DIV0)
-PMPZ_OP(fdiv_r,     PMPZ_CHECK_DIV0)
-PMPZ_OP(divexact,   PMPZ_CHECK_DIV0)
 PMPZ_OP(and,        PMPZ_NO_CHECK)
 PMPZ_OP(ior,        PMPZ_NO_CHECK)
 PMPZ_OP(xor,        PMPZ_NO_CHECK)
@@ -118,6 +129,89 @@ PMPZ_OP(lcm,        PMPZ_NO_CHECK)
 PMPZ_OP(remove,     PMPZ_NO_CHECK)      /* TODO: return value not returned */
 
 
+/*
+ * Classify the divisor d, to dispatch to the GMP _2exp and _ui functions.
+ *
+ * The test is cheap compared to the division, so it is done at every call.
+ */
+void
+pmpz_get_divisor(pmpz_divisor *dv, mpz_srcptr d)
+{
+    dv->kind = PMPZ_DIVISOR_MPZ;
+    if (LIKELY(!MPZ_IS_ZERO(d)))
+    {
+        /* the lowest bit set is the same in d and abs(d) */
+        dv->exp = mpz_scan1(d, 0);
+        if (dv->exp == mpz_sizeinbase(d, 2) - 1) {
+            dv->kind = PMPZ_DIVISOR_2EXP;
+        }
+        else if (NLIMBS(d) == 1
+                && sizeof(mp_limb_t) <= sizeof(unsigned long)) {
+            dv->kind = PMPZ_DIVISOR_UI;
+            dv->ui = (unsigned long)LIMBS(d)[0];
+        }
+    }
+}
+
+
+/* Division operators defined (mpz, mpz) -> mpz.
+ *
+ * If the divisor is positive dispatch to the GMP _2exp or _ui variant of the
+ * function, when possible.
+ */
+
+/* there is no mpz_divexact_2exp: it would be the same of tdiv_q_2exp */
+#define mpz_divexact_2exp mpz_tdiv_q_2exp
+
+#define PMPZ_DIV_EVAL(op, tgt, n, d, dv) \
+do { \
+    if (SIZ(d) > 0 && (dv)->kind == PMPZ_DIVISOR_2EXP) { \
+        mpz_ ## op ## _2exp (tgt, n, (dv)->exp); \
+    } \
+    else if (SIZ(d) > 0 && (dv)->kind == PMPZ_DIVISOR_UI) { \
+        mpz_ ## op ## _ui (tgt, n, (dv)->ui); \
+    } \
+    else { \
+        mpz_ ## op (tgt, n, d); \
+    } \
+} while (0)
+
+#define PMPZ_DIV(op) \
+ \
+PGMP_PG_FUNCTION(pmpz_ ## op) \
+{ \
+    const mpz_t     z1 = {0}; \
+    const mpz_t     z2 = {0}; \
+    pmpz_divisor    dv; \
+    pmpz_expanded   *ez; \
+    mpz_t           zf; \
+ \
+    PGMP_GETARG_MPZ(z1, 0); \
+    PGMP_GETARG_MPZ(z2, 1); \
+    PMPZ_CHECK_DIV0(z2); \
+    pmpz_get_divisor(&dv, z2); \
+ \
+    if ((ez = PGMP_EXPANDED_TARGET(0))) { \
+        PGMP_EXPANDED_EVAL(ez, \
+            PMPZ_DIV_EVAL(op, ez->z, PGMP_EXPANDED_SRC(ez, z1), z2, &dv)); \
+        PGMP_RETURN_EXPANDED(ez); \
+    } \
+ \
+    mpz_init(zf); \
+    PMPZ_DIV_EVAL(op, zf, z1, z2, &dv); \
+ \
+    PGMP_RETURN_MPZ(zf); \
+}
+
+PMPZ_DIV(tdiv_q)
+PMPZ_DIV(tdiv_r)
+PMPZ_DIV(cdiv_q)
+PMPZ_DIV(cdiv_r)
+PMPZ_DIV(fdiv_q)
+PMPZ_DIV(fdiv_r)
+PMPZ_DIV(divexact)
+
+
 /* Operators defined (mpz, mpz) -> (mpz, mpz). */
 
 #define PMPZ_OP2(op, CHECK2) \
@@ -145,14 +239,18 @@ PMPZ_OP2(cdiv_qr,    PMPZ_CHECK_DIV0)
 PMPZ_OP2(fdiv_qr,    PMPZ_CHECK_DIV0)
 
 
-/* Functions defined on unsigned long */
+/* Functions defined on unsigned long
+ *
+ * FUNC is the GMP function implementing op, or its interruptible version.
+ */
 
-#define PMPZ_OP_UL(op, CHECK1, CHECK2) \
+#define PMPZ_OP_UL(op, CHECK1, CHECK2, FUNC) \
  \
 PGMP_PG_FUNCTION(pmpz_ ## op) \
 { \
     const mpz_t     z = {0}; \
     unsigned long   b; \
+    pmpz_expanded   *ez; \
     mpz_t           zf; \
  \
     PGMP_GETARG_MPZ(z, 0); \
@@ -160,16 +258,22 @@ PGMP_PG_FUNCTION(pmpz_ ## op) \
     \
     PGMP_GETARG_ULONG(b, 1); \
     CHECK2(b); \
+ \
+    if ((ez = PGMP_EXPANDED_TARGET(0))) { \
+        PGMP_EXPANDED_EVAL(ez, \
+            FUNC (ez->z, PGMP_EXPANDED_SRC(ez, z), b)); \
+        PGMP_RETURN_EXPANDED(ez); \
+    } \
  \
     mpz_init(zf); \
-    mpz_ ## op (zf, z, b); \
+    FUNC (zf, z, b); \
  \
     PGMP_RETURN_MPZ(zf); \
 }
 
-PMPZ_OP_UL(pow_ui,  PMPZ_NO_CHECK,      PMPZ_CHECK_ULONG_MAX)
-PMPZ_OP_UL(root,    PMPZ_CHECK_NONEG,   PMPZ_CHECK_LONG_POS)
-PMPZ_OP_UL(bin_ui,  PMPZ_NO_CHECK,      PMPZ_CHECK_LONG_NONEG)
+PMPZ_OP_UL(pow_ui,  PMPZ_NO_CHECK,      PMPZ_CHECK_ULONG_MAX,   mpz_pow_ui_intr)
+PMPZ_OP_UL(root,    PMPZ_CHECK_NONEG,   PMPZ_CHECK_LONG_POS,    mpz_root)
+PMPZ_OP_UL(bin_ui,  PMPZ_NO_CHECK,      PMPZ_CHECK_LONG_NONEG,  mpz_bin_ui_cached)
 
 
 /* Functions defined on bit count
@@ -179,13 +283,13 @@ PMPZ_OP_UL(bin_ui,  PMPZ_NO_CHECK,      PMPZ_CHECK_LONG_NONEG)
 
 #define PMPZ_OP_BITCNT PMPZ_OP_UL
 
-PMPZ_OP_BITCNT(mul_2exp,        PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
-PMPZ_OP_BITCNT(tdiv_q_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
-PMPZ_OP_BITCNT(tdiv_r_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
-PMPZ_OP_BITCNT(cdiv_q_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
-PMPZ_OP_BITCNT(cdiv_r_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
-PMPZ_OP_BITCNT(fdiv_q_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
-PMPZ_OP_BITCNT(fdiv_r_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK)
+PMPZ_OP_BITCNT(mul_2exp,        PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_mul_2exp_intr)
+PMPZ_OP_BITCNT(tdiv_q_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_tdiv_q_2exp)
+PMPZ_OP_BITCNT(tdiv_r_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_tdiv_r_2exp)
+PMPZ_OP_BITCNT(cdiv_q_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_cdiv_q_2exp)
+PMPZ_OP_BITCNT(cdiv_r_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_cdiv_r_2exp)
+PMPZ_OP_BITCNT(fdiv_q_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_fdiv_q_2exp)
+PMPZ_OP_BITCNT(fdiv_r_2exp,     PMPZ_NO_CHECK,  PMPZ_NO_CHECK,  mpz_fdiv_r_2exp)
 
 
 /* Unary predicates */
@@ -287,6 +391,7 @@ PGMP_PG_FUNCTION(pmpz_divisible)
 {
     const mpz_t     n = {0};
     const mpz_t     d = {0};
+    pmpz_divisor    dv;
 
     PGMP_GETARG_MPZ(n, 0);
     PGMP_GETARG_MPZ(d, 1);
@@ -298,6 +403,17 @@ PGMP_PG_FUNCTION(pmpz_divisible)
     }
 #endif
 
+    /* the sign of the divisor doesn't matter here */
+    pmpz_get_divisor(&dv, d);
+    switch (dv.kind) {
+        case PMPZ_DIVISOR_2EXP:
+            PG_RETURN_BOOL(mpz_divisible_2exp_p(n, dv.exp));
+        case PMPZ_DIVISOR_UI:
+            PG_RETURN_BOOL(mpz_divisible_ui_p(n, dv.ui));
+        default:
+            break;
+    }
+
     PG_RETURN_BOOL(mpz_divisible_p(n, d));
 }
 
@@ -317,6 +433,7 @@ PGMP_PG_FUNCTION(pmpz_congruent)
     const mpz_t     n = {0};
     const mpz_t     c = {0};
     const mpz_t     d = {0};
+    pmpz_divisor    dv;
 
     PGMP_GETARG_MPZ(n, 0);
     PGMP_GETARG_MPZ(c, 1);
@@ -329,6 +446,16 @@ PGMP_PG_FUNCTION(pmpz_congruent)
     }
 #endif
 
+    pmpz_get_divisor(&dv, d);
+    switch (dv.kind) {
+        case PMPZ_DIVISOR_2EXP:
+            PG_RETURN_BOOL(mpz_congruent_2exp_p(n, c, dv.exp));
+        case PMPZ_DIVISOR_UI:
+            PG_RETURN_BOOL(
+                mpz_fdiv_ui(n, dv.ui) == mpz_fdiv_ui(c, dv.ui));
+        default:
+            break;
+    }
 
     PG_RETURN_BOOL(mpz_congruent_p(n, c, d));
 }
@@ -346,23 +473,3 @@ PGMP_PG_FUNCTION(pmpz_congruent_2exp)
     PG_RETURN_BOOL(mpz_congruent_2exp_p(n, c, b));
 }
 
-
-PGMP_PG_FUNCTION(pmpz_powm)
-{
-    const mpz_t     base = {0};
-    const mpz_t     exp = {0};
-    const mpz_t     mod = {0};
-    mpz_t           zf;
-
-    PGMP_GETARG_MPZ(base, 0);
-    PGMP_GETARG_MPZ(exp, 1);
-    PMPZ_CHECK_NONEG(exp);
-    PGMP_GETARG_MPZ(mod, 2);
-    PMPZ_CHECK_DIV0(mod);
-
-    mpz_init(zf);
-    mpz_powm(zf, base, exp, mod);
-
-    PGMP_RETURN_MPZ(zf);
-}
-
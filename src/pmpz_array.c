@@ -0,0 +1,499 @@
+/* pmpz_array -- functions operating on arrays of mpz
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+#include "utils/array.h"
+#include "utils/lsyscache.h"        /* for get_typlenbyvalalign */
+#include "utils/memutils.h"         /* for AllocSizeIsValid */
+
+#include <stdlib.h>                 /* for qsort */
+
+
+/*
+ * Array functions unpack every element only once into an mpz_t (which
+ * doesn't copy the limbs) and build the result in a single allocation.
+ */
+
+/*
+ * Return the storage information about the array elements.
+ *
+ * The information is cached in fn_extra: it is used by the mpq array
+ * functions too. Set returning functions keep their FuncCallContext in
+ * fn_extra, so for them the information is looked up at every call.
+ */
+pgmp_array_meta *
+pgmp_array_get_meta(FunctionCallInfo fcinfo, Oid elemtype)
+{
+    pgmp_array_meta *meta;
+
+    if (fcinfo->flinfo->fn_retset)
+    {
+        meta = (pgmp_array_meta *)palloc(sizeof(pgmp_array_meta));
+        get_typlenbyvalalign(elemtype,
+            &meta->typlen, &meta->typbyval, &meta->typalign);
+        meta->elemtype = elemtype;
+        return meta;
+    }
+
+    meta = (pgmp_array_meta *)fcinfo->flinfo->fn_extra;
+    if (UNLIKELY(meta == NULL || meta->elemtype != elemtype))
+    {
+        if (meta == NULL) {
+            meta = (pgmp_array_meta *)MemoryContextAlloc(
+                fcinfo->flinfo->fn_mcxt, sizeof(pgmp_array_meta));
+            fcinfo->flinfo->fn_extra = meta;
+        }
+
+        get_typlenbyvalalign(elemtype,
+            &meta->typlen, &meta->typbyval, &meta->typalign);
+        meta->elemtype = elemtype;
+    }
+
+    return meta;
+}
+
+
+/*
+ * Unpack the elements of an array into a vector of mpz.
+ *
+ * Return the number of elements. The mpz don't own their data, so they must
+ * not be changed (see mpz_from_pmpz()). The null elements are flagged in the
+ * nulls vector and their mpz is left uninitialized.
+ */
+int
+mpz_array_unpack(FunctionCallInfo fcinfo, ArrayType *arr,
+    mpz_t **zs, bool **nulls)
+{
+    pgmp_array_meta *meta = pgmp_array_get_meta(fcinfo, ARR_ELEMTYPE(arr));
+    Datum           *elems;
+    int             n, i;
+
+    deconstruct_array(arr, meta->elemtype,
+        meta->typlen, meta->typbyval, meta->typalign,
+        &elems, nulls, &n);
+
+    *zs = (mpz_t *)palloc(n * sizeof(mpz_t));
+    for (i = 0; i < n; i++) {
+        if (!(*nulls)[i]) {
+            mpz_from_datum((*zs)[i], elems[i]);
+        }
+    }
+
+    pfree(elems);
+    return n;
+}
+
+
+/*
+ * Build an array from a vector of n values of elemtype.
+ *
+ * The size of the i-th value in the array is returned by size(values, i), and
+ * write(dest, values, i) writes it at dest. nulls may be NULL if there are no
+ * null elements. The array is allocated in one go and the values written
+ * straight into it. Used by the mpq array functions too.
+ */
+ArrayType *
+pgmp_array_build(FunctionCallInfo fcinfo, Oid elemtype,
+    const void *values, pgmp_array_size_f size, pgmp_array_write_f write,
+    bool *nulls, int n, int ndims, const int *dims, const int *lbs)
+{
+    pgmp_array_meta *meta = pgmp_array_get_meta(fcinfo, elemtype);
+    ArrayType       *res;
+    Size            nbytes = 0;
+    int32           dataoffset = 0;
+    bool            hasnulls = false;
+    bits8           *bitmap;
+    char            *p;
+    int             i;
+
+    if (n == 0) {
+        return construct_empty_array(elemtype);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (nulls && nulls[i]) {
+            hasnulls = true;
+            continue;
+        }
+        nbytes += size(values, i);
+        nbytes = att_align_nominal(nbytes, meta->typalign);
+    }
+
+    if (hasnulls) {
+        dataoffset = ARR_OVERHEAD_WITHNULLS(ndims, n);
+        nbytes += dataoffset;
+    }
+    else {
+        nbytes += ARR_OVERHEAD_NONULLS(ndims);
+    }
+
+    if (UNLIKELY(!AllocSizeIsValid(nbytes))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("array size exceeds the maximum allowed (%d)",
+                (int)MaxAllocSize)));
+    }
+
+    res = (ArrayType *)palloc0(nbytes);
+    SET_VARSIZE(res, nbytes);
+    res->ndim = ndims;
+    res->dataoffset = dataoffset;
+    res->elemtype = elemtype;
+    memcpy(ARR_DIMS(res), dims, ndims * sizeof(int));
+    memcpy(ARR_LBOUND(res), lbs, ndims * sizeof(int));
+
+    bitmap = ARR_NULLBITMAP(res);
+    p = ARR_DATA_PTR(res);
+
+    for (i = 0; i < n; i++)
+    {
+        if (nulls && nulls[i]) {
+            continue;
+        }
+        if (bitmap) {
+            bitmap[i / 8] |= 1 << (i % 8);
+        }
+        write(p, values, i);
+        p += att_align_nominal(size(values, i), meta->typalign);
+    }
+
+    return res;
+}
+
+
+static Size
+_pmpz_elem_size(const void *values, int i)
+{
+    return PMPZ_SIZE(((mpz_t *)values)[i]);
+}
+
+static void
+_pmpz_elem_write(void *dest, const void *values, int i)
+{
+    pmpz_write_mpz((pmpz *)dest, ((mpz_t *)values)[i]);
+}
+
+/*
+ * Build an array of mpz from a vector of values.
+ */
+ArrayType *
+pmpz_array_build(FunctionCallInfo fcinfo, Oid elemtype,
+    mpz_t *zs, bool *nulls, int n, int ndims, const int *dims, const int *lbs)
+{
+    return pgmp_array_build(fcinfo, elemtype,
+        zs, _pmpz_elem_size, _pmpz_elem_write,
+        nulls, n, ndims, dims, lbs);
+}
+
+
+/* Element-wise operators (mpz[], mpz[]) -> mpz[]
+ *
+ * The result is null where either of the arguments is null.
+ */
+
+#define PMPZ_ARRAY_OP(op) \
+ \
+PGMP_PG_FUNCTION(pmpz_array_ ## op) \
+{ \
+    ArrayType       *a1 = PG_GETARG_ARRAYTYPE_P(0); \
+    ArrayType       *a2 = PG_GETARG_ARRAYTYPE_P(1); \
+    mpz_t           *zs1, *zs2, *zf; \
+    bool            *nulls1, *nulls2, *nulls; \
+    int             n, i; \
+ \
+    PGMP_ARRAY_CHECK_DIMS(a1, a2); \
+    n = mpz_array_unpack(fcinfo, a1, &zs1, &nulls1); \
+    mpz_array_unpack(fcinfo, a2, &zs2, &nulls2); \
+ \
+    zf = (mpz_t *)palloc(n * sizeof(mpz_t)); \
+    nulls = (bool *)palloc(n * sizeof(bool)); \
+    for (i = 0; i < n; i++) { \
+        if ((nulls[i] = (nulls1[i] || nulls2[i]))) { \
+            continue; \
+        } \
+        mpz_init(zf[i]); \
+        mpz_ ## op (zf[i], zs1[i], zs2[i]); \
+    } \
+ \
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a1), \
+        zf, nulls, n, ARR_NDIM(a1), ARR_DIMS(a1), ARR_LBOUND(a1))); \
+}
+
+PMPZ_ARRAY_OP(add)
+PMPZ_ARRAY_OP(sub)
+PMPZ_ARRAY_OP(mul)
+
+
+/* Multiply every element of an array by a scalar */
+
+PGMP_PG_FUNCTION(pmpz_array_scale)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    const mpz_t     k = {0};
+    mpz_t           *zs, *zf;
+    bool            *nulls;
+    int             n, i;
+
+    PGMP_GETARG_MPZ(k, 1);
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+
+    zf = (mpz_t *)palloc(n * sizeof(mpz_t));
+    for (i = 0; i < n; i++) {
+        if (nulls[i]) {
+            continue;
+        }
+        mpz_init(zf[i]);
+        mpz_mul(zf[i], zs[i], k);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a),
+        zf, nulls, n, ARR_NDIM(a), ARR_DIMS(a), ARR_LBOUND(a)));
+}
+
+
+/* Reductions of an array to a single value.
+ *
+ * Null elements are ignored. If there are no elements left return NULL, as
+ * the aggregate functions do.
+ */
+
+PGMP_PG_FUNCTION(pmpz_array_dot)
+{
+    ArrayType       *a1 = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType       *a2 = PG_GETARG_ARRAYTYPE_P(1);
+    mpz_t           *zs1, *zs2;
+    bool            *nulls1, *nulls2;
+    bool            found = false;
+    int             n, i;
+    mpz_t           zf;
+
+    PGMP_ARRAY_CHECK_DIMS(a1, a2);
+    n = mpz_array_unpack(fcinfo, a1, &zs1, &nulls1);
+    mpz_array_unpack(fcinfo, a2, &zs2, &nulls2);
+
+    mpz_init(zf);
+    for (i = 0; i < n; i++) {
+        if (nulls1[i] || nulls2[i]) {
+            continue;
+        }
+        mpz_addmul(zf, zs1[i], zs2[i]);
+        found = true;
+    }
+
+    if (!found) {
+        PG_RETURN_NULL();
+    }
+
+    PGMP_RETURN_MPZ(zf);
+}
+
+
+#define PMPZ_ARRAY_REDUCE(name, op, init) \
+ \
+PGMP_PG_FUNCTION(pmpz_array_ ## name) \
+{ \
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0); \
+    mpz_t           *zs; \
+    bool            *nulls; \
+    bool            found = false; \
+    int             n, i; \
+    mpz_t           zf; \
+ \
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls); \
+ \
+    mpz_init_set_si(zf, init); \
+    for (i = 0; i < n; i++) { \
+        if (nulls[i]) { \
+            continue; \
+        } \
+        mpz_ ## op (zf, zf, zs[i]); \
+        found = true; \
+    } \
+ \
+    if (!found) { \
+        PG_RETURN_NULL(); \
+    } \
+ \
+    PGMP_RETURN_MPZ(zf); \
+}
+
+PMPZ_ARRAY_REDUCE(sum, add, 0)
+PMPZ_ARRAY_REDUCE(prod, mul, 1)
+
+
+/* Sort an array in ascending order, with the nulls last.
+ *
+ * The result is a one-dimensional array.
+ */
+
+static int
+_mpz_qsort_cmp(const void *a, const void *b)
+{
+    return mpz_cmp(*(const mpz_t *)a, *(const mpz_t *)b);
+}
+
+PGMP_PG_FUNCTION(pmpz_array_sort)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    mpz_t           *zs;
+    bool            *nulls;
+    int             n, nvals, i;
+    int             lb = 1;
+
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+
+    /* move the values before the nulls */
+    for (i = 0, nvals = 0; i < n; i++) {
+        if (!nulls[i]) {
+            *(zs[nvals++]) = *(zs[i]);
+        }
+    }
+
+    qsort(zs, nvals, sizeof(mpz_t), _mpz_qsort_cmp);
+
+    for (i = 0; i < n; i++) {
+        nulls[i] = (i >= nvals);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a),
+        zs, nulls, n, 1, &n, &lb));
+}
+
+
+/*
+ * Compute the inverses modulo m of n values by Montgomery's trick.
+ *
+ * With p[k] the product of the first k+1 values, a single inversion of the
+ * last p gives all the inverses going backwards:
+ *
+ *      1/z[k] = 1/p[k] * p[k-1],  1/p[k-1] = 1/p[k] * z[k]
+ *
+ * so the cost is one inversion and 3(n-1) multiplications modulo m instead of
+ * n inversions. The elements null in nulls and the ones without an inverse
+ * are flagged in resnulls and their res is left uninitialized.
+ */
+void
+mpz_array_invert(mpz_t *res, bool *resnulls, mpz_t *zs, const bool *nulls,
+    int n, mpz_srcptr m)
+{
+    mpz_t           *p;
+    mpz_t           inv, t;
+    int             *idx;
+    int             nv = 0, i, k;
+
+    /* the non-null elements reduced modulo m, without the multiples of m */
+    idx = (int *)palloc((n + 1) * sizeof(int));
+    for (i = 0; i < n; i++)
+    {
+        if ((resnulls[i] = nulls[i])) {
+            continue;
+        }
+        if (mpz_cmpabs_ui(m, 1) <= 0) {
+            /* leave the corner cases to GMP */
+            mpz_init(res[i]);
+            resnulls[i] = !mpz_invert(res[i], zs[i], m);
+            continue;
+        }
+        mpz_init(res[i]);
+        mpz_mod(res[i], zs[i], m);
+        if (MPZ_IS_ZERO(res[i])) {
+            resnulls[i] = true;
+            continue;
+        }
+        idx[nv++] = i;
+    }
+    if (!nv) {
+        pfree(idx);
+        return;
+    }
+
+    p = (mpz_t *)palloc(nv * sizeof(mpz_t));
+    mpz_init_set(p[0], res[idx[0]]);
+    for (k = 1; k < nv; k++) {
+        mpz_init(p[k]);
+        mpz_mul(p[k], p[k - 1], res[idx[k]]);
+        mpz_mod(p[k], p[k], m);
+        if (UNLIKELY((k & 0xFFF) == 0)) {
+            CHECK_FOR_INTERRUPTS();
+        }
+    }
+
+    mpz_init(inv);
+    mpz_init(t);
+    if (mpz_invert(inv, p[nv - 1], m))
+    {
+        for (k = nv - 1; k > 0; k--)
+        {
+            i = idx[k];
+            mpz_mul(t, inv, p[k - 1]);
+            mpz_mod(t, t, m);
+            mpz_mul(inv, inv, res[i]);
+            mpz_mod(inv, inv, m);
+            mpz_swap(res[i], t);
+            if (UNLIKELY((k & 0xFFF) == 0)) {
+                CHECK_FOR_INTERRUPTS();
+            }
+        }
+        mpz_swap(res[idx[0]], inv);
+    }
+    else
+    {
+        /* some element shares a factor with m: invert them one by one */
+        for (k = 0; k < nv; k++) {
+            i = idx[k];
+            resnulls[i] = !mpz_invert(res[i], res[i], m);
+        }
+    }
+
+    for (k = 0; k < nv; k++) {
+        mpz_clear(p[k]);
+    }
+    pfree(p);
+    pfree(idx);
+    mpz_clear(inv);
+    mpz_clear(t);
+}
+
+/* Invert every element of an array modulo m */
+
+PGMP_PG_FUNCTION(pmpz_array_invert)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    const mpz_t     m = {0};
+    mpz_t           *zs, *zf;
+    bool            *nulls, *fnulls;
+    int             n;
+
+    PGMP_GETARG_MPZ(m, 1);
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+
+    zf = (mpz_t *)palloc((n + 1) * sizeof(mpz_t));
+    fnulls = (bool *)palloc((n + 1) * sizeof(bool));
+    mpz_array_invert(zf, fnulls, zs, nulls, n, m);
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a),
+        zf, fnulls, n, ARR_NDIM(a), ARR_DIMS(a), ARR_LBOUND(a)));
+}
@@ -0,0 +1,495 @@
+/* pmpz_cache -- cache of the results of the sequence functions
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "access/htup_details.h"    /* for heap_form_tuple */
+#include "lib/ilist.h"
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+#include "utils/memutils.h"         /* for TopMemoryContext */
+
+#include <math.h>
+
+
+/*
+ * Queries often compute the same factorials, Fibonacci numbers or binomials
+ * on every row, or values close to each other (fac(n) for a range of n).
+ * The large results are kept in a per-backend cache, limited in size by
+ * pgmp.cache_size and evicted in LRU order. A value missing from the cache
+ * can be computed from a close one:
+ *
+ *      n! = m! * (m+1) * ... * n
+ *      F[m+d] = F[m] F[d+1] + F[m-1] F[d]
+ *      F[m+d-1] = F[m] F[d] + F[m-1] F[d-1]
+ *      bin(n, k+1) = bin(n, k) * (n-k) / (k+1)
+ *      bin(n+1, k) = bin(n, k) * (n+1) / (n+1-k)
+ *
+ * The Lucas numbers are computed from the Fibonacci numbers, so they share
+ * the same entries.
+ */
+
+/* Results smaller than this are cheaper to compute than to look up */
+#define PMPZ_CACHE_MIN_BITS 4096
+
+/* Maximum number of steps to compute a binomial from a cached one */
+#define PMPZ_CACHE_BIN_STEPS 16
+
+#define LOG2_E 1.4426950408889634
+
+typedef enum
+{
+    PMPZ_CACHE_FAC,
+    PMPZ_CACHE_FIB,
+    PMPZ_CACHE_BIN
+
+} pmpz_cache_kind;
+
+typedef struct
+{
+    dlist_node      node;
+    pmpz_cache_kind kind;
+    unsigned long   n;
+    unsigned long   k;          /* only for bin */
+    mpz_t           v;
+    mpz_t           v1;         /* F[n-1], only for fib */
+    Size            size;
+
+} pmpz_cache_entry;
+
+static MemoryContext cache_ctx = NULL;
+static dlist_head cache_lru = DLIST_STATIC_INIT(cache_lru);
+static Size cache_used = 0;
+static int64 cache_entries = 0;
+
+static int64 cache_hits = 0;
+static int64 cache_partial_hits = 0;
+static int64 cache_misses = 0;
+
+
+#define PMPZ_CACHE_LIMIT ((Size)pgmp_cache_size * 1024)
+
+static void
+_cache_remove(pmpz_cache_entry *e)
+{
+    dlist_delete(&e->node);
+    cache_used -= e->size;
+    cache_entries--;
+
+    mpz_clear(e->v);
+    if (e->kind == PMPZ_CACHE_FIB) {
+        mpz_clear(e->v1);
+    }
+    pfree(e);
+}
+
+/* Evict the least recently used entries until the cache fits in size */
+static void
+_cache_evict(Size size)
+{
+    while (cache_used > size && !dlist_is_empty(&cache_lru)) {
+        _cache_remove(dlist_tail_element(pmpz_cache_entry, node, &cache_lru));
+    }
+}
+
+/* Return true if a result of about nbits bits should go through the cache */
+static bool
+_cache_worth(double nbits)
+{
+    return pgmp_cache_size > 0 && nbits >= PMPZ_CACHE_MIN_BITS;
+}
+
+static void
+_cache_add(pmpz_cache_kind kind, unsigned long n, unsigned long k,
+    mpz_srcptr v, mpz_srcptr v1)
+{
+    pmpz_cache_entry    *e;
+    MemoryContext       oldctx;
+    Size                size;
+
+    if (!_cache_worth(mpz_sizeinbase(v, 2))) {
+        return;
+    }
+
+    size = sizeof(pmpz_cache_entry)
+        + (NLIMBS(v) + (v1 ? NLIMBS(v1) : 0)) * sizeof(mp_limb_t);
+    if (size > PMPZ_CACHE_LIMIT / 4) {
+        return;
+    }
+
+    if (!cache_ctx) {
+        cache_ctx = AllocSetContextCreate(TopMemoryContext,
+            "pgmp cache", ALLOCSET_DEFAULT_SIZES);
+    }
+    _cache_evict(PMPZ_CACHE_LIMIT - size);
+
+    oldctx = MemoryContextSwitchTo(cache_ctx);
+    e = (pmpz_cache_entry *)palloc(sizeof(pmpz_cache_entry));
+    e->kind = kind;
+    e->n = n;
+    e->k = k;
+    mpz_init_set(e->v, v);
+    if (v1) {
+        mpz_init_set(e->v1, v1);
+    }
+    e->size = size;
+    MemoryContextSwitchTo(oldctx);
+
+    dlist_push_head(&cache_lru, &e->node);
+    cache_used += size;
+    cache_entries++;
+}
+
+/* Return the number of steps to compute (n, k) from the entry e, or
+ * ULONG_MAX if e can't be used */
+static unsigned long
+_cache_distance(const pmpz_cache_entry *e, unsigned long n, unsigned long k)
+{
+    switch (e->kind)
+    {
+        case PMPZ_CACHE_FAC:
+        case PMPZ_CACHE_FIB:
+            if (e->n < n && n - e->n <= n / 16) {
+                return n - e->n;
+            }
+            break;
+
+        case PMPZ_CACHE_BIN:
+            if (e->n == n && e->k < k && k - e->k <= PMPZ_CACHE_BIN_STEPS) {
+                return k - e->k;
+            }
+            if (e->k == k && e->n < n && n - e->n <= PMPZ_CACHE_BIN_STEPS) {
+                return n - e->n;
+            }
+            break;
+    }
+    return ULONG_MAX;
+}
+
+/*
+ * Look for the value (n, k) in the cache.
+ *
+ * Return the entry if found, else NULL and, in *near, the closest entry it
+ * can be computed from, if any. The hit and miss counts are updated here:
+ * the caller is expected to add the value it computes.
+ */
+static pmpz_cache_entry *
+_cache_lookup(pmpz_cache_kind kind, unsigned long n, unsigned long k,
+    pmpz_cache_entry **near)
+{
+    dlist_iter          iter;
+    pmpz_cache_entry    *e;
+    unsigned long       d, dnear = ULONG_MAX;
+
+    *near = NULL;
+    dlist_foreach(iter, &cache_lru)
+    {
+        e = dlist_container(pmpz_cache_entry, node, iter.cur);
+        if (e->kind != kind) {
+            continue;
+        }
+        if (e->n == n && e->k == k) {
+            dlist_move_head(&cache_lru, &e->node);
+            cache_hits++;
+            return e;
+        }
+        if ((d = _cache_distance(e, n, k)) < dnear) {
+            dnear = d;
+            *near = e;
+        }
+    }
+
+    if (*near) {
+        dlist_move_head(&cache_lru, &(*near)->node);
+        cache_partial_hits++;
+    }
+    else {
+        cache_misses++;
+    }
+    return NULL;
+}
+
+
+/*
+ * Factorial.
+ */
+
+void
+mpz_fac_ui_cached(mpz_ptr res, unsigned long n)
+{
+    pmpz_cache_entry    *e, *near;
+    unsigned long       *v, i, acc;
+    size_t              nv = 0;
+    mpz_t               t;
+
+    if (!_cache_worth(n * log2(n + 1.0))) {
+        mpz_fac_ui_intr(res, n);
+        return;
+    }
+
+    /* checked here too, as the limit may have changed since caching */
+    pgmp_check_result_bits(lgamma(n + 1.0) * LOG2_E);
+
+    if ((e = _cache_lookup(PMPZ_CACHE_FAC, n, 0, &near))) {
+        mpz_set(res, e->v);
+        return;
+    }
+
+    if (!near) {
+        mpz_fac_ui_intr(res, n);
+        _cache_add(PMPZ_CACHE_FAC, n, 0, res, NULL);
+        return;
+    }
+
+    /* n! = m! * (m+1) * ... * n, with the factors packed in words */
+    v = (unsigned long *)palloc((n - near->n) * sizeof(unsigned long));
+    acc = 1;
+    for (i = near->n + 1; i <= n; i++)
+    {
+        if (acc > ULONG_MAX / i) {
+            v[nv++] = acc;
+            acc = i;
+        }
+        else {
+            acc *= i;
+        }
+    }
+    v[nv++] = acc;
+
+    mpz_init(t);
+    mpz_prod_ui_intr(t, v, nv);
+    pfree(v);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(res, near->v, t);
+    mpz_clear(t);
+
+    _cache_add(PMPZ_CACHE_FAC, n, 0, res, NULL);
+}
+
+
+/*
+ * Fibonacci and Lucas numbers.
+ */
+
+void
+mpz_fib2_ui_cached(mpz_ptr fn, mpz_ptr fnsub1, unsigned long n)
+{
+    pmpz_cache_entry    *e, *near;
+    mpz_t               fd1, fd, fdsub1, t;
+
+    if (!_cache_worth(PMPZ_FIB_BITS(n))) {
+        mpz_fib2_ui_intr(fn, fnsub1, n);
+        return;
+    }
+
+    pgmp_check_result_bits(PMPZ_FIB_BITS(n));
+
+    if ((e = _cache_lookup(PMPZ_CACHE_FIB, n, 0, &near))) {
+        mpz_set(fn, e->v);
+        mpz_set(fnsub1, e->v1);
+        return;
+    }
+
+    if (!near) {
+        mpz_fib2_ui_intr(fn, fnsub1, n);
+        _cache_add(PMPZ_CACHE_FIB, n, 0, fn, fnsub1);
+        return;
+    }
+
+    /* F[d+1], F[d], F[d-1] with d = n - m */
+    mpz_init(fd1);
+    mpz_init(fd);
+    mpz_init(fdsub1);
+    mpz_fib2_ui_intr(fd, fdsub1, n - near->n);
+    mpz_add(fd1, fd, fdsub1);
+
+    mpz_init(t);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(fn, near->v, fd1);
+    mpz_mul(t, near->v1, fd);
+    mpz_add(fn, fn, t);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(fnsub1, near->v, fd);
+    mpz_mul(t, near->v1, fdsub1);
+    mpz_add(fnsub1, fnsub1, t);
+
+    mpz_clear(t);
+    mpz_clear(fdsub1);
+    mpz_clear(fd);
+    mpz_clear(fd1);
+
+    _cache_add(PMPZ_CACHE_FIB, n, 0, fn, fnsub1);
+}
+
+void
+mpz_fib_ui_cached(mpz_ptr fn, unsigned long n)
+{
+    mpz_t       t;
+
+    mpz_init(t);
+    mpz_fib2_ui_cached(fn, t, n);
+    mpz_clear(t);
+}
+
+/*
+ *      L[n] = F[n] + 2 F[n-1]
+ *      L[n-1] = 2 F[n] - F[n-1]
+ */
+void
+mpz_lucnum2_ui_cached(mpz_ptr ln, mpz_ptr lnsub1, unsigned long n)
+{
+    mpz_t       f1, f0;
+
+    if (!_cache_worth(PMPZ_FIB_BITS(n))) {
+        mpz_lucnum2_ui_intr(ln, lnsub1, n);
+        return;
+    }
+
+    mpz_init(f1);
+    mpz_init(f0);
+    mpz_fib2_ui_cached(f1, f0, n);
+
+    mpz_mul_2exp(ln, f0, 1);
+    mpz_add(ln, ln, f1);
+    mpz_mul_2exp(lnsub1, f1, 1);
+    mpz_sub(lnsub1, lnsub1, f0);
+
+    mpz_clear(f0);
+    mpz_clear(f1);
+}
+
+void
+mpz_lucnum_ui_cached(mpz_ptr ln, unsigned long n)
+{
+    mpz_t       t;
+
+    mpz_init(t);
+    mpz_lucnum2_ui_cached(ln, t, n);
+    mpz_clear(t);
+}
+
+
+/*
+ * Binomial coefficient.
+ *
+ * Only n >= 0 fitting an unsigned long is cached; values of k close to 0 or
+ * to n give results too small to be worth it.
+ */
+
+void
+mpz_bin_ui_cached(mpz_ptr res, mpz_srcptr n, unsigned long k)
+{
+    pmpz_cache_entry    *e, *near;
+    unsigned long       nn, i;
+
+    if (pgmp_cache_size <= 0 || !mpz_fits_ulong_p(n)
+            || (nn = mpz_get_ui(n)) < k
+            || Min(k, nn - k) < PMPZ_CACHE_BIN_STEPS * 2) {
+        mpz_bin_ui_intr(res, n, k);
+        return;
+    }
+
+    if ((e = _cache_lookup(PMPZ_CACHE_BIN, nn, k, &near))) {
+        pgmp_check_result_bits(mpz_sizeinbase(e->v, 2));
+        mpz_set(res, e->v);
+        return;
+    }
+
+    if (!near) {
+        mpz_bin_ui_intr(res, n, k);
+        _cache_add(PMPZ_CACHE_BIN, nn, k, res, NULL);
+        return;
+    }
+
+    mpz_set(res, near->v);
+    if (near->n == nn)
+    {
+        for (i = near->k; i < k; i++) {
+            mpz_mul_ui(res, res, nn - i);
+            mpz_divexact_ui(res, res, i + 1);
+        }
+    }
+    else
+    {
+        for (i = near->n; i < nn; i++) {
+            mpz_mul_ui(res, res, i + 1);
+            mpz_divexact_ui(res, res, i + 1 - k);
+        }
+    }
+
+    _cache_add(PMPZ_CACHE_BIN, nn, k, res, NULL);
+}
+
+
+/*
+ * Functions to inspect and reset the cache
+ */
+
+/* Assign hook of pgmp.cache_size: drop the entries exceeding the new size */
+void
+pgmp_cache_assign_size(int newval, void *extra)
+{
+    _cache_evict((Size)newval * 1024);
+}
+
+PGMP_PG_FUNCTION(pgmp_cache_stats)
+{
+    TupleDesc   tupdesc;
+    Datum       result[5];
+    bool        isnull[5] = {false, false, false, false, false};
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+        ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("function returning record called in context "
+                "that cannot accept type record")));
+    }
+    tupdesc = BlessTupleDesc(tupdesc);
+
+    result[0] = Int64GetDatum(cache_hits);
+    result[1] = Int64GetDatum(cache_partial_hits);
+    result[2] = Int64GetDatum(cache_misses);
+    result[3] = Int64GetDatum(cache_entries);
+    result[4] = Int64GetDatum((int64)cache_used);
+
+    PG_RETURN_DATUM(HeapTupleGetDatum(
+        heap_form_tuple(tupdesc, result, isnull)));
+}
+
+PGMP_PG_FUNCTION(pgmp_cache_reset)
+{
+    pmpz_const_reset();
+
+    if (cache_ctx) {
+        MemoryContextReset(cache_ctx);
+    }
+    dlist_init(&cache_lru);
+    cache_used = 0;
+    cache_entries = 0;
+
+    cache_hits = 0;
+    cache_partial_hits = 0;
+    cache_misses = 0;
+
+    PG_RETURN_VOID();
+}
@@ -0,0 +1,465 @@
+/* pmpz_const -- digits of mathematical constants
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+#include "utils/memutils.h"         /* for TopMemoryContext */
+
+#include <math.h>
+
+
+/*
+ * The constants are computed as floor(x * 10^digits) by summing their series
+ * with binary splitting: the sum of the terms in [a, b) is kept as a few
+ * integers, and two adjacent ranges are joined with a few multiplications of
+ * numbers of similar size, so that most of the work is done by the GMP fast
+ * multiplication.
+ *
+ *      pi = 426880 sqrt(10005) / sum (-1)^k (6k)! (13591409 + 545140134 k)
+ *                                         / ((3k)! (k!)^3 640320^(3k))
+ *      e = 1 + sum 1/k!
+ *      log(2) = 2 atanh(1/3) = 2 sum 1/((2k+1) 3^(2k+1))
+ *
+ * The sums of the largest number of terms computed are kept for the session:
+ * a request for more digits only sums the missing terms, a request for less
+ * digits truncates the last value computed.
+ */
+
+/* Extra digits computed to absorb the truncation and rounding errors */
+#define PMPZ_CONST_GUARD 10
+
+#define LN_10 2.302585092994046
+#define LOG2_10 3.3219280948873622
+
+typedef struct
+{
+    unsigned long   n;          /* number of terms summed */
+    mpz_t           p;
+    mpz_t           q;
+    mpz_t           t;
+
+} pmpz_bsplit;
+
+typedef struct
+{
+    /* set r to the sum of the term a */
+    void            (*term)(pmpz_bsplit *r, unsigned long a);
+    /* set r to the sum of r and the following range r2 */
+    void            (*join)(pmpz_bsplit *r, pmpz_bsplit *r2);
+    /* number of terms to sum to get the digits */
+    unsigned long   (*nterms)(unsigned long digits);
+    /* set res to floor(x * 10^digits) from the sum */
+    void            (*eval)(mpz_ptr res, const pmpz_bsplit *r,
+                        unsigned long digits);
+
+    /* the sum and the value with most digits computed in the session */
+    pmpz_bsplit     *sum;
+    unsigned long   digits;
+    mpz_t           value;
+
+} pmpz_const;
+
+
+/* res = z * 10^n */
+static void
+_mul_10exp(mpz_ptr res, mpz_srcptr z, unsigned long n)
+{
+    mpz_t       t;
+
+    mpz_init(t);
+    mpz_ui_pow_ui(t, 10, n);
+    mpz_mul(res, z, t);
+    mpz_clear(t);
+}
+
+/* res = floor(z / 10^n) */
+static void
+_fdiv_q_10exp(mpz_ptr res, mpz_srcptr z, unsigned long n)
+{
+    mpz_t       t;
+
+    mpz_init(t);
+    mpz_ui_pow_ui(t, 10, n);
+    mpz_fdiv_q(res, z, t);
+    mpz_clear(t);
+}
+
+
+static void
+_bsplit_init(pmpz_bsplit *r)
+{
+    r->n = 0;
+    mpz_init(r->p);
+    mpz_init(r->q);
+    mpz_init(r->t);
+}
+
+static void
+_bsplit_clear(pmpz_bsplit *r)
+{
+    mpz_clear(r->p);
+    mpz_clear(r->q);
+    mpz_clear(r->t);
+}
+
+/* Set r to the sum of the terms in [a, b) */
+static void
+_bsplit(const pmpz_const *c, pmpz_bsplit *r, unsigned long a, unsigned long b)
+{
+    pmpz_bsplit     r2;
+    unsigned long   m;
+
+    if (b - a == 1) {
+        c->term(r, a);
+        r->n = 1;
+        return;
+    }
+
+    m = a + (b - a) / 2;
+    _bsplit(c, r, a, m);
+    _bsplit_init(&r2);
+    _bsplit(c, &r2, m, b);
+    CHECK_FOR_INTERRUPTS();
+    c->join(r, &r2);
+    r->n += r2.n;
+    _bsplit_clear(&r2);
+}
+
+
+/*
+ * pi, Chudnovsky series.
+ *
+ *      P(a, b) = prod (6k-5)(2k-1)(6k-1)
+ *      Q(a, b) = prod k^3 640320^3 / 24
+ *      T(a, b) = sum P(a, k+1) / Q(a, k+1) * (-1)^k (13591409 + 545140134 k)
+ *              * Q(a, b)
+ */
+
+#define CHUDNOVSKY_DIGITS_PER_TERM 14.181647462725477
+
+static void
+_pi_term(pmpz_bsplit *r, unsigned long a)
+{
+    if (a == 0) {
+        mpz_set_ui(r->p, 1);
+        mpz_set_ui(r->q, 1);
+    }
+    else {
+        mpz_set_ui(r->p, 6 * a - 5);
+        mpz_mul_ui(r->p, r->p, 2 * a - 1);
+        mpz_mul_ui(r->p, r->p, 6 * a - 1);
+        mpz_set_ui(r->q, a);
+        mpz_mul_ui(r->q, r->q, a);
+        mpz_mul_ui(r->q, r->q, a);
+        /* 640320^3 / 24 = 2^15 3^2 5^3 23^3 29^3 */
+        mpz_mul_ui(r->q, r->q, 36864000UL);
+        mpz_mul_ui(r->q, r->q, 296740963UL);
+    }
+    mpz_set_ui(r->t, 545140134UL);
+    mpz_mul_ui(r->t, r->t, a);
+    mpz_add_ui(r->t, r->t, 13591409UL);
+    mpz_mul(r->t, r->t, r->p);
+    if (a & 1) {
+        mpz_neg(r->t, r->t);
+    }
+}
+
+static void
+_pi_join(pmpz_bsplit *r, pmpz_bsplit *r2)
+{
+    /* T = Q2 T1 + P1 T2, P = P1 P2, Q = Q1 Q2 */
+    mpz_mul(r->t, r->t, r2->q);
+    mpz_mul(r2->t, r2->t, r->p);
+    mpz_add(r->t, r->t, r2->t);
+    mpz_mul(r->p, r->p, r2->p);
+    mpz_mul(r->q, r->q, r2->q);
+}
+
+static unsigned long
+_pi_nterms(unsigned long digits)
+{
+    return (unsigned long)(digits / CHUDNOVSKY_DIGITS_PER_TERM) + 2;
+}
+
+static void
+_pi_eval(mpz_ptr res, const pmpz_bsplit *r, unsigned long digits)
+{
+    mpz_t       s;
+
+    /* pi = 426880 sqrt(10005) Q / T */
+    mpz_init(s);
+    mpz_ui_pow_ui(s, 10, 2 * digits);
+    mpz_mul_ui(s, s, 10005);
+    mpz_sqrt(s, s);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(res, r->q, s);
+    mpz_mul_ui(res, res, 426880);
+    mpz_fdiv_q(res, res, r->t);
+    mpz_clear(s);
+}
+
+
+/*
+ * e, as 1 + P/Q with P/Q = sum 1/k! for k in [a+1, b], relative to a!.
+ */
+
+static void
+_e_term(pmpz_bsplit *r, unsigned long a)
+{
+    mpz_set_ui(r->p, 1);
+    mpz_set_ui(r->q, a + 1);
+}
+
+static void
+_e_join(pmpz_bsplit *r, pmpz_bsplit *r2)
+{
+    /* P = P1 Q2 + P2, Q = Q1 Q2 */
+    mpz_mul(r->p, r->p, r2->q);
+    mpz_add(r->p, r->p, r2->p);
+    mpz_mul(r->q, r->q, r2->q);
+}
+
+static unsigned long
+_e_nterms(unsigned long digits)
+{
+    unsigned long   lo = 1, hi = 2, m;
+
+    /* the smallest n with n! > 10^digits */
+    while (lgamma(hi + 1.0) / LN_10 <= digits) {
+        hi *= 2;
+    }
+    while (lo < hi) {
+        m = lo + (hi - lo) / 2;
+        if (lgamma(m + 1.0) / LN_10 <= digits) {
+            lo = m + 1;
+        }
+        else {
+            hi = m;
+        }
+    }
+    return lo + 1;
+}
+
+static void
+_e_eval(mpz_ptr res, const pmpz_bsplit *r, unsigned long digits)
+{
+    mpz_add(res, r->q, r->p);
+    _mul_10exp(res, res, digits);
+    mpz_fdiv_q(res, res, r->q);
+}
+
+
+/*
+ * log(2), as 2 atanh(1/3). The p field holds the product of the 2k+1.
+ *
+ *      B(a, b) = prod (2k+1)
+ *      Q(a, b) = prod 3^(2k+1) / 3^(2k-1)
+ *      T(a, b) = sum B(a, b) Q(a, b) / ((2k+1) Q(a, k+1))
+ */
+
+static void
+_ln2_term(pmpz_bsplit *r, unsigned long a)
+{
+    mpz_set_ui(r->p, 2 * a + 1);
+    mpz_set_ui(r->q, a == 0 ? 3 : 9);
+    mpz_set_ui(r->t, 1);
+}
+
+static void
+_ln2_join(pmpz_bsplit *r, pmpz_bsplit *r2)
+{
+    /* T = B2 Q2 T1 + B1 T2, B = B1 B2, Q = Q1 Q2 */
+    mpz_mul(r->t, r->t, r2->p);
+    mpz_mul(r->t, r->t, r2->q);
+    mpz_mul(r2->t, r2->t, r->p);
+    mpz_add(r->t, r->t, r2->t);
+    mpz_mul(r->p, r->p, r2->p);
+    mpz_mul(r->q, r->q, r2->q);
+}
+
+static unsigned long
+_ln2_nterms(unsigned long digits)
+{
+    /* every term adds log10(9) digits */
+    return (unsigned long)(digits / 0.9542425094393249) + 2;
+}
+
+static void
+_ln2_eval(mpz_ptr res, const pmpz_bsplit *r, unsigned long digits)
+{
+    mpz_t       d;
+
+    mpz_init(d);
+    mpz_mul(d, r->p, r->q);
+    mpz_mul_2exp(res, r->t, 1);
+    _mul_10exp(res, res, digits);
+    mpz_fdiv_q(res, res, d);
+    mpz_clear(d);
+}
+
+
+static pmpz_const const_pi = {_pi_term, _pi_join, _pi_nterms, _pi_eval};
+static pmpz_const const_e = {_e_term, _e_join, _e_nterms, _e_eval};
+static pmpz_const const_ln2 = {_ln2_term, _ln2_join, _ln2_nterms, _ln2_eval};
+
+
+/* Store the sum and the value computed if they fit in the cache size */
+static void
+_const_store(pmpz_const *c, const pmpz_bsplit *r, mpz_srcptr value,
+    unsigned long digits)
+{
+    MemoryContext   oldctx;
+    double          size;
+
+    size = (NLIMBS(r->p) + NLIMBS(r->q) + NLIMBS(r->t) + NLIMBS(value))
+        * sizeof(mp_limb_t);
+    if (size > (double)pgmp_cache_size * 1024 / 4) {
+        return;
+    }
+
+    oldctx = MemoryContextSwitchTo(TopMemoryContext);
+    if (!c->sum) {
+        c->sum = (pmpz_bsplit *)palloc(sizeof(pmpz_bsplit));
+        _bsplit_init(c->sum);
+        mpz_init(c->value);
+    }
+    c->sum->n = r->n;
+    mpz_set(c->sum->p, r->p);
+    mpz_set(c->sum->q, r->q);
+    mpz_set(c->sum->t, r->t);
+    mpz_set(c->value, value);
+    c->digits = digits;
+    MemoryContextSwitchTo(oldctx);
+}
+
+/* Set res to floor(x * 10^digits) */
+static void
+_const_digits(mpz_ptr res, pmpz_const *c, unsigned long digits)
+{
+    pmpz_bsplit     r, r2;
+    unsigned long   n;
+
+    pgmp_check_result_bits(digits * LOG2_10);
+
+    /* truncate a value already computed */
+    if (c->sum && c->digits >= digits) {
+        _fdiv_q_10exp(res, c->value, c->digits - digits);
+        return;
+    }
+
+    n = c->nterms(digits + PMPZ_CONST_GUARD);
+    _bsplit_init(&r);
+    if (c->sum && c->sum->n <= n)
+    {
+        /* extend the sum already computed with the missing terms */
+        r.n = c->sum->n;
+        mpz_set(r.p, c->sum->p);
+        mpz_set(r.q, c->sum->q);
+        mpz_set(r.t, c->sum->t);
+        if (r.n < n) {
+            _bsplit_init(&r2);
+            _bsplit(c, &r2, r.n, n);
+            c->join(&r, &r2);
+            r.n = n;
+            _bsplit_clear(&r2);
+        }
+    }
+    else {
+        _bsplit(c, &r, 0, n);
+    }
+
+    CHECK_FOR_INTERRUPTS();
+    c->eval(res, &r, digits + PMPZ_CONST_GUARD);
+    _fdiv_q_10exp(res, res, PMPZ_CONST_GUARD);
+
+    _const_store(c, &r, res, digits);
+    _bsplit_clear(&r);
+}
+
+/*
+ * Drop the sums kept for the session.
+ */
+void
+pmpz_const_reset(void)
+{
+    pmpz_const      *cs[] = {&const_pi, &const_e, &const_ln2};
+    int             i;
+
+    for (i = 0; i < lengthof(cs); i++)
+    {
+        if (!cs[i]->sum) {
+            continue;
+        }
+        _bsplit_clear(cs[i]->sum);
+        pfree(cs[i]->sum);
+        cs[i]->sum = NULL;
+        mpz_clear(cs[i]->value);
+    }
+}
+
+
+#define PMPZ_CONST(f) \
+ \
+PGMP_PG_FUNCTION(pmpz_ ## f ## _digits) \
+{ \
+    unsigned long   digits; \
+    mpz_t           zf; \
+ \
+    PGMP_GETARG_ULONG(digits, 0); \
+ \
+    mpz_init(zf); \
+    _const_digits(zf, &const_ ## f, digits); \
+ \
+    PGMP_RETURN_MPZ(zf); \
+}
+
+PMPZ_CONST(pi)
+PMPZ_CONST(e)
+PMPZ_CONST(ln2)
+
+
+/*
+ * floor(sqrt(z) * 10^digits), computed exactly as sqrt(z * 10^(2 digits)).
+ */
+PGMP_PG_FUNCTION(pmpz_sqrt_digits)
+{
+    const mpz_t     z = {0};
+    unsigned long   digits;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPZ(z, 0);
+    PMPZ_CHECK_NONEG(z);
+    PGMP_GETARG_ULONG(digits, 1);
+
+    pgmp_check_result_bits(
+        mpz_sizeinbase(z, 2) / 2.0 + digits * LOG2_10);
+
+    mpz_init(zf);
+    mpz_ui_pow_ui(zf, 10, 2 * digits);
+    mpz_mul(zf, zf, z);
+    CHECK_FOR_INTERRUPTS();
+    mpz_sqrt(zf, zf);
+
+    PGMP_RETURN_MPZ(zf);
+}
@@ -0,0 +1,292 @@
+/* pmpz_expanded -- expanded representation of mpz values
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "nodes/primnodes.h"
+#include "utils/memutils.h"         /* for AllocSetContextCreate */
+#if PG_VERSION_NUM >= 180000
+#include "nodes/nodeFuncs.h"        /* for expression_tree_walker */
+#include "nodes/supportnodes.h"
+#endif
+
+
+/*
+ * An expanded mpz keeps a live mpz_t whose limbs are allocated in the object
+ * memory context. Functions receiving a read-write pointer to such an object
+ * can update the value in place and return the same pointer, saving the
+ * allocation of a new datum and, often, the reallocation of the limbs.
+ *
+ * PL/pgSQL stores the read-write objects returned by a function into the
+ * variables and, from PostgreSQL 18, passes them back as read-write to the
+ * functions declaring so via a support function (see pmpz_support). So
+ * statements such as "n := n + 2" in a loop can run without allocating.
+ */
+
+static Size pmpz_expanded_get_flat_size(ExpandedObjectHeader *eohptr);
+static void pmpz_expanded_flatten_into(ExpandedObjectHeader *eohptr,
+    void *result, Size allocated_size);
+
+static const ExpandedObjectMethods pmpz_expanded_methods =
+{
+    pmpz_expanded_get_flat_size,
+    pmpz_expanded_flatten_into
+};
+
+
+/*
+ * Create a new expanded mpz with value 0 as a child of a memory context
+ */
+static pmpz_expanded *
+pmpz_expanded_new(MemoryContext parentcontext)
+{
+    pmpz_expanded   *ez;
+    MemoryContext   objcxt;
+    MemoryContext   oldcxt;
+
+    objcxt = AllocSetContextCreate(parentcontext,
+        "expanded mpz", ALLOCSET_SMALL_SIZES);
+
+    ez = (pmpz_expanded *)MemoryContextAlloc(objcxt, sizeof(pmpz_expanded));
+    EOH_init_header(&ez->hdr, &pmpz_expanded_methods, objcxt);
+    ez->magic = PMPZ_EXPANDED_MAGIC;
+
+    oldcxt = MemoryContextSwitchTo(objcxt);
+    mpz_init(ez->z);
+    MemoryContextSwitchTo(oldcxt);
+
+    return ez;
+}
+
+
+static Size
+pmpz_expanded_get_flat_size(ExpandedObjectHeader *eohptr)
+{
+    pmpz_expanded   *ez = (pmpz_expanded *)eohptr;
+
+    Assert(ez->magic == PMPZ_EXPANDED_MAGIC);
+
+    return PMPZ_SIZE(ez->z);
+}
+
+static void
+pmpz_expanded_flatten_into(ExpandedObjectHeader *eohptr,
+    void *result, Size allocated_size)
+{
+    pmpz_expanded   *ez = (pmpz_expanded *)eohptr;
+    pmpz            *res = (pmpz *)result;
+
+    Assert(ez->magic == PMPZ_EXPANDED_MAGIC);
+    Assert(allocated_size == pmpz_expanded_get_flat_size(eohptr));
+
+    pmpz_write_mpz(res, ez->z);
+}
+
+
+/*
+ * Initialize a mpz from a datum, either flat or expanded.
+ *
+ * As in mpz_from_pmpz() the structure populated doesn't own the data, which
+ * must not be changed nor cleared.
+ */
+void
+mpz_from_datum(mpz_srcptr z, Datum d)
+{
+    if (VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(d)))
+    {
+        pmpz_expanded   *ez = (pmpz_expanded *)DatumGetEOHP(d);
+
+        Assert(ez->magic == PMPZ_EXPANDED_MAGIC);
+
+        /* discard the const qualifier */
+        *((mpz_ptr)z) = *(ez->z);
+    }
+    else
+    {
+        mpz_from_pmpz(z, (pmpz *)PG_DETOAST_DATUM(d));
+    }
+}
+
+
+#if PG_VERSION_NUM >= 180000
+static bool _is_inplace_call(FunctionCallInfo fcinfo);
+static bool _is_param_extern(Node *node, int paramid);
+static bool _param_walker(Node *node, void *context);
+#endif
+
+/*
+ * Return the expanded object to store the result of a function into.
+ *
+ * If the n-th argument is a read-write expanded mpz the function can work in
+ * place on it. If instead the argument is a flat procedural language variable
+ * the call was allowed to update, a new object is returned, so that next time
+ * the variable can be updated in place. Return NULL if the function should
+ * return a regular flat value.
+ */
+pmpz_expanded *
+pmpz_expanded_target(FunctionCallInfo fcinfo, int n)
+{
+    Datum           d = PG_GETARG_DATUM(n);
+
+    if (VARATT_IS_EXTERNAL_EXPANDED_RW(DatumGetPointer(d)))
+    {
+        pmpz_expanded   *ez = (pmpz_expanded *)DatumGetEOHP(d);
+
+        Assert(ez->magic == PMPZ_EXPANDED_MAGIC);
+        return ez;
+    }
+
+#if PG_VERSION_NUM >= 180000
+    /* Before PostgreSQL 18 the variables are never passed read-write to
+     * our functions, so expanding them would only add overhead. */
+    if (n == 0 && !VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(d))
+            && _is_inplace_call(fcinfo)) {
+        return pmpz_expanded_new(CurrentMemoryContext);
+    }
+#endif
+
+    return NULL;
+}
+
+
+/*
+ * Planner support function for the mpz functions working in place.
+ *
+ * The cost and simplification requests are handled as for the other
+ * functions (see pmpz_support_plan).
+ */
+PGMP_PG_FUNCTION(pmpz_support)
+{
+    Node        *rawreq = (Node *)PG_GETARG_POINTER(0);
+    Node        *ret;
+
+    if ((ret = pmpz_support_plan(rawreq))) {
+        PG_RETURN_POINTER(ret);
+    }
+
+#if PG_VERSION_NUM >= 180000
+    if (IsA(rawreq, SupportRequestModifyInPlace))
+    {
+        /* The functions can work in place on their first argument, if it is
+         * the variable being assigned and the variable is not referenced by
+         * the other arguments too. */
+        SupportRequestModifyInPlace *req =
+            (SupportRequestModifyInPlace *)rawreq;
+        Node        *arg = linitial(req->args);
+        ListCell    *lc;
+
+        if (_is_param_extern(arg, req->paramid))
+        {
+            ret = arg;
+            for_each_from(lc, req->args, 1)
+            {
+                if (_param_walker(lfirst(lc), &req->paramid)) {
+                    ret = NULL;
+                    break;
+                }
+            }
+        }
+    }
+#endif
+
+    PG_RETURN_POINTER(ret);
+}
+
+
+#if PG_VERSION_NUM >= 180000
+
+/*
+ * Return true if the function is called on a procedural language variable
+ * in the way the support function allows to work in place.
+ *
+ * PL/pgSQL passes the variable to update as it is, so the first time it is a
+ * flat value, undistinguishable from the variables only read by the other
+ * calls: repeat the test of pmpz_support on the expression executed. The
+ * expressions not assigning the variable would only get a result returned
+ * expanded with no need.
+ */
+static bool
+_is_inplace_call(FunctionCallInfo fcinfo)
+{
+    Node        *expr;
+    List        *args;
+    Param       *p;
+    ListCell    *lc;
+
+    if (!(fcinfo->flinfo && fcinfo->flinfo->fn_expr)) {
+        return false;
+    }
+
+    expr = fcinfo->flinfo->fn_expr;
+    if (IsA(expr, FuncExpr)) {
+        args = ((FuncExpr *)expr)->args;
+    }
+    else if (IsA(expr, OpExpr)) {
+        args = ((OpExpr *)expr)->args;
+    }
+    else {
+        return false;
+    }
+
+    if (args == NIL || !_is_param_extern(linitial(args), -1)) {
+        return false;
+    }
+
+    p = (Param *)linitial(args);
+    for_each_from(lc, args, 1)
+    {
+        if (_param_walker(lfirst(lc), &p->paramid)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Return true if node is an external Param with the given id (any if -1) */
+static bool
+_is_param_extern(Node *node, int paramid)
+{
+    Param   *p = (Param *)node;
+
+    return node != NULL && IsA(node, Param)
+        && p->paramkind == PARAM_EXTERN
+        && (paramid < 0 || p->paramid == paramid);
+}
+
+/* Return true if the expression references the external Param *context */
+static bool
+_param_walker(Node *node, void *context)
+{
+    if (node == NULL) {
+        return false;
+    }
+
+    if (_is_param_extern(node, *(int *)context)) {
+        return true;
+    }
+
+    return expression_tree_walker(node, _param_walker, context);
+}
+
+#endif
@@ -0,0 +1,755 @@
+/* pmpz_factor -- integer factorization
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+#include "access/htup_details.h"    /* for heap_form_tuple */
+
+#include <string.h>                 /* for memmove */
+
+
+/*
+ * The number is factored by methods able to find larger and larger factors:
+ *
+ * - the factors in the table of the small primes are removed by trial
+ *   division (see pmpz_small_factor());
+ * - a composite cofactor is split by Pollard's rho method, in the variant by
+ *   Brent, which finds quickly factors up to about 10 digits;
+ * - if rho doesn't succeed, Lenstra's elliptic curve method (ECM) is used,
+ *   with bounds increasing until a factor is found.
+ *
+ * The factors found are split again until they are prime according to
+ * mpz_probab_prime_p_table(). The computation can take a long time for large
+ * numbers without small factors: it checks for interrupts regularly, so it
+ * can be cancelled or stopped by statement_timeout.
+ */
+
+/* Iterations of the rho method for every polynomial tried */
+#define PMPZ_RHO_ITERS (1 << 16)
+
+/* Number of polynomials x^2 + c tried by the rho method */
+#define PMPZ_RHO_TRIES 3
+
+/* Number of differences multiplied together before a gcd in rho */
+#define PMPZ_RHO_BATCH 128
+
+/* Repetitions of the probabilistic test on the factors */
+#define PMPZ_FACTOR_REPS 25
+
+/* Numbers up to this size are factored by trial division, if composite */
+#define PMPZ_FACTOR_TRIAL_BITS 32
+
+/* Giant step of the ECM stage 2 */
+#define PMPZ_ECM_D 2310
+
+/* Largest bound of the ECM stage 2, limiting the size of its sieve */
+#define PMPZ_ECM_MAX_B2 (1UL << 26)
+
+/* Bounds of the ECM stage 1 and number of curves to try, with the size of
+ * the factors they are suited for (from the GMP-ECM documentation). After the
+ * last level the bound keeps growing. */
+static const struct
+{
+    unsigned long   b1;
+    int             curves;
+
+} ecm_levels[] = {
+    { 2000, 25 },           /* 15 digits */
+    { 11000, 90 },          /* 20 digits */
+    { 50000, 300 },         /* 25 digits */
+    { 250000, 700 },        /* 30 digits */
+    { 1000000, 1800 },      /* 35 digits */
+    { 3000000, 5100 },      /* 40 digits */
+};
+
+#define PMPZ_ECM_NLEVELS (sizeof(ecm_levels) / sizeof(ecm_levels[0]))
+
+
+/*
+ * The factors found, with their exponent, sorted by increasing prime.
+ */
+typedef struct
+{
+    int             n;
+    int             size;
+    mpz_t           *primes;
+    int             *exps;
+
+} pmpz_factors;
+
+/* Add p^e to the factors, keeping them sorted. The small factors are found
+ * in order, so they are appended at the end. */
+static void
+_factors_add(pmpz_factors *fs, mpz_srcptr p, int e)
+{
+    int             i, cmp = -1;
+
+    for (i = fs->n; i > 0 && (cmp = mpz_cmp(fs->primes[i - 1], p)) > 0; i--) ;
+    if (cmp == 0) {
+        fs->exps[i - 1] += e;
+        return;
+    }
+
+    if (fs->n >= fs->size) {
+        fs->size = Max(fs->size * 2, 8);
+        fs->primes = fs->primes
+            ? (mpz_t *)repalloc(fs->primes, fs->size * sizeof(mpz_t))
+            : (mpz_t *)palloc(fs->size * sizeof(mpz_t));
+        fs->exps = fs->exps
+            ? (int *)repalloc(fs->exps, fs->size * sizeof(int))
+            : (int *)palloc(fs->size * sizeof(int));
+    }
+
+    memmove(fs->primes + i + 1, fs->primes + i, (fs->n - i) * sizeof(mpz_t));
+    memmove(fs->exps + i + 1, fs->exps + i, (fs->n - i) * sizeof(int));
+    mpz_init_set(fs->primes[i], p);
+    fs->exps[i] = e;
+    fs->n++;
+}
+
+
+/*
+ * Pollard's rho method, with Brent's cycle detection.
+ *
+ * Set f to a non trivial factor of the composite n and return true, or return
+ * false if no factor was found in PMPZ_RHO_ITERS iterations.
+ */
+static bool
+_rho(mpz_ptr f, mpz_srcptr n, unsigned long c)
+{
+    mpz_t           x, y, ys, q, t;
+    unsigned long   r = 1, k, i, iters = 0;
+    bool            found;
+
+    mpz_init_set_ui(y, 2);
+    mpz_init(x);
+    mpz_init(ys);
+    mpz_init_set_ui(q, 1);
+    mpz_init(t);
+    mpz_set_ui(f, 1);
+
+#define RHO_STEP(z) \
+    do { \
+        mpz_mul(z, z, z); \
+        mpz_add_ui(z, z, c); \
+        mpz_tdiv_r(z, z, n); \
+    } while (0)
+
+    while (mpz_cmp_ui(f, 1) == 0 && iters < PMPZ_RHO_ITERS)
+    {
+        mpz_set(x, y);
+        for (i = 0; i < r; i++) {
+            RHO_STEP(y);
+        }
+        for (k = 0; k < r && mpz_cmp_ui(f, 1) == 0; k += PMPZ_RHO_BATCH)
+        {
+            CHECK_FOR_INTERRUPTS();
+            mpz_set(ys, y);
+            for (i = 0; i < Min(PMPZ_RHO_BATCH, r - k); i++) {
+                RHO_STEP(y);
+                mpz_sub(t, x, y);
+                mpz_mul(q, q, t);
+                mpz_tdiv_r(q, q, n);
+            }
+            mpz_gcd(f, q, n);
+            iters += i;
+        }
+        r *= 2;
+    }
+
+    /* the batch went too far: go back one step at a time */
+    if (mpz_cmp(f, n) == 0)
+    {
+        do {
+            RHO_STEP(ys);
+            mpz_sub(t, x, ys);
+            mpz_gcd(f, t, n);
+        } while (mpz_cmp_ui(f, 1) == 0);
+    }
+
+#undef RHO_STEP
+
+    found = mpz_cmp_ui(f, 1) != 0 && mpz_cmp(f, n) != 0;
+
+    mpz_clear(x);
+    mpz_clear(y);
+    mpz_clear(ys);
+    mpz_clear(q);
+    mpz_clear(t);
+
+    return found;
+}
+
+
+/*
+ * Elliptic curve method.
+ *
+ * The curves are in Montgomery form, using only the X and Z coordinates, with
+ * Suyama's parametrization. The stage 2 uses the baby-step giant-step
+ * continuation: the product of (X[kD] Z[j] - X[j] Z[kD]) is 0 modulo p if
+ * the order of the curve modulo p has a prime kD +/- j between B1 and B2.
+ */
+
+typedef struct
+{
+    mpz_srcptr      n;
+    mpz_t           a24;        /* (A + 2) / 4 */
+    mpz_t           t1, t2, t3, t4;
+
+} pmpz_ecm;
+
+/* (X2:Z2) = 2 (X:Z) */
+static void
+_ecm_dbl(pmpz_ecm *e, mpz_ptr x2, mpz_ptr z2, mpz_srcptr x, mpz_srcptr z)
+{
+    mpz_add(e->t1, x, z);
+    mpz_mul(e->t1, e->t1, e->t1);
+    mpz_sub(e->t2, x, z);
+    mpz_mul(e->t2, e->t2, e->t2);
+    mpz_sub(e->t3, e->t1, e->t2);           /* 4 X Z */
+    mpz_mul(x2, e->t1, e->t2);
+    mpz_tdiv_r(x2, x2, e->n);
+    mpz_mul(e->t1, e->a24, e->t3);
+    mpz_add(e->t1, e->t1, e->t2);
+    mpz_mul(z2, e->t3, e->t1);
+    mpz_tdiv_r(z2, z2, e->n);
+}
+
+/* (XR:ZR) = (XP:ZP) + (XQ:ZQ), given (XD:ZD) = P - Q */
+static void
+_ecm_add(pmpz_ecm *e, mpz_ptr xr, mpz_ptr zr,
+    mpz_srcptr xp, mpz_srcptr zp, mpz_srcptr xq, mpz_srcptr zq,
+    mpz_srcptr xd, mpz_srcptr zd)
+{
+    mpz_sub(e->t1, xp, zp);
+    mpz_add(e->t2, xq, zq);
+    mpz_mul(e->t1, e->t1, e->t2);
+    mpz_add(e->t2, xp, zp);
+    mpz_sub(e->t3, xq, zq);
+    mpz_mul(e->t2, e->t2, e->t3);
+    mpz_add(e->t3, e->t1, e->t2);
+    mpz_mul(e->t3, e->t3, e->t3);
+    mpz_tdiv_r(e->t3, e->t3, e->n);
+    mpz_sub(e->t4, e->t1, e->t2);
+    mpz_mul(e->t4, e->t4, e->t4);
+    mpz_tdiv_r(e->t4, e->t4, e->n);
+    mpz_mul(e->t1, zd, e->t3);
+    mpz_mul(e->t2, xd, e->t4);
+    mpz_tdiv_r(xr, e->t1, e->n);
+    mpz_tdiv_r(zr, e->t2, e->n);
+}
+
+/* (X:Z) = k (X:Z), k > 0, by the Montgomery ladder */
+static void
+_ecm_mul(pmpz_ecm *e, mpz_ptr x, mpz_ptr z, unsigned long k)
+{
+    mpz_t           x0, z0, x1, z1;
+    int             bit;
+
+    if (k == 1) {
+        return;
+    }
+
+    mpz_init_set(x0, x);
+    mpz_init_set(z0, z);
+    mpz_init(x1);
+    mpz_init(z1);
+    _ecm_dbl(e, x1, z1, x, z);
+
+    for (bit = 8 * sizeof(unsigned long) - 1; !(k >> bit); bit--) ;
+    for (bit--; bit >= 0; bit--)
+    {
+        if ((k >> bit) & 1) {
+            _ecm_add(e, x0, z0, x1, z1, x0, z0, x, z);
+            _ecm_dbl(e, x1, z1, x1, z1);
+        }
+        else {
+            _ecm_add(e, x1, z1, x1, z1, x0, z0, x, z);
+            _ecm_dbl(e, x0, z0, x0, z0);
+        }
+    }
+
+    mpz_swap(x, x0);
+    mpz_swap(z, z0);
+    mpz_clear(x0);
+    mpz_clear(z0);
+    mpz_clear(x1);
+    mpz_clear(z1);
+}
+
+/* Return true if the odd number p is prime according to the odd sieve */
+#define ODD_PRIME(sieve, p) (!((sieve)[(p) / 16] & (1 << (((p) / 2) % 8))))
+
+/*
+ * Try a curve with parameter sigma and bounds b1, b2, using the sieve of the
+ * odd numbers up to b2 + PMPZ_ECM_D.
+ *
+ * Set f to a non trivial factor of n and return true, or return false.
+ */
+static bool
+_ecm_curve(mpz_ptr f, mpz_srcptr n, unsigned long sigma,
+    unsigned long b1, unsigned long b2, const uint8 *sieve)
+{
+    pmpz_ecm        e;
+    mpz_t           x, z, u, v, acc, xg, zg, xr, zr, xs, zs;
+    mpz_t           *xj, *zj;
+    unsigned long   p, q, k, mul, j, kmin, kmax;
+    int             nj = PMPZ_ECM_D / 4;
+    bool            found = false;
+
+    e.n = n;
+    mpz_init(e.a24);
+    mpz_init(e.t1);
+    mpz_init(e.t2);
+    mpz_init(e.t3);
+    mpz_init(e.t4);
+    mpz_init(x);
+    mpz_init(z);
+    mpz_init(u);
+    mpz_init(v);
+    mpz_init(acc);
+
+    /* Suyama: u = sigma^2 - 5, v = 4 sigma, the point is (u^3 : v^3) and
+     * (A + 2) / 4 = (v - u)^3 (3u + v) / (16 u^3 v) */
+    mpz_set_ui(u, sigma);
+    mpz_mul_ui(u, u, sigma);
+    mpz_sub_ui(u, u, 5);
+    mpz_set_ui(v, sigma);
+    mpz_mul_ui(v, v, 4);
+    mpz_powm_ui(x, u, 3, n);
+    mpz_powm_ui(z, v, 3, n);
+
+    mpz_mul(acc, x, v);
+    mpz_mul_ui(acc, acc, 16);
+    mpz_mod(acc, acc, n);
+    if (!mpz_invert(acc, acc, n))
+    {
+        mpz_gcd(f, acc, n);
+        found = mpz_cmp_ui(f, 1) != 0 && mpz_cmp(f, n) != 0;
+        goto exit;
+    }
+    mpz_sub(e.a24, v, u);
+    mpz_powm_ui(e.a24, e.a24, 3, n);
+    mpz_mul_ui(u, u, 3);
+    mpz_add(u, u, v);
+    mpz_mul(e.a24, e.a24, u);
+    mpz_mul(e.a24, e.a24, acc);
+    mpz_mod(e.a24, e.a24, n);
+
+    /* stage 1: multiply the point by the prime powers up to b1, packed in
+     * words to reduce the number of ladders */
+    mul = 1;
+    for (p = 2; p <= b1; p = (p == 2) ? 3 : p + 2)
+    {
+        if (p > 2 && !ODD_PRIME(sieve, p)) {
+            continue;
+        }
+        for (q = p; q <= b1 / p; q *= p) ;
+        if (mul > ULONG_MAX / q) {
+            CHECK_FOR_INTERRUPTS();
+            _ecm_mul(&e, x, z, mul);
+            mul = 1;
+        }
+        mul *= q;
+    }
+    _ecm_mul(&e, x, z, mul);
+
+    mpz_gcd(f, z, n);
+    if (mpz_cmp_ui(f, 1) != 0) {
+        found = mpz_cmp(f, n) != 0;
+        goto exit;
+    }
+
+    /* stage 2, baby steps: the odd multiples j Q for j < D / 2 */
+    xj = (mpz_t *)palloc(nj * sizeof(mpz_t));
+    zj = (mpz_t *)palloc(nj * sizeof(mpz_t));
+    mpz_init(xg);
+    mpz_init(zg);
+    _ecm_dbl(&e, xg, zg, x, z);                 /* 2 Q */
+    mpz_init_set(xj[0], x);
+    mpz_init_set(zj[0], z);
+    mpz_init(xj[1]);
+    mpz_init(zj[1]);
+    _ecm_add(&e, xj[1], zj[1], xg, zg, x, z, x, z);
+    for (j = 2; j < nj; j++) {
+        mpz_init(xj[j]);
+        mpz_init(zj[j]);
+        _ecm_add(&e, xj[j], zj[j], xj[j - 1], zj[j - 1], xg, zg,
+            xj[j - 2], zj[j - 2]);
+    }
+
+    /* giant steps: k D Q for k D - D / 2 < b2 */
+    kmin = Max(b1 / PMPZ_ECM_D, 1);
+    kmax = b2 / PMPZ_ECM_D + 1;
+    mpz_set(xg, x);
+    mpz_set(zg, z);
+    _ecm_mul(&e, xg, zg, PMPZ_ECM_D);
+    mpz_init_set(xs, x);                        /* (k - 1) D Q */
+    mpz_init_set(zs, z);
+    mpz_init_set(xr, x);                        /* k D Q */
+    mpz_init_set(zr, z);
+    _ecm_mul(&e, xs, zs, (kmin - 1) * PMPZ_ECM_D + (kmin == 1));
+    _ecm_mul(&e, xr, zr, kmin * PMPZ_ECM_D);
+
+    mpz_set_ui(acc, 1);
+    for (k = kmin; k <= kmax; k++)
+    {
+        CHECK_FOR_INTERRUPTS();
+        for (j = 1; j < PMPZ_ECM_D / 2; j += 2)
+        {
+            p = k * PMPZ_ECM_D;
+            if (!((p - j > b1 && p - j <= b2 && ODD_PRIME(sieve, p - j))
+                    || (p + j > b1 && p + j <= b2
+                        && ODD_PRIME(sieve, p + j)))) {
+                continue;
+            }
+            mpz_mul(e.t1, xr, zj[j / 2]);
+            mpz_submul(e.t1, xj[j / 2], zr);
+            mpz_mul(acc, acc, e.t1);
+            mpz_tdiv_r(acc, acc, n);
+        }
+
+        /* (k + 1) D Q = k D Q + D Q, with difference (k - 1) D Q */
+        if (k == 1) {
+            _ecm_dbl(&e, xs, zs, xr, zr);
+        }
+        else {
+            _ecm_add(&e, xs, zs, xr, zr, xg, zg, xs, zs);
+        }
+        mpz_swap(xs, xr);
+        mpz_swap(zs, zr);
+    }
+
+    mpz_gcd(f, acc, n);
+    found = mpz_cmp_ui(f, 1) != 0 && mpz_cmp(f, n) != 0;
+
+    for (j = 0; j < nj; j++) {
+        mpz_clear(xj[j]);
+        mpz_clear(zj[j]);
+    }
+    pfree(xj);
+    pfree(zj);
+    mpz_clear(xg);
+    mpz_clear(zg);
+    mpz_clear(xr);
+    mpz_clear(zr);
+    mpz_clear(xs);
+    mpz_clear(zs);
+
+exit:
+    mpz_clear(e.a24);
+    mpz_clear(e.t1);
+    mpz_clear(e.t2);
+    mpz_clear(e.t3);
+    mpz_clear(e.t4);
+    mpz_clear(x);
+    mpz_clear(z);
+    mpz_clear(u);
+    mpz_clear(v);
+    mpz_clear(acc);
+
+    return found;
+}
+
+/* Set f to a non trivial factor of the composite n by ECM */
+static void
+_ecm(mpz_ptr f, mpz_srcptr n)
+{
+    unsigned long   b1, b2, sigma = 6;
+    uint8           *sieve;
+    int             level, curve, ncurves;
+    bool            found = false;
+
+    for (level = 0; !found; level++)
+    {
+        if (level < PMPZ_ECM_NLEVELS) {
+            b1 = ecm_levels[level].b1;
+            ncurves = ecm_levels[level].curves;
+        }
+        else {
+            b1 = ecm_levels[PMPZ_ECM_NLEVELS - 1].b1
+                * (level - PMPZ_ECM_NLEVELS + 2);
+            ncurves = ecm_levels[PMPZ_ECM_NLEVELS - 1].curves;
+        }
+        b2 = Max(Min(100 * b1, PMPZ_ECM_MAX_B2), b1);
+
+        sieve = pmpz_odd_sieve(b2 + PMPZ_ECM_D);
+        for (curve = 0; curve < ncurves && !found; curve++) {
+            found = _ecm_curve(f, n, sigma++, b1, b2, sieve);
+        }
+        pfree(sieve);
+    }
+}
+
+
+/* Add to fs the prime factors of n > 1 without small factors, each one with
+ * e times its multiplicity */
+static void
+_factor_large(pmpz_factors *fs, mpz_srcptr n, int e)
+{
+    mpz_t           f, g;
+    unsigned long   c, k;
+    bool            found = false;
+
+    if (mpz_probab_prime_p_table(n, PMPZ_FACTOR_REPS)) {
+        _factors_add(fs, n, e);
+        return;
+    }
+
+    mpz_init(f);
+    mpz_init(g);
+
+    /* a perfect power is split by its root; the smallest exponent found is
+     * a prime and the root may be a power itself */
+    if (mpz_perfect_power_p(n))
+    {
+        for (k = 2; ; k++) {
+            if (mpz_root(f, n, k)) {
+                _factor_large(fs, f, e * k);
+                goto exit;
+            }
+        }
+    }
+
+    /* the methods below may fail on very small numbers: these are factored
+     * by plain trial division */
+    if (mpz_sizeinbase(n, 2) <= PMPZ_FACTOR_TRIAL_BITS)
+    {
+        unsigned long   v = mpz_get_ui(n);
+
+        for (k = 3; v % k; k += 2) ;
+        mpz_set_ui(f, k);
+        found = true;
+    }
+
+    for (c = 1; c <= PMPZ_RHO_TRIES && !found; c++) {
+        found = _rho(f, n, c);
+    }
+    if (!found) {
+        _ecm(f, n);
+    }
+
+    mpz_divexact(g, n, f);
+    _factor_large(fs, f, e);
+    _factor_large(fs, g, e);
+
+exit:
+    mpz_clear(f);
+    mpz_clear(g);
+}
+
+/*
+ * Factor n into primes.
+ *
+ * Return the number of distinct prime factors, setting primes and exps to
+ * palloc'd arrays sorted by increasing prime. A negative n has -1 as first
+ * factor; 0 is returned as 0^1.
+ */
+int
+mpz_factor(mpz_srcptr n, mpz_t **primes, int **exps)
+{
+    pmpz_factors    fs = {0, 0, NULL, NULL};
+    mpz_t           c, p;
+    unsigned long   sp;
+
+    mpz_init(p);
+    if (SIZ(n) <= 0)
+    {
+        mpz_set_si(p, SIZ(n) ? -1 : 0);
+        _factors_add(&fs, p, 1);
+        if (!SIZ(n)) {
+            goto exit;
+        }
+    }
+
+    /* remove the small factors */
+    mpz_init(c);
+    mpz_abs(c, n);
+    while ((sp = pmpz_small_factor(c, ULONG_MAX)))
+    {
+        mpz_set_ui(p, sp);
+        _factors_add(&fs, p, mpz_remove(c, c, p));
+    }
+
+    if (mpz_cmp_ui(c, 1) > 0) {
+        _factor_large(&fs, c, 1);
+    }
+    mpz_clear(c);
+
+exit:
+    mpz_clear(p);
+    *primes = fs.primes;
+    *exps = fs.exps;
+    return fs.n;
+}
+
+
+/*
+ * SQL functions.
+ *
+ * The numbers are factored lazily, one at time, in the multi-call context.
+ */
+
+typedef struct
+{
+    int             n;          /* number of values to factor */
+    mpz_t           *zs;
+    bool            *nulls;
+    int             cur;        /* value being returned */
+    int             nf;         /* factors of the current value */
+    mpz_t           *primes;
+    int             *exps;
+    int             fi;         /* next factor to return */
+
+} pmpz_factor_state;
+
+/* Move to the next factor to return, false if there are no more */
+static bool
+_factor_next(pmpz_factor_state *st, MemoryContext ctx)
+{
+    MemoryContext   oldctx;
+
+    while (st->fi >= st->nf)
+    {
+        if (++st->cur >= st->n) {
+            return false;
+        }
+        if (st->nulls && st->nulls[st->cur]) {
+            st->nf = 0;
+            continue;
+        }
+        oldctx = MemoryContextSwitchTo(ctx);
+        st->nf = mpz_factor(st->zs[st->cur], &st->primes, &st->exps);
+        MemoryContextSwitchTo(oldctx);
+        st->fi = 0;
+    }
+
+    return true;
+}
+
+static pmpz_factor_state *
+_factor_state(int n, mpz_t *zs, bool *nulls)
+{
+    pmpz_factor_state *st;
+
+    st = (pmpz_factor_state *)palloc0(sizeof(pmpz_factor_state));
+    st->n = n;
+    st->zs = zs;
+    st->nulls = nulls;
+    st->cur = -1;
+    return st;
+}
+
+static TupleDesc
+_factor_tupdesc(FunctionCallInfo fcinfo)
+{
+    TupleDesc   tupdesc;
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+        ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("function returning record called in context "
+                "that cannot accept type record")));
+    }
+    return BlessTupleDesc(tupdesc);
+}
+
+PGMP_PG_FUNCTION(pmpz_factor)
+{
+    FuncCallContext     *funcctx;
+    MemoryContext       oldctx;
+    pmpz_factor_state   *st;
+    Datum               result[2];
+    bool                isnull[2] = {false, false};
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        const mpz_t     z = {0};
+        mpz_t           *zs;
+
+        PGMP_GETARG_MPZ(z, 0);
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        zs = (mpz_t *)palloc(sizeof(mpz_t));
+        mpz_init_set(zs[0], z);
+        funcctx->user_fctx = _factor_state(1, zs, NULL);
+        funcctx->tuple_desc = _factor_tupdesc(fcinfo);
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    st = (pmpz_factor_state *)funcctx->user_fctx;
+
+    if (!_factor_next(st, funcctx->multi_call_memory_ctx)) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    result[0] = PointerGetDatum(pmpz_from_mpz(st->primes[st->fi]));
+    result[1] = Int32GetDatum(st->exps[st->fi]);
+    st->fi++;
+
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(
+        heap_form_tuple(funcctx->tuple_desc, result, isnull)));
+}
+
+PGMP_PG_FUNCTION(pmpz_array_factor)
+{
+    FuncCallContext     *funcctx;
+    MemoryContext       oldctx;
+    pmpz_factor_state   *st;
+    Datum               result[3];
+    bool                isnull[3] = {false, false, false};
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        mpz_t           *zs;
+        bool            *nulls;
+        int             n;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        n = mpz_array_unpack(fcinfo, PG_GETARG_ARRAYTYPE_P_COPY(0),
+            &zs, &nulls);
+        funcctx->user_fctx = _factor_state(n, zs, nulls);
+        funcctx->tuple_desc = _factor_tupdesc(fcinfo);
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    st = (pmpz_factor_state *)funcctx->user_fctx;
+
+    if (!_factor_next(st, funcctx->multi_call_memory_ctx)) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    result[0] = Int32GetDatum(st->cur + 1);
+    result[1] = PointerGetDatum(pmpz_from_mpz(st->primes[st->fi]));
+    result[2] = Int32GetDatum(st->exps[st->fi]);
+    st->fi++;
+
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(
+        heap_form_tuple(funcctx->tuple_desc, result, isnull)));
+}
@@ -0,0 +1,563 @@
+/* pmpz_intr -- interruptible versions of the expensive mpz functions
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+
+#include <math.h>
+
+
+/*
+ * A GMP call can't be interrupted: a query computing fac(100000000) would
+ * ignore cancel requests and statement_timeout until the end. The functions
+ * here have the same interface as the GMP functions they replace; when the
+ * result is large they compute it in steps, each one bounded by a
+ * multiplication of the size of the result, checking for interrupts in
+ * between. The size of the result is checked against pgmp.max_bits before
+ * starting the computation.
+ *
+ * The functions allow the output to be the same object as an input.
+ */
+
+/* Below this result size the GMP functions are called directly */
+#define PMPZ_INTR_BITS (1 << 20)
+
+/* Below this size nextprime is left to GMP */
+#define PMPZ_INTR_PRIME_BITS 512
+
+/* Cost of a powm chunk, in the units of _powm_cost() (about 4ns each) */
+#define PMPZ_INTR_POWM_COST (1 << 26)
+
+#define LOG2_E 1.4426950408889634
+
+
+/*
+ * Product of an array of unsigned long, by binary splitting.
+ */
+void
+mpz_prod_ui_intr(mpz_ptr res, const unsigned long *v, size_t n)
+{
+    size_t      i;
+    mpz_t       t;
+
+    if (n <= 16)
+    {
+        mpz_set_ui(res, n ? v[0] : 1);
+        for (i = 1; i < n; i++) {
+            mpz_mul_ui(res, res, v[i]);
+        }
+        return;
+    }
+
+    mpz_init(t);
+    mpz_prod_ui_intr(res, v, n / 2);
+    mpz_prod_ui_intr(t, v + n / 2, n - n / 2);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(res, res, t);
+    mpz_clear(t);
+}
+
+
+/*
+ * Factorial.
+ *
+ * Computed by the prime swing algorithm: n! = ((n/2)!)^2 * swing(n), where
+ * swing(n) = n! / ((n/2)!)^2 is the product of the prime powers p^e, e being
+ * the number of odd floor(n / p^k). This is the same algorithm used by GMP.
+ */
+
+/* Odd numbers sieve: bit i is set if 2i+1 is composite, for 2i+1 <= n */
+uint8 *
+pmpz_odd_sieve(unsigned long n)
+{
+    unsigned long   size = n / 2 + 1;
+    unsigned long   i, j;
+    uint8           *s;
+
+    s = (uint8 *)palloc0(size / 8 + 1);
+    s[0] |= 1;      /* 1 is not prime */
+    for (i = 1; (2 * i + 1) * (2 * i + 1) <= n; i++)
+    {
+        if (s[i / 8] & (1 << (i % 8))) {
+            continue;
+        }
+        for (j = (2 * i + 1) * (2 * i + 1) / 2; j < size; j += 2 * i + 1) {
+            s[j / 8] |= 1 << (j % 8);
+        }
+        if ((i & 0xFFF) == 0) {
+            CHECK_FOR_INTERRUPTS();
+        }
+    }
+
+    return s;
+}
+
+static void
+_swing(mpz_ptr res, unsigned long n, const uint8 *sieve)
+{
+    unsigned long   *v, acc, q, p, pk, i;
+    size_t          nv = 0;
+    int             e;
+
+    /* the prime powers packed in words, at most one per odd number */
+    v = (unsigned long *)palloc((n / 4 + 2) * sizeof(unsigned long));
+    acc = 1;
+
+    for (i = 0; 2 * i + 1 <= n; i++)
+    {
+        if (i == 0) {
+            p = 2;      /* slot 0 is used for the even prime */
+        }
+        else if (sieve[i / 8] & (1 << (i % 8))) {
+            continue;
+        }
+        else {
+            p = 2 * i + 1;
+        }
+
+        pk = 1;
+        for (q = n / p, e = 0; q > 0; q /= p) {
+            if (q & 1) {
+                pk *= p;
+                e++;
+            }
+        }
+        if (e == 0) {
+            continue;
+        }
+
+        if (acc > ULONG_MAX / pk) {
+            v[nv++] = acc;
+            acc = pk;
+        }
+        else {
+            acc *= pk;
+        }
+    }
+    v[nv++] = acc;
+
+    mpz_prod_ui_intr(res, v, nv);
+    pfree(v);
+}
+
+static void
+_fac(mpz_ptr res, unsigned long n, const uint8 *sieve)
+{
+    mpz_t       sw;
+
+    if (n * log2(n + 1.0) < PMPZ_INTR_BITS) {
+        mpz_fac_ui(res, n);
+        return;
+    }
+
+    _fac(res, n / 2, sieve);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(res, res, res);
+
+    mpz_init(sw);
+    _swing(sw, n, sieve);
+    CHECK_FOR_INTERRUPTS();
+    mpz_mul(res, res, sw);
+    mpz_clear(sw);
+}
+
+void
+mpz_fac_ui_intr(mpz_ptr res, unsigned long n)
+{
+    uint8       *sieve;
+
+    pgmp_check_result_bits(lgamma(n + 1.0) * LOG2_E);
+
+    if (n * log2(n + 1.0) < PMPZ_INTR_BITS) {
+        mpz_fac_ui(res, n);
+        return;
+    }
+
+    sieve = pmpz_odd_sieve(n);
+    _fac(res, n, sieve);
+    pfree(sieve);
+}
+
+
+/*
+ * Fibonacci and Lucas numbers.
+ *
+ * Computed from a small pair of Fibonacci numbers by doubling the index:
+ *
+ *      F[2k+1] = 4 F[k]^2 - F[k-1]^2 + 2 (-1)^k
+ *      F[2k-1] = F[k]^2 + F[k-1]^2
+ *      F[2k] = F[2k+1] - F[2k-1]
+ */
+
+void
+mpz_fib2_ui_intr(mpz_ptr fn, mpz_ptr fnsub1, unsigned long n)
+{
+    int         shift;
+    unsigned long k;
+    mpz_t       f1, f0, t;
+
+    pgmp_check_result_bits(PMPZ_FIB_BITS(n));
+
+    if (PMPZ_FIB_BITS(n) < PMPZ_INTR_BITS) {
+        mpz_fib2_ui(fn, fnsub1, n);
+        return;
+    }
+
+    /* Start from the top bits of n */
+    for (shift = 0; PMPZ_FIB_BITS(n >> shift) >= PMPZ_INTR_BITS / 2; shift++);
+    k = n >> shift;
+
+    mpz_init(f1);
+    mpz_init(f0);
+    mpz_init(t);
+    mpz_fib2_ui(f1, f0, k);
+
+    while (shift-- > 0)
+    {
+        CHECK_FOR_INTERRUPTS();
+
+        mpz_mul(f1, f1, f1);            /* F[k]^2 */
+        mpz_mul(f0, f0, f0);            /* F[k-1]^2 */
+        mpz_mul_2exp(t, f1, 2);
+        mpz_sub(t, t, f0);              /* F[2k+1] */
+        if (k & 1) {
+            mpz_sub_ui(t, t, 2);
+        }
+        else {
+            mpz_add_ui(t, t, 2);
+        }
+        mpz_add(f0, f1, f0);            /* F[2k-1] */
+        mpz_sub(f1, t, f0);             /* F[2k] */
+
+        if ((n >> shift) & 1) {
+            /* (F[2k+1], F[2k]) */
+            mpz_swap(f0, f1);
+            mpz_swap(f1, t);
+            k = 2 * k + 1;
+        }
+        else {
+            k = 2 * k;
+        }
+    }
+
+    mpz_swap(fn, f1);
+    mpz_swap(fnsub1, f0);
+    mpz_clear(f1);
+    mpz_clear(f0);
+    mpz_clear(t);
+}
+
+void
+mpz_fib_ui_intr(mpz_ptr fn, unsigned long n)
+{
+    mpz_t       t;
+
+    mpz_init(t);
+    mpz_fib2_ui_intr(fn, t, n);
+    mpz_clear(t);
+}
+
+/* L[n] = F[n] + 2 F[n-1], L[n-1] = 2 F[n] - F[n-1] */
+void
+mpz_lucnum2_ui_intr(mpz_ptr ln, mpz_ptr lnsub1, unsigned long n)
+{
+    mpz_t       f1, f0;
+
+    pgmp_check_result_bits(PMPZ_FIB_BITS(n));
+
+    if (PMPZ_FIB_BITS(n) < PMPZ_INTR_BITS) {
+        mpz_lucnum2_ui(ln, lnsub1, n);
+        return;
+    }
+
+    mpz_init(f1);
+    mpz_init(f0);
+    mpz_fib2_ui_intr(f1, f0, n);
+    mpz_mul_2exp(ln, f0, 1);
+    mpz_add(ln, ln, f1);
+    mpz_mul_2exp(lnsub1, f1, 1);
+    mpz_sub(lnsub1, lnsub1, f0);
+    mpz_clear(f1);
+    mpz_clear(f0);
+}
+
+void
+mpz_lucnum_ui_intr(mpz_ptr ln, unsigned long n)
+{
+    mpz_t       t;
+
+    mpz_init(t);
+    mpz_lucnum2_ui_intr(ln, t, n);
+    mpz_clear(t);
+}
+
+
+/*
+ * Power, by left-to-right binary exponentiation of the odd part of the base.
+ */
+void
+mpz_pow_ui_intr(mpz_ptr res, mpz_srcptr base, unsigned long exp)
+{
+    double          bits;
+    mp_bitcnt_t     tz;
+    mpz_t           b, r;
+    int             i;
+
+    if (MPZ_IS_ZERO(base) || exp == 0) {
+        mpz_pow_ui(res, base, exp);
+        return;
+    }
+
+    /* the result is at least this large */
+    bits = (mpz_sizeinbase(base, 2) - 1.0) * exp + 1.0;
+    pgmp_check_result_bits(bits);
+
+    if (bits < PMPZ_INTR_BITS) {
+        mpz_pow_ui(res, base, exp);
+        return;
+    }
+
+    tz = mpz_scan1(base, 0);
+    mpz_init(b);
+    mpz_tdiv_q_2exp(b, base, tz);
+    mpz_init_set(r, b);
+
+    for (i = (int)(sizeof(unsigned long) * CHAR_BIT) - 1; !(exp >> i); i--);
+    while (--i >= 0)
+    {
+        CHECK_FOR_INTERRUPTS();
+        mpz_mul(r, r, r);
+        if ((exp >> i) & 1) {
+            mpz_mul(r, r, b);
+        }
+    }
+
+    mpz_mul_2exp(res, r, tz * exp);
+    mpz_clear(b);
+    mpz_clear(r);
+}
+
+/* log2 of a positive mpz */
+static double
+_log2_mpz(mpz_srcptr z)
+{
+    long        e;
+    double      d = mpz_get_d_2exp(&e, z);
+
+    return e + log2(d);
+}
+
+void
+mpz_bin_ui_intr(mpz_ptr res, mpz_srcptr n, unsigned long k)
+{
+    mpz_t       m;
+    unsigned long j;
+    double      bits = 1;
+
+    /* bin(-n, k) = (-1)^k bin(n + k - 1, k) */
+    mpz_init(m);
+    if (SIZ(n) < 0) {
+        mpz_neg(m, n);
+        mpz_add_ui(m, m, k);
+        mpz_sub_ui(m, m, 1);
+    }
+    else {
+        mpz_set(m, n);
+    }
+
+    /* bin(m, k) = bin(m, m - k): the estimate is better for the smaller */
+    if (k > 0 && mpz_cmp_ui(m, k) >= 0)
+    {
+        j = k;
+        mpz_sub_ui(m, m, k);
+        if (mpz_cmp_ui(m, k) < 0) {
+            j = mpz_get_ui(m);
+        }
+        mpz_add_ui(m, m, k);
+
+        if (mpz_sizeinbase(m, 2) <= 53) {
+            double  dm = mpz_get_d(m);
+
+            bits = (lgamma(dm + 1.0) - lgamma(j + 1.0) - lgamma(dm - j + 1.0))
+                * LOG2_E;
+        }
+        else {
+            /* about log2(m^j / j!) */
+            bits = j * _log2_mpz(m) - lgamma(j + 1.0) * LOG2_E;
+        }
+    }
+    mpz_clear(m);
+    pgmp_check_result_bits(bits);
+
+    mpz_bin_ui(res, n, k);
+}
+
+void
+mpz_mul_2exp_intr(mpz_ptr res, mpz_srcptr z, mp_bitcnt_t b)
+{
+    if (!MPZ_IS_ZERO(z)) {
+        pgmp_check_result_bits((double)mpz_sizeinbase(z, 2) + b);
+    }
+    mpz_mul_2exp(res, z, b);
+}
+
+
+/*
+ * Modular exponentiation.
+ *
+ * If the computation is long the exponent is split in chunks of c bits,
+ * from the least significant:
+ *
+ *      b^e = prod (b^(2^(c i)))^e[i]
+ *
+ * This costs about twice a single mpz_powm, so it is only used when a call
+ * would take more than about a second.
+ */
+
+static double
+_powm_cost(double ebits, mpz_srcptr mod)
+{
+    return ebits * pow(NLIMBS(mod), 1.585);
+}
+
+void
+mpz_powm_intr(mpz_ptr res, mpz_srcptr base, mpz_srcptr exp, mpz_srcptr mod)
+{
+    double          ebits = mpz_sizeinbase(exp, 2);
+    mp_bitcnt_t     c, off;
+    mpz_t           r, b, e, t;
+
+    if (_powm_cost(ebits, mod) < 4.0 * PMPZ_INTR_POWM_COST) {
+        mpz_powm(res, base, exp, mod);
+        return;
+    }
+
+    c = (mp_bitcnt_t)(ebits * PMPZ_INTR_POWM_COST / _powm_cost(ebits, mod));
+    c = Max(c, 1);
+
+    mpz_init(r);
+    mpz_init(b);
+    mpz_init(e);
+    mpz_init(t);
+    mpz_set_ui(r, 1);
+    mpz_mod(r, r, mod);
+    mpz_mod(b, base, mod);
+    mpz_setbit(t, c);       /* 2^c */
+
+    for (off = 0; off < ebits; off += c)
+    {
+        CHECK_FOR_INTERRUPTS();
+        if (off) {
+            mpz_powm(b, b, t, mod);
+        }
+        mpz_tdiv_q_2exp(e, exp, off);
+        mpz_tdiv_r_2exp(e, e, c);
+        if (!MPZ_IS_ZERO(e)) {
+            mpz_powm(e, b, e, mod);
+            mpz_mul(r, r, e);
+            mpz_mod(r, r, mod);
+        }
+    }
+
+    mpz_swap(res, r);
+    mpz_clear(r);
+    mpz_clear(b);
+    mpz_clear(e);
+    mpz_clear(t);
+}
+
+
+/*
+ * Next prime.
+ *
+ * The odd candidates are sieved a window at a time by the primes of the
+ * small primes table, keeping their residues from a window to the next, and
+ * the survivors are tested as mpz_nextprime does.
+ */
+
+/* Number of odd candidates sieved at once */
+#define PMPZ_INTR_PRIME_WINDOW 4096
+
+void
+mpz_nextprime_intr(mpz_ptr res, mpz_srcptr z)
+{
+    const uint32    *primes;
+    uint32          *rems;
+    uint8           *comp;
+    uint64          j, p;
+    mpz_t           c;
+    int             nprimes, i;
+    bool            found = false;
+
+    if (SIZ(z) <= 0 || mpz_sizeinbase(z, 2) < PMPZ_INTR_PRIME_BITS) {
+        mpz_nextprime(res, z);
+        return;
+    }
+
+    primes = pmpz_small_primes(
+        pmpz_trial_limit(mpz_sizeinbase(z, 2)), &nprimes);
+    rems = (uint32 *)palloc(Max(nprimes, 1) * sizeof(uint32));
+    comp = (uint8 *)palloc(PMPZ_INTR_PRIME_WINDOW);
+
+    /* the first odd number greater than z */
+    mpz_init(c);
+    mpz_add_ui(c, z, mpz_odd_p(z) ? 2 : 1);
+    for (i = 0; i < nprimes; i++) {
+        rems[i] = mpz_fdiv_ui(c, primes[i]);
+    }
+
+    while (!found)
+    {
+        /* mark the candidates c + 2j with a small factor */
+        memset(comp, 0, PMPZ_INTR_PRIME_WINDOW);
+        for (i = 0; i < nprimes; i++)
+        {
+            p = primes[i];
+            /* c + 2j = 0 mod p: j = -c / 2 mod p */
+            for (j = (p - rems[i]) % p * ((p + 1) / 2) % p;
+                    j < PMPZ_INTR_PRIME_WINDOW; j += p) {
+                comp[j] = 1;
+            }
+            rems[i] = (rems[i] + 2 * PMPZ_INTR_PRIME_WINDOW) % p;
+        }
+
+        for (j = 0; j < PMPZ_INTR_PRIME_WINDOW; j++)
+        {
+            if (comp[j]) {
+                continue;
+            }
+            CHECK_FOR_INTERRUPTS();
+            mpz_add_ui(res, c, 2 * j);
+            if (mpz_bpsw_prime_p(res, 25)) {
+                found = true;
+                break;
+            }
+        }
+
+        mpz_add_ui(c, c, 2 * PMPZ_INTR_PRIME_WINDOW);
+    }
+
+    mpz_clear(c);
+    pfree(rems);
+    pfree(comp);
+}
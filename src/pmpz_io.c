@@ -23,7 +23,8 @@
 #include "pgmp-impl.h"
 
 #include "fmgr.h"
-#include "utils/builtins.h"     /* for numeric_out */
+#include "utils/builtins.h"     /* for TextDatumGetCString */
+#include "utils/varbit.h"
 
 #include <math.h>               /* for isinf, isnan */
 
@@ -32,13 +33,242 @@
  * Input/Output functions
  */
 
+/*
+ * Fast paths for small values.
+ *
+ * Most of the values in a text COPY are small enough to fit in a pgmp_small
+ * (two limbs on 64 bit platforms): parse and print them without going
+ * through the GMP string functions and their extra allocations.
+ */
+
+/* "00" "01" ... "99": the digits of the numbers from 0 to 99 */
+static const char _pgmp_digits2[201] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+/*
+ * Parse a small decimal number at the start of str.
+ *
+ * Accept an optional minus followed by at most PGMP_SMALL_DIGITS digits,
+ * with no leading zero (which would denote an octal number). Return a
+ * pointer to the first char after the digits or NULL if the number can't
+ * be parsed by the fast path.
+ */
+const char *
+pgmp_small_parse(const char *str, pgmp_small *v, bool *neg)
+{
+    const char  *p = str;
+    const char  *start;
+    pgmp_small  acc = 0;
+
+    if ((*neg = (*p == '-'))) {
+        p++;
+    }
+
+    start = p;
+    if (*p == '0') {
+        p++;
+    }
+    else {
+        while ((unsigned)(*p - '0') < 10) {
+            acc = acc * 10 + (*p++ - '0');
+        }
+    }
+
+    if (p == start || p - start > PGMP_SMALL_DIGITS) {
+        return NULL;
+    }
+
+    *v = acc;
+    return p;
+}
+
+/* Write the digits of v right aligned before end, return their start */
+static char *
+_pgmp_format_u64(char *end, uint64 v)
+{
+    while (v >= 100) {
+        int i = (v % 100) * 2;
+        v /= 100;
+        *--end = _pgmp_digits2[i + 1];
+        *--end = _pgmp_digits2[i];
+    }
+    if (v >= 10) {
+        *--end = _pgmp_digits2[v * 2 + 1];
+        *--end = _pgmp_digits2[v * 2];
+    }
+    else {
+        *--end = '0' + v;
+    }
+    return end;
+}
+
+/*
+ * Print the digits of v into buf and terminate it.
+ *
+ * Return the pointer to the terminator.
+ */
+char *
+pgmp_small_format(char *buf, pgmp_small v)
+{
+    char        tmp[PGMP_SMALL_BUFSIZE];
+    char        *end = tmp + sizeof(tmp);
+    char        *p;
+    size_t      len;
+
+#ifdef __SIZEOF_INT128__
+    if (v > PG_UINT64_MAX)
+    {
+        /* split in chunks of 19 digits, padding the lower ones with 0s */
+        const uint64 e19 = 10000000000000000000ULL;
+        int         i;
+
+        while (v > PG_UINT64_MAX) {
+            p = _pgmp_format_u64(end, (uint64)(v % e19));
+            for (i = 19 - (end - p); i > 0; i--) {
+                *--p = '0';
+            }
+            end = p;
+            v /= e19;
+        }
+    }
+#endif
+    p = _pgmp_format_u64(end, (uint64)v);
+
+    len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return buf + len;
+}
+
+/* Split v into limbs, return their number */
+int
+pgmp_small_to_limbs(pgmp_small v, mp_limb_t *limbs)
+{
+    int         n = 0;
+
+    while (v) {
+        limbs[n++] = (mp_limb_t)v;
+        /* two shifts: a single one may be as wide as v */
+        v >>= GMP_NUMB_BITS / 2;
+        v >>= GMP_NUMB_BITS / 2;
+    }
+    return n;
+}
+
+/* Set v = abs(z) and return true if it fits in a pgmp_small */
+bool
+mpz_get_small(mpz_srcptr z, pgmp_small *v)
+{
+    int         i;
+
+    if (NLIMBS(z) > PGMP_SMALL_LIMBS) {
+        return false;
+    }
+
+    *v = 0;
+    for (i = NLIMBS(z) - 1; i >= 0; i--) {
+        *v <<= GMP_NUMB_BITS / 2;
+        *v <<= GMP_NUMB_BITS / 2;
+        *v |= LIMBS(z)[i];
+    }
+    return true;
+}
+
+
+/*
+ * Parse a long decimal number, made only of an optional minus and digits
+ * not starting with 0.
+ *
+ * The digits are converted into their values, and validated, 8 at time in a
+ * 64 bit word, then passed to mpn_set_str, which uses a divide and conquer
+ * algorithm for large numbers and writes the limbs straight into the result.
+ *
+ * Return NULL if the string is not in this format.
+ */
+static pmpz *
+_pmpz_from_decimal(const char *str)
+{
+    const char      *p = str;
+    bool            neg;
+    size_t          len, i, nlimbs;
+    unsigned char   *digits;
+    uint64          w, bad = 0;
+    mp_size_t       size;
+    pmpz            *res;
+
+    if ((neg = (*p == '-'))) {
+        p++;
+    }
+    if ((unsigned)(*p - '1') >= 9) {
+        return NULL;
+    }
+
+    len = strlen(p);
+    digits = (unsigned char *)palloc(len);
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        /* a byte is not a digit if it overflows or is >= 10 */
+        memcpy(&w, p + i, 8);
+        w -= UINT64CONST(0x3030303030303030);
+        bad |= (w | (w + UINT64CONST(0x7676767676767676)))
+            & UINT64CONST(0x8080808080808080);
+        memcpy(digits + i, &w, 8);
+    }
+    for (; i < len; i++)
+    {
+        digits[i] = (unsigned char)(p[i] - '0');
+        bad |= (digits[i] > 9);
+    }
+
+    if (bad) {
+        pfree(digits);
+        return NULL;
+    }
+
+    /* mpn_set_str wants room for the largest number of len digits + 1 */
+    nlimbs = (size_t)(len * 3.3219280948873626 / GMP_NUMB_BITS) + 2;
+    res = (pmpz *)palloc(PMPZ_HDRSIZE + nlimbs * sizeof(mp_limb_t));
+    size = mpn_set_str(res->data, digits, len, 10);
+    pfree(digits);
+
+    SET_VARSIZE(res, PMPZ_HDRSIZE + size * sizeof(mp_limb_t));
+    res->mdata = neg ? PMPZ_SIGN_MASK : 0;      /* version: 0 */
+
+    return res;
+}
+
 PGMP_PG_FUNCTION(pmpz_in)
 {
-    char    *str;
-    mpz_t   z;
+    char        *str;
+    const char  *end;
+    pgmp_small  v;
+    bool        neg;
+    pmpz        *res;
+    mpz_t       z;
 
     str = PG_GETARG_CSTRING(0);
 
+    if ((end = pgmp_small_parse(str, &v, &neg)) && *end == '\0')
+    {
+        mp_limb_t   limbs[PGMP_SMALL_LIMBS];
+        int         n = pgmp_small_to_limbs(v, limbs);
+
+        res = (pmpz *)palloc(PMPZ_HDRSIZE + n * sizeof(mp_limb_t));
+        SET_VARSIZE(res, PMPZ_HDRSIZE + n * sizeof(mp_limb_t));
+        res->mdata = (neg && n) ? PMPZ_SIGN_MASK : 0;   /* version: 0 */
+        memcpy(res->data, limbs, n * sizeof(mp_limb_t));
+        PG_RETURN_POINTER(res);
+    }
+
+    if ((res = _pmpz_from_decimal(str))) {
+        PG_RETURN_POINTER(res);
+    }
+
     if (0 != mpz_init_set_str(z, str, 0))
     {
         const char *ell;
@@ -91,9 +321,17 @@ PGMP_PG_FUNCTION(pmpz_out)
 {
     const mpz_t     z = {0};
     char            *buf;
+    pgmp_small      v;
 
     PGMP_GETARG_MPZ(z, 0);
 
+    if (mpz_get_small(z, &v)) {
+        buf = palloc(PGMP_SMALL_BUFSIZE);
+        buf[0] = '-';
+        pgmp_small_format(buf + (SIZ(z) < 0), v);
+        PG_RETURN_CSTRING(buf);
+    }
+
     /* We must allocate the output buffer ourselves because the buffer
      * returned by mpz_get_str actually starts a few bytes before (because of
      * the custom GMP allocator); Postgres will try to free the pointer we
@@ -238,32 +476,6 @@ _pmpz_from_double(double in)
 }
 
 
-PGMP_PG_FUNCTION(pmpz_from_numeric)
-{
-    char    *str;
-    char    *p;
-    mpz_t   z;
-
-    /* convert the numeric into string. */
-    str = DatumGetCString(DirectFunctionCall1(numeric_out,
-        PG_GETARG_DATUM(0)));
-
-    /* truncate the string if it contains a decimal dot */
-    if ((p = strchr(str, '.'))) { *p = '\0'; }
-
-    if (0 != mpz_init_set_str(z, str, 10))
-    {
-        /* here str may have been cropped, but I expect this error
-         * only triggered by NaN, so not in case of regular number */
-        ereport(ERROR, (
-            errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
-            errmsg("can't convert numeric value to mpz: \"%s\"", str)));
-    }
-
-    PGMP_RETURN_MPZ(z);
-}
-
-
 PGMP_PG_FUNCTION(pmpz_to_int2)
 {
     const mpz_t     z = {0};
@@ -390,3 +602,173 @@ PGMP_PG_FUNCTION(pmpz_to_float8)
     PG_RETURN_FLOAT8((float8)out);
 }
 
+
+/*
+ * Raw binary conversions
+ *
+ * The bytes are copied in and out of the limbs by mpz_import/mpz_export,
+ * with no intermediate string.
+ */
+
+/* Return the mpz_import/mpz_export order for a byte order name */
+static int
+_pmpz_byte_order(text *t)
+{
+    char        *s = text_to_cstring(t);
+
+    if (0 == strcmp(s, "big")) {
+        return 1;
+    }
+    if (0 == strcmp(s, "little")) {
+        return -1;
+    }
+
+    ereport(ERROR, (
+        errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+        errmsg("invalid byte order: \"%s\"", s),
+        errhint("byte order should be 'big' or 'little'")));
+
+    return 0;   /* never reached */
+}
+
+PGMP_PG_FUNCTION(pmpz_from_bytea)
+{
+    bytea           *b = PG_GETARG_BYTEA_PP(0);
+    const unsigned char *p = (const unsigned char *)VARDATA_ANY(b);
+    size_t          n = VARSIZE_ANY_EXHDR(b);
+    int             order = 1;
+    bool            sign = false;
+    mpz_t           z;
+
+    if (PG_NARGS() > 1) {
+        order = _pmpz_byte_order(PG_GETARG_TEXT_PP(1));
+        sign = PG_GETARG_BOOL(2);
+    }
+
+    mpz_init(z);
+    if (n == 0) {
+        PGMP_RETURN_MPZ(z);
+    }
+
+    mpz_import(z, n, order, 1, 0, 0, p);
+
+    /* two's complement: subtract 2^(8n) if the sign bit is set */
+    if (sign && (p[order > 0 ? 0 : n - 1] & 0x80)) {
+        mpz_t   t;
+
+        mpz_init(t);
+        mpz_setbit(t, 8 * n);
+        mpz_sub(z, z, t);
+        mpz_clear(t);
+    }
+
+    PGMP_RETURN_MPZ(z);
+}
+
+/*
+ * Export z as bytes.
+ *
+ * Unsigned values use the minimum number of bytes (one for zero); signed
+ * values use the minimum number of bytes in two's complement, so that the
+ * most significant bit is the sign.
+ */
+PGMP_PG_FUNCTION(pmpz_to_bytea)
+{
+    const mpz_t     z = {0};
+    int             order = 1;
+    bool            sign = false;
+    bool            neg;
+    mpz_t           t;
+    size_t          nbytes, count, i;
+    bytea           *res;
+    unsigned char   *p;
+
+    PGMP_GETARG_MPZ(z, 0);
+    if (PG_NARGS() > 1) {
+        order = _pmpz_byte_order(PG_GETARG_TEXT_PP(1));
+        sign = PG_GETARG_BOOL(2);
+    }
+    if (!sign) {
+        PMPZ_CHECK_NONEG(z);
+    }
+
+    /* the bytes of a negative z are the complement of the bytes of -z-1 */
+    neg = SIZ(z) < 0;
+    mpz_init(t);
+    if (neg) {
+        mpz_com(t, z);
+    }
+    else {
+        mpz_set(t, z);
+    }
+
+    if (sign) {
+        nbytes = mpz_sizeinbase(t, 2) / 8 + 1;
+    }
+    else {
+        nbytes = (mpz_sizeinbase(t, 2) + 7) / 8;
+    }
+    count = MPZ_IS_ZERO(t) ? 0 : (mpz_sizeinbase(t, 2) + 7) / 8;
+
+    res = (bytea *)palloc0(VARHDRSZ + nbytes);
+    SET_VARSIZE(res, VARHDRSZ + nbytes);
+    p = (unsigned char *)VARDATA(res);
+
+    if (count) {
+        mpz_export(p + (order > 0 ? nbytes - count : 0),
+            NULL, order, 1, 0, 0, t);
+    }
+    if (neg) {
+        for (i = 0; i < nbytes; i++) {
+            p[i] = ~p[i];
+        }
+    }
+
+    mpz_clear(t);
+    PG_RETURN_BYTEA_P(res);
+}
+
+PGMP_PG_FUNCTION(pmpz_from_varbit)
+{
+    VarBit          *vb = PG_GETARG_VARBIT_P(0);
+    int             nbytes = VARBITBYTES(vb);
+    mpz_t           z;
+
+    mpz_init(z);
+    if (nbytes == 0) {
+        PGMP_RETURN_MPZ(z);
+    }
+
+    /* the bits are left-aligned in the bytes, the last ones are padding */
+    mpz_import(z, nbytes, 1, 1, 0, 0, VARBITS(vb));
+    mpz_tdiv_q_2exp(z, z, 8 * nbytes - VARBITLEN(vb));
+
+    PGMP_RETURN_MPZ(z);
+}
+
+PGMP_PG_FUNCTION(pmpz_to_varbit)
+{
+    const mpz_t     z = {0};
+    size_t          nbits, len;
+    VarBit          *res;
+    mpz_t           t;
+
+    PGMP_GETARG_MPZ(z, 0);
+    PMPZ_CHECK_NONEG(z);
+
+    /* zero is represented as B'0' */
+    nbits = mpz_sizeinbase(z, 2);
+    len = VARBITTOTALLEN(nbits);
+    res = (VarBit *)palloc0(len);
+    SET_VARSIZE(res, len);
+    VARBITLEN(res) = nbits;
+
+    if (!MPZ_IS_ZERO(z)) {
+        mpz_init(t);
+        mpz_mul_2exp(t, z, (8 - nbits % 8) % 8);
+        mpz_export(VARBITS(res), NULL, 1, 1, 0, 0, t);
+        mpz_clear(t);
+    }
+
+    PG_RETURN_VARBIT_P(res);
+}
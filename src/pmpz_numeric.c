@@ -0,0 +1,356 @@
+/* pmpz_numeric -- conversion between mpz and numeric
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"     /* for numeric_send, numeric_recv */
+
+
+/*
+ * The numeric internal representation is private to the backend, but its
+ * binary send/recv format exposes the same base 10000 digits:
+ *
+ *      int16 ndigits, int16 weight, uint16 sign, int16 dscale,
+ *      int16 digits[ndigits]
+ *
+ * all in network byte order, the first digit being the most significant.
+ * The digits are converted from and to limbs without going through a
+ * decimal string.
+ */
+
+#define PGMP_NUMERIC_HDRSIZE (4 * sizeof(int16))
+
+/* Number of base 10000 digits fitting in an unsigned long */
+#if PGMP_LONG_64
+#define PGMP_NUMERIC_GROUP 4
+#else
+#define PGMP_NUMERIC_GROUP 2
+#endif
+
+/* Below this number of digits don't use divide and conquer */
+#define PGMP_NUMERIC_DC_THRESHOLD 64
+
+
+static inline int16
+_get_int16(const char *p)
+{
+    return (int16)(((uint8)p[0] << 8) | (uint8)p[1]);
+}
+
+static inline void
+_put_int16(char *p, int16 v)
+{
+    p[0] = (char)(((uint16)v >> 8) & 0xFF);
+    p[1] = (char)((uint16)v & 0xFF);
+}
+
+
+/*
+ * Unpack a numeric Datum into its base 10000 digits.
+ */
+void
+pgmp_numeric_unpack(pgmp_numeric *num, Datum d)
+{
+    bytea       *b;
+    const char  *p;
+    int         i;
+
+    b = DatumGetByteaPP(DirectFunctionCall1(numeric_send, d));
+    p = VARDATA_ANY(b);
+
+    num->ndigits = _get_int16(p);
+    num->weight = _get_int16(p + 2);
+    num->sign = (uint16)_get_int16(p + 4);
+    num->dscale = _get_int16(p + 6);
+
+    num->digits = (int16 *)palloc(Max(num->ndigits, 1) * sizeof(int16));
+    p += PGMP_NUMERIC_HDRSIZE;
+    for (i = 0; i < num->ndigits; i++, p += 2) {
+        num->digits[i] = _get_int16(p);
+    }
+}
+
+/*
+ * Build a numeric Datum from its base 10000 digits, applying typmod.
+ *
+ * Leading and trailing zero digits are allowed.
+ */
+Datum
+pgmp_numeric_pack(const pgmp_numeric *num, int32 typmod)
+{
+    StringInfoData  buf;
+    char            *p;
+    int             i;
+
+    if (num->ndigits > PG_INT16_MAX
+            || num->weight > PG_INT16_MAX || num->weight < -PG_INT16_MAX) {
+        ereport(ERROR, (
+            errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+            errmsg("value overflows numeric format")));
+    }
+
+    buf.len = buf.maxlen = PGMP_NUMERIC_HDRSIZE + num->ndigits * sizeof(int16);
+    buf.data = p = palloc(buf.len + 1);
+    buf.cursor = 0;
+
+    _put_int16(p, num->ndigits);
+    _put_int16(p + 2, num->weight);
+    _put_int16(p + 4, (int16)num->sign);
+    _put_int16(p + 6, num->dscale);
+    p += PGMP_NUMERIC_HDRSIZE;
+    for (i = 0; i < num->ndigits; i++, p += 2) {
+        _put_int16(p, num->digits[i]);
+    }
+
+    return DirectFunctionCall3(numeric_recv, PointerGetDatum(&buf),
+        ObjectIdGetDatum(InvalidOid), Int32GetDatum(typmod));
+}
+
+
+/*
+ * Powers 10000^(2^k) used to split the numbers in the divide and conquer
+ * conversions. Computed on demand and only valid during a conversion.
+ */
+typedef struct
+{
+    int         n;
+    mpz_t       p[32];
+
+} _nbase_powers;
+
+static mpz_srcptr
+_nbase_power(_nbase_powers *pows, int k)
+{
+    for (; pows->n <= k; pows->n++)
+    {
+        mpz_init(pows->p[pows->n]);
+        if (pows->n == 0) {
+            mpz_set_ui(pows->p[0], 10000);
+        }
+        else {
+            mpz_mul(pows->p[pows->n], pows->p[pows->n - 1],
+                pows->p[pows->n - 1]);
+        }
+    }
+    return pows->p[k];
+}
+
+static void
+_nbase_powers_clear(_nbase_powers *pows)
+{
+    int         i;
+
+    for (i = 0; i < pows->n; i++) {
+        mpz_clear(pows->p[i]);
+    }
+}
+
+/* Return the largest k such as 2^k < n */
+static inline int
+_nbase_split(int n)
+{
+    int         k = 0;
+
+    while ((2 << k) < n) {
+        k++;
+    }
+    return k;
+}
+
+
+static void
+_mpz_set_digits(mpz_ptr z, const int16 *digits, int n, _nbase_powers *pows)
+{
+    int             i, j, k;
+    unsigned long   g, m;
+    mpz_t           lo;
+
+    if (n <= PGMP_NUMERIC_DC_THRESHOLD)
+    {
+        mpz_set_ui(z, 0);
+        for (i = 0; i < n; i += PGMP_NUMERIC_GROUP)
+        {
+            g = 0;
+            m = 1;
+            for (j = i; j < n && j < i + PGMP_NUMERIC_GROUP; j++) {
+                g = g * 10000 + digits[j];
+                m *= 10000;
+            }
+            mpz_mul_ui(z, z, m);
+            mpz_add_ui(z, z, g);
+        }
+        return;
+    }
+
+    /* z = high * 10000^(2^k) + low, with low of 2^k digits */
+    k = _nbase_split(n);
+    mpz_init(lo);
+    _mpz_set_digits(lo, digits + n - (1 << k), 1 << k, pows);
+    _mpz_set_digits(z, digits, n - (1 << k), pows);
+    mpz_mul(z, z, _nbase_power(pows, k));
+    mpz_add(z, z, lo);
+    mpz_clear(lo);
+}
+
+/*
+ * Set z from n base 10000 digits, the most significant first.
+ *
+ * z must be initialized.
+ */
+void
+mpz_set_numeric_digits(mpz_ptr z, const int16 *digits, int n)
+{
+    _nbase_powers   pows;
+
+    pows.n = 0;
+    _mpz_set_digits(z, digits, n, &pows);
+    _nbase_powers_clear(&pows);
+}
+
+
+/* Write exactly n digits of z >= 0 into digits; z is destroyed */
+static void
+_mpz_get_digits(int16 *digits, mpz_ptr z, int n, _nbase_powers *pows)
+{
+    int             i, j, k;
+    unsigned long   g;
+    mpz_t           lo;
+
+    if (n <= PGMP_NUMERIC_DC_THRESHOLD)
+    {
+        for (i = n; i > 0; i -= PGMP_NUMERIC_GROUP)
+        {
+#if PGMP_LONG_64
+            g = mpz_tdiv_q_ui(z, z, 10000000000000000UL);
+#else
+            g = mpz_tdiv_q_ui(z, z, 100000000UL);
+#endif
+            for (j = i - 1; j >= 0 && j >= i - PGMP_NUMERIC_GROUP; j--) {
+                digits[j] = g % 10000;
+                g /= 10000;
+            }
+        }
+        return;
+    }
+
+    /* high, low = divmod(z, 10000^(2^k)), with low of 2^k digits */
+    k = _nbase_split(n);
+    mpz_init(lo);
+    mpz_tdiv_qr(z, lo, z, _nbase_power(pows, k));
+    _mpz_get_digits(digits + n - (1 << k), lo, 1 << k, pows);
+    _mpz_get_digits(digits, z, n - (1 << k), pows);
+    mpz_clear(lo);
+}
+
+/*
+ * Return the base 10000 digits of abs(z), the most significant first.
+ *
+ * The digits are allocated with palloc, their number is returned in n.
+ * There may be a leading zero digit.
+ */
+int16 *
+mpz_get_numeric_digits(mpz_srcptr z, int *n)
+{
+    int16           *digits;
+    _nbase_powers   pows;
+    mpz_t           t;
+
+    *n = (mpz_sizeinbase(z, 10) + 3) / 4;
+    digits = (int16 *)palloc(*n * sizeof(int16));
+
+    mpz_init(t);
+    mpz_abs(t, z);
+    pows.n = 0;
+    _mpz_get_digits(digits, t, *n, &pows);
+    _nbase_powers_clear(&pows);
+    mpz_clear(t);
+
+    return digits;
+}
+
+
+/*
+ * Conversion functions
+ */
+
+PGMP_PG_FUNCTION(pmpz_from_numeric)
+{
+    pgmp_numeric    num;
+    int             nint;
+    mpz_t           z, p;
+
+    pgmp_numeric_unpack(&num, PG_GETARG_DATUM(0));
+
+    if (UNLIKELY(num.sign != PGMP_NUMERIC_POS
+            && num.sign != PGMP_NUMERIC_NEG)) {
+        ereport(ERROR, (
+            errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+            errmsg("can't convert numeric value to mpz: \"%s\"",
+                DatumGetCString(DirectFunctionCall1(numeric_out,
+                    PG_GETARG_DATUM(0))))));
+    }
+
+    /* the digits of the integer part, discarding the decimals */
+    mpz_init(z);
+    nint = num.weight + 1;
+    if (nint > 0)
+    {
+        mpz_set_numeric_digits(z, num.digits, Min(nint, num.ndigits));
+
+        /* trailing zero digits are not stored */
+        if (nint > num.ndigits) {
+            mpz_init(p);
+            mpz_ui_pow_ui(p, 10000, nint - num.ndigits);
+            mpz_mul(z, z, p);
+            mpz_clear(p);
+        }
+
+        if (num.sign == PGMP_NUMERIC_NEG) {
+            mpz_neg(z, z);
+        }
+    }
+
+    PGMP_RETURN_MPZ(z);
+}
+
+
+PGMP_PG_FUNCTION(pmpz_to_numeric)
+{
+    const mpz_t     z = {0};
+    int64           i;
+    pgmp_numeric    num;
+
+    PGMP_GETARG_MPZ(z, 0);
+
+    if (0 == pmpz_get_int64(z, &i)) {
+        return DirectFunctionCall1(int8_numeric, Int64GetDatum(i));
+    }
+
+    num.digits = mpz_get_numeric_digits(z, &num.ndigits);
+    num.weight = num.ndigits - 1;
+    num.sign = SIZ(z) < 0 ? PGMP_NUMERIC_NEG : PGMP_NUMERIC_POS;
+    num.dscale = 0;
+
+    return pgmp_numeric_pack(&num, -1);
+}
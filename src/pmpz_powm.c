@@ -0,0 +1,370 @@
+/* pmpz_powm -- modular exponentiation functions
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"              /* for work_mem, CHECK_FOR_INTERRUPTS */
+#include "utils/array.h"
+
+
+/*
+ * GMP doesn't expose the setup of its modular exponentiation, so the work
+ * shared by many exponentiations with the same base and modulus is reused
+ * by precomputing a table of powers of the base: base^(d * 16^j) mod m for
+ * every digit d of a base 16 exponent. An exponentiation then takes a
+ * multiplication per non-zero exponent digit and no squaring, about three
+ * times faster than mpz_powm. Building the table costs about as much as five
+ * mpz_powm calls, so it is only done when it can be reused enough times.
+ */
+
+#define PMPZ_POWM_WBITS 4
+#define PMPZ_POWM_WSIZE ((1 << PMPZ_POWM_WBITS) - 1)
+
+/* Number of exponentiations above which the table is worth building */
+#define PMPZ_POWM_MIN_CALLS 8
+
+typedef struct
+{
+    mpz_t       mod;            /* abs of the modulus */
+    int         nwin;           /* number of exponent digits in the table */
+    mpz_t       *tab;           /* tab[j * WSIZE + d - 1] = b^(d * 16^j) */
+
+} pmpz_powm_table;
+
+
+static void
+_powm_table_init(pmpz_powm_table *t, mpz_srcptr mod)
+{
+    mpz_init(t->mod);
+    mpz_abs(t->mod, mod);
+    t->nwin = 0;
+    t->tab = NULL;
+}
+
+static void
+_powm_table_free(pmpz_powm_table *t)
+{
+    int         i;
+
+    for (i = 0; i < t->nwin * PMPZ_POWM_WSIZE; i++) {
+        mpz_clear(t->tab[i]);
+    }
+    if (t->tab) {
+        pfree(t->tab);
+    }
+    mpz_clear(t->mod);
+}
+
+/*
+ * Make sure the table can evaluate exponents with up to nbits bits.
+ *
+ * Return false if the table would be larger than work_mem: in this case the
+ * table is not changed.
+ */
+static bool
+_powm_table_extend(pmpz_powm_table *t, mpz_srcptr base, size_t nbits)
+{
+    int         nwin = (nbits + PMPZ_POWM_WBITS - 1) / PMPZ_POWM_WBITS;
+    int         j, d;
+    mpz_t       *row;
+
+    if (nwin <= t->nwin) {
+        return true;
+    }
+
+    if ((double)nwin * PMPZ_POWM_WSIZE
+            * (NLIMBS(t->mod) + 1) * sizeof(mp_limb_t)
+            > (double)work_mem * 1024.0) {
+        return false;
+    }
+
+    if (t->tab) {
+        t->tab = (mpz_t *)repalloc(t->tab,
+            nwin * PMPZ_POWM_WSIZE * sizeof(mpz_t));
+    }
+    else {
+        t->tab = (mpz_t *)palloc(nwin * PMPZ_POWM_WSIZE * sizeof(mpz_t));
+    }
+
+    for (j = t->nwin; j < nwin; j++)
+    {
+        row = t->tab + j * PMPZ_POWM_WSIZE;
+        mpz_init(row[0]);
+        if (j == 0) {
+            mpz_mod(row[0], base, t->mod);
+        }
+        else {
+            /* b^(16^j) = b^(15 * 16^(j-1)) * b^(16^(j-1)) */
+            mpz_mul(row[0], row[-1], row[-PMPZ_POWM_WSIZE]);
+            mpz_tdiv_r(row[0], row[0], t->mod);
+        }
+        for (d = 1; d < PMPZ_POWM_WSIZE; d++) {
+            mpz_init(row[d]);
+            mpz_mul(row[d], row[d - 1], row[0]);
+            mpz_tdiv_r(row[d], row[d], t->mod);
+        }
+    }
+    t->nwin = nwin;
+
+    return true;
+}
+
+/*
+ * Set res = base^exp mod m using a table extended to the size of exp.
+ */
+static void
+_powm_table_eval(mpz_ptr res, const pmpz_powm_table *t, mpz_srcptr exp)
+{
+    int             i, k, j;
+    mp_limb_t       limb;
+    unsigned        d;
+
+    mpz_set_ui(res, 1);
+    mpz_tdiv_r(res, res, t->mod);
+
+    for (i = 0; i < NLIMBS(exp); i++)
+    {
+        CHECK_FOR_INTERRUPTS();
+        limb = LIMBS(exp)[i];
+        for (k = 0; limb; k++, limb >>= PMPZ_POWM_WBITS)
+        {
+            if (!(d = limb & PMPZ_POWM_WSIZE)) {
+                continue;
+            }
+            j = i * (GMP_NUMB_BITS / PMPZ_POWM_WBITS) + k;
+            mpz_mul(res, res, t->tab[j * PMPZ_POWM_WSIZE + d - 1]);
+            mpz_tdiv_r(res, res, t->mod);
+        }
+    }
+}
+
+
+/*
+ * Scalar modular exponentiation.
+ *
+ * The function keeps in fn_extra a cache keyed on the modulus, reused while
+ * consecutive calls have the same one (e.g. in b^x mod p over many rows).
+ * When the same base is seen in a few consecutive calls too, the powers table
+ * of the base is built in the cache, and used until the base changes.
+ */
+
+typedef struct
+{
+    mpz_t               base;       /* base of the table */
+    int                 ncalls;     /* consecutive calls seen with base */
+    bool                valid;      /* the table has been built */
+    pmpz_powm_table     tab;        /* the modulus is the cache key */
+
+} pmpz_powm_cache;
+
+static pmpz_powm_cache *
+_powm_get_cache(FunctionCallInfo fcinfo, mpz_srcptr mod)
+{
+    pmpz_powm_cache *c;
+    MemoryContext   oldctx;
+
+    if (!fcinfo->flinfo) {
+        return NULL;
+    }
+
+    c = (pmpz_powm_cache *)fcinfo->flinfo->fn_extra;
+    if (LIKELY(c != NULL && mpz_cmpabs(c->tab.mod, mod) == 0)) {
+        return c;
+    }
+
+    oldctx = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    if (c == NULL) {
+        c = (pmpz_powm_cache *)palloc(sizeof(pmpz_powm_cache));
+        mpz_init(c->base);
+        fcinfo->flinfo->fn_extra = c;
+    }
+    else {
+        _powm_table_free(&c->tab);
+    }
+    c->ncalls = 0;
+    c->valid = false;
+    _powm_table_init(&c->tab, mod);
+    MemoryContextSwitchTo(oldctx);
+
+    return c;
+}
+
+/* Make the cache ready to compute the powers of base */
+static void
+_powm_cache_set_base(FunctionCallInfo fcinfo, pmpz_powm_cache *c,
+    mpz_srcptr base)
+{
+    MemoryContext   oldctx;
+
+    if (LIKELY(mpz_cmp(c->base, base) == 0)) {
+        return;
+    }
+
+    oldctx = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    mpz_set(c->base, base);
+    if (c->tab.nwin) {
+        /* drop the powers of the previous base */
+        mpz_t       mod;
+
+        mpz_init_set(mod, c->tab.mod);
+        _powm_table_free(&c->tab);
+        _powm_table_init(&c->tab, mod);
+        mpz_clear(mod);
+    }
+    MemoryContextSwitchTo(oldctx);
+
+    c->ncalls = 0;
+    c->valid = false;
+}
+
+PGMP_PG_FUNCTION(pmpz_powm)
+{
+    const mpz_t     base = {0};
+    const mpz_t     exp = {0};
+    const mpz_t     mod = {0};
+    pmpz_powm_cache *c;
+    MemoryContext   oldctx;
+    mpz_t           zf;
+
+    PGMP_GETARG_MPZ(base, 0);
+    PGMP_GETARG_MPZ(exp, 1);
+    PMPZ_CHECK_NONEG(exp);
+    PGMP_GETARG_MPZ(mod, 2);
+    PMPZ_CHECK_DIV0(mod);
+
+    mpz_init(zf);
+
+    if ((c = _powm_get_cache(fcinfo, mod)))
+    {
+        _powm_cache_set_base(fcinfo, c, base);
+        if (c->valid || ++c->ncalls >= PMPZ_POWM_MIN_CALLS)
+        {
+            oldctx = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+            c->valid = _powm_table_extend(
+                &c->tab, base, mpz_sizeinbase(exp, 2));
+            MemoryContextSwitchTo(oldctx);
+
+            if (c->valid) {
+                _powm_table_eval(zf, &c->tab, exp);
+                PGMP_RETURN_MPZ(zf);
+            }
+            /* too large: don't try again for a while */
+            c->ncalls = 0;
+        }
+    }
+
+    mpz_powm_intr(zf, base, exp, mod);
+
+    PGMP_RETURN_MPZ(zf);
+}
+
+
+/*
+ * Batch modular exponentiation.
+ *
+ * Null elements in the input array produce null elements in the output.
+ *
+ * With an array of bases there is no table to share: GMP doesn't expose the
+ * setup of the modulus, so every element is a mpz_powm call, saving only the
+ * overhead of a function call per element.
+ */
+
+PGMP_PG_FUNCTION(pmpz_powm_bases)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    const mpz_t     exp = {0};
+    const mpz_t     mod = {0};
+    mpz_t           *zs, *zf;
+    bool            *nulls;
+    int             n, i;
+
+    PGMP_GETARG_MPZ(exp, 1);
+    PMPZ_CHECK_NONEG(exp);
+    PGMP_GETARG_MPZ(mod, 2);
+    PMPZ_CHECK_DIV0(mod);
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+
+    zf = (mpz_t *)palloc(n * sizeof(mpz_t));
+    for (i = 0; i < n; i++) {
+        if (nulls[i]) {
+            continue;
+        }
+        CHECK_FOR_INTERRUPTS();
+        mpz_init(zf[i]);
+        mpz_powm_intr(zf[i], zs[i], exp, mod);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a),
+        zf, nulls, n, ARR_NDIM(a), ARR_DIMS(a), ARR_LBOUND(a)));
+}
+
+PGMP_PG_FUNCTION(pmpz_powm_exps)
+{
+    const mpz_t     base = {0};
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(1);
+    const mpz_t     mod = {0};
+    mpz_t           *zs, *zf;
+    bool            *nulls;
+    int             n, i, count = 0;
+    size_t          nbits = 0;
+    pmpz_powm_table tab;
+    bool            valid = false;
+
+    PGMP_GETARG_MPZ(base, 0);
+    PGMP_GETARG_MPZ(mod, 2);
+    PMPZ_CHECK_DIV0(mod);
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+
+    for (i = 0; i < n; i++) {
+        if (nulls[i]) {
+            continue;
+        }
+        PMPZ_CHECK_NONEG(zs[i]);
+        nbits = Max(nbits, mpz_sizeinbase(zs[i], 2));
+        count++;
+    }
+
+    if (count >= PMPZ_POWM_MIN_CALLS) {
+        _powm_table_init(&tab, mod);
+        valid = _powm_table_extend(&tab, base, nbits);
+    }
+
+    zf = (mpz_t *)palloc(n * sizeof(mpz_t));
+    for (i = 0; i < n; i++) {
+        if (nulls[i]) {
+            continue;
+        }
+        CHECK_FOR_INTERRUPTS();
+        mpz_init(zf[i]);
+        if (valid) {
+            _powm_table_eval(zf[i], &tab, zs[i]);
+        }
+        else {
+            mpz_powm_intr(zf[i], base, zs[i], mod);
+        }
+    }
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a),
+        zf, nulls, n, ARR_NDIM(a), ARR_DIMS(a), ARR_LBOUND(a)));
+}
+
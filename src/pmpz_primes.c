@@ -0,0 +1,813 @@
+/* pmpz_primes -- enumeration of the primes in a range
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+#include "utils/memutils.h"         /* for TopMemoryContext */
+
+#include <math.h>
+
+
+/*
+ * Table of the small primes.
+ *
+ * The odd primes up to pgmp.trial_division_limit are computed the first time
+ * they are needed in the session. They are grouped in blocks whose product is
+ * about PMPZ_TRIAL_BLOCK_BITS: a single gcd of a candidate with the product
+ * of a block tells if any of its primes is a factor. The first block only
+ * takes the primes whose product fits in an unsigned long, so the most common
+ * factors are found by a division by a single limb.
+ */
+
+/* Size of the product of the primes in a block */
+#define PMPZ_TRIAL_BLOCK_BITS 4096
+
+/* Below this size the candidates are left to the primality test */
+#define PMPZ_TRIAL_MIN_BITS 64
+
+/* The primes tried on a number of n bits are up to n times this factor */
+#define PMPZ_TRIAL_BITS_FACTOR 64
+
+typedef struct
+{
+    uint32          *primes;    /* the odd primes up to the limit */
+    int             nprimes;
+    unsigned long   first;      /* product of primes[0] .. primes[nfirst-1] */
+    int             nfirst;
+    int             nblocks;
+    int             *bstart;    /* the block i is bstart[i] .. bstart[i+1]-1 */
+    mpz_t           *bprod;     /* product of the primes in every block */
+
+} pmpz_trial_table;
+
+static MemoryContext trial_ctx = NULL;
+static pmpz_trial_table *trial_table = NULL;
+
+
+/* Return the table of the small primes, NULL if it is disabled */
+static pmpz_trial_table *
+_trial_table(void)
+{
+    pmpz_trial_table    *t;
+    MemoryContext       oldctx;
+    unsigned long       limit = pgmp_trial_division_limit;
+    unsigned long       i, *v;
+    uint8               *odd;
+    double              bits;
+    int                 j;
+
+    if (trial_table || limit < 3) {
+        return trial_table;
+    }
+
+    if (!trial_ctx) {
+        trial_ctx = AllocSetContextCreate(TopMemoryContext,
+            "pgmp prime table", ALLOCSET_DEFAULT_SIZES);
+    }
+    oldctx = MemoryContextSwitchTo(trial_ctx);
+
+    t = (pmpz_trial_table *)palloc(sizeof(pmpz_trial_table));
+    odd = pmpz_odd_sieve(limit);
+    t->primes = (uint32 *)palloc((limit / 2 + 1) * sizeof(uint32));
+    t->nprimes = 0;
+    for (i = 1; 2 * i + 1 <= limit; i++) {
+        if (!(odd[i / 8] & (1 << (i % 8)))) {
+            t->primes[t->nprimes++] = 2 * i + 1;
+        }
+    }
+    pfree(odd);
+
+    t->first = 1;
+    for (t->nfirst = 0; t->nfirst < t->nprimes
+            && t->first <= ULONG_MAX / t->primes[t->nfirst]; t->nfirst++) {
+        t->first *= t->primes[t->nfirst];
+    }
+
+    /* split the other primes in blocks */
+    t->bstart = (int *)palloc((t->nprimes + 2) * sizeof(int));
+    t->nblocks = 0;
+    t->bstart[0] = t->nfirst;
+    for (j = t->nfirst, bits = 0; j < t->nprimes; j++)
+    {
+        bits += log2(t->primes[j]);
+        if (bits >= PMPZ_TRIAL_BLOCK_BITS || j == t->nprimes - 1) {
+            t->bstart[++t->nblocks] = j + 1;
+            bits = 0;
+        }
+    }
+
+    t->bprod = (mpz_t *)palloc(Max(t->nblocks, 1) * sizeof(mpz_t));
+    v = (unsigned long *)palloc(Max(t->nprimes, 1) * sizeof(unsigned long));
+    for (j = 0; j < t->nprimes; j++) {
+        v[j] = t->primes[j];
+    }
+    for (j = 0; j < t->nblocks; j++) {
+        mpz_init(t->bprod[j]);
+        mpz_prod_ui_intr(t->bprod[j], v + t->bstart[j],
+            t->bstart[j + 1] - t->bstart[j]);
+    }
+    pfree(v);
+
+    MemoryContextSwitchTo(oldctx);
+
+    trial_table = t;
+    return t;
+}
+
+/* Assign hook of pgmp.trial_division_limit: the table will be rebuilt */
+void
+pgmp_trial_assign_limit(int newval, void *extra)
+{
+    if (trial_ctx) {
+        MemoryContextReset(trial_ctx);
+    }
+    trial_table = NULL;
+}
+
+/* Return the limit of the primes worth trying on a number of nbits */
+unsigned long
+pmpz_trial_limit(size_t nbits)
+{
+    return (unsigned long)Min((double)nbits * PMPZ_TRIAL_BITS_FACTOR,
+        (double)pgmp_trial_division_limit);
+}
+
+/*
+ * Return the odd primes up to limit available in the table, setting their
+ * number in n. The array is valid until pgmp.trial_division_limit changes.
+ */
+const uint32 *
+pmpz_small_primes(unsigned long limit, int *n)
+{
+    pmpz_trial_table    *t = _trial_table();
+    int                 lo = 0, hi, mid;
+
+    if (!t) {
+        *n = 0;
+        return NULL;
+    }
+
+    /* the number of primes <= limit */
+    hi = t->nprimes;
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (t->primes[mid] <= limit) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    *n = lo;
+    return t->primes;
+}
+
+/*
+ * Return the smallest prime factor of z up to limit, 0 if there is none.
+ * Only the primes in the table are tried. z must not be 0.
+ */
+unsigned long
+pmpz_small_factor(mpz_srcptr z, unsigned long limit)
+{
+    pmpz_trial_table    *t;
+    unsigned long       g, res = 0;
+    mpz_t               r;
+    int                 i, j;
+
+    if (limit < 2 || mpz_cmpabs_ui(z, 1) <= 0) {
+        return 0;
+    }
+    if (mpz_even_p(z)) {
+        return 2;
+    }
+    if (!(t = _trial_table())) {
+        return 0;
+    }
+
+    if (t->nfirst && (g = mpz_gcd_ui(NULL, z, t->first)) > 1)
+    {
+        for (j = 0; j < t->nfirst; j++) {
+            if (g % t->primes[j] == 0) {
+                return t->primes[j] <= limit ? t->primes[j] : 0;
+            }
+        }
+    }
+
+    mpz_init(r);
+    for (i = 0; i < t->nblocks && t->primes[t->bstart[i]] <= limit; i++)
+    {
+        CHECK_FOR_INTERRUPTS();
+        mpz_gcd(r, z, t->bprod[i]);
+        if (mpz_cmp_ui(r, 1) == 0) {
+            continue;
+        }
+        for (j = t->bstart[i]; j < t->bstart[i + 1]; j++) {
+            if (mpz_divisible_ui_p(r, t->primes[j])) {
+                res = t->primes[j] <= limit ? t->primes[j] : 0;
+                break;
+            }
+        }
+        break;
+    }
+    mpz_clear(r);
+
+    return res;
+}
+
+/*
+ * Baillie-PSW primality test.
+ *
+ * A strong probable prime test to base 2 followed by a strong Lucas test with
+ * the parameters chosen by Selfridge's method A. There is no composite known
+ * passing both and it has been verified that there is none below 2^64; the
+ * cost is about the one of three Miller-Rabin rounds. Numbers up to 64 bits
+ * are tested by Miller-Rabin on native words with a set of bases known to be
+ * deterministic.
+ */
+
+/* Repetitions of GMP's test the BPSW test is considered equivalent to: as
+ * in mpz_probab_prime_p() since GMP 6.2, only the repetitions in excess are
+ * run as further Miller-Rabin rounds */
+#define PMPZ_BPSW_REPS 24
+
+#ifdef __SIZEOF_INT128__
+
+/* Montgomery multiplication modulo the odd n, with ninv = 1/n mod 2^64:
+ * return a b / 2^64 mod n for a, b < n */
+static inline uint64
+_mont_mul(uint64 a, uint64 b, uint64 n, uint64 ninv)
+{
+    unsigned __int128   t = (unsigned __int128)a * b;
+    uint64              m = (uint64)t * ninv;
+    uint64              hi = (uint64)(t >> 64);
+    uint64              mn = (uint64)(((unsigned __int128)m * n) >> 64);
+
+    /* t - m n is a multiple of 2^64 */
+    return hi >= mn ? hi - mn : hi - mn + n;
+}
+
+/* Deterministic Miller-Rabin for n < 2^64, with the bases found by
+ * J. Sinclair, in Montgomery representation */
+static bool
+_u64_prime_p(uint64 n)
+{
+    static const uint32 small[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    static const uint64 bases[] = {
+        2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    uint64      d, x, a, ninv, one, mone;
+    int         s, i, r, bit;
+
+    for (i = 0; i < lengthof(small); i++) {
+        if (n % small[i] == 0) {
+            return n == small[i];
+        }
+    }
+    if (n < 41 * 41) {
+        return n > 1;
+    }
+
+    /* Newton iteration, each step doubling the correct bits */
+    for (ninv = n, i = 0; i < 5; i++) {
+        ninv *= 2 - n * ninv;
+    }
+    one = (0 - n) % n;                      /* 2^64 mod n */
+    mone = n - one;                         /* -1 */
+
+    for (d = n - 1, s = 0; !(d & 1); d >>= 1, s++) ;
+
+    for (i = 0; i < lengthof(bases); i++)
+    {
+        if (!(a = bases[i] % n)) {
+            continue;
+        }
+        a = (uint64)(((unsigned __int128)a << 64) % n);
+        x = a;
+        for (bit = 62 - __builtin_clzll(d); bit >= 0; bit--) {
+            x = _mont_mul(x, x, n, ninv);
+            if ((d >> bit) & 1) {
+                x = _mont_mul(x, a, n, ninv);
+            }
+        }
+        if (x == one || x == mone) {
+            continue;
+        }
+        for (r = 1; r < s; r++) {
+            if ((x = _mont_mul(x, x, n, ninv)) == mone) {
+                break;
+            }
+        }
+        if (r == s) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif  /* __SIZEOF_INT128__ */
+
+/* Since GMP 6.2 mpz_probab_prime_p() runs the same test on the mpn layer */
+#if __GMP_MP_RELEASE < 60200
+
+/* Strong probable prime test of the odd n > 3 to base b */
+static bool
+_strong_prp(mpz_srcptr n, unsigned long b)
+{
+    mpz_t       nm1, d, x;
+    mp_bitcnt_t s, r;
+    bool        rv = true;
+
+    mpz_init(nm1);
+    mpz_init(d);
+    mpz_init_set_ui(x, b);
+
+    mpz_sub_ui(nm1, n, 1);
+    s = mpz_scan1(nm1, 0);
+    mpz_tdiv_q_2exp(d, nm1, s);
+    mpz_powm(x, x, d, n);
+
+    if (mpz_cmp_ui(x, 1) != 0 && mpz_cmp(x, nm1) != 0)
+    {
+        for (r = 1; r < s; r++) {
+            mpz_mul(x, x, x);
+            mpz_mod(x, x, n);
+            if (mpz_cmp(x, nm1) == 0) {
+                break;
+            }
+        }
+        rv = r < s;
+    }
+
+    mpz_clear(nm1);
+    mpz_clear(d);
+    mpz_clear(x);
+    return rv;
+}
+
+/* Halve x modulo the odd n, with 0 <= x < n */
+#define HALF_MOD(x, n) \
+    do { \
+        if (mpz_odd_p(x)) { \
+            mpz_add(x, x, n); \
+        } \
+        mpz_tdiv_q_2exp(x, x, 1); \
+    } while (0)
+
+/* Strong Lucas probable prime test of the odd n > 3, not a perfect square */
+static bool
+_strong_lucas_prp(mpz_srcptr n)
+{
+    mpz_t       u, v, qk, d, t;
+    long        D = 5, Q;
+    mp_bitcnt_t s, r;
+    int         j, bit;
+    bool        rv = false;
+
+    /* Selfridge: the first D in 5, -7, 9, -11... with (D/n) = -1 */
+    while ((j = mpz_si_kronecker(D, n)) != -1)
+    {
+        if (j == 0 && mpz_cmpabs_ui(n, labs(D)) != 0) {
+            return false;
+        }
+        D = D > 0 ? -D - 2 : -D + 2;
+    }
+    Q = (1 - D) / 4;
+
+    /* n + 1 = d 2^s */
+    mpz_init(d);
+    mpz_add_ui(d, n, 1);
+    s = mpz_scan1(d, 0);
+    mpz_tdiv_q_2exp(d, d, s);
+
+    /* U_1 = 1, V_1 = P = 1, then walk the bits of d */
+    mpz_init_set_ui(u, 1);
+    mpz_init_set_ui(v, 1);
+    mpz_init_set_si(qk, Q);
+    mpz_mod(qk, qk, n);
+    mpz_init(t);
+
+    for (bit = mpz_sizeinbase(d, 2) - 2; bit >= 0; bit--)
+    {
+        /* U_2k = U_k V_k, V_2k = V_k^2 - 2 Q^k */
+        mpz_mul(u, u, v);
+        mpz_mod(u, u, n);
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, qk, 2);
+        mpz_mod(v, v, n);
+        mpz_mul(qk, qk, qk);
+        mpz_mod(qk, qk, n);
+
+        if (mpz_tstbit(d, bit))
+        {
+            /* U_k+1 = (P U_k + V_k) / 2, V_k+1 = (D U_k + P V_k) / 2 */
+            mpz_mul_si(t, u, D);
+            mpz_add(u, u, v);
+            mpz_mod(u, u, n);
+            HALF_MOD(u, n);
+            mpz_add(v, v, t);
+            mpz_mod(v, v, n);
+            HALF_MOD(v, n);
+            mpz_mul_si(qk, qk, Q);
+            mpz_mod(qk, qk, n);
+        }
+    }
+
+    if (!SIZ(u) || !SIZ(v)) {
+        rv = true;
+    }
+    else {
+        /* V_d2^r = 0 for some 0 < r < s */
+        for (r = 1; r < s; r++) {
+            mpz_mul(v, v, v);
+            mpz_submul_ui(v, qk, 2);
+            mpz_mod(v, v, n);
+            if (!SIZ(v)) {
+                rv = true;
+                break;
+            }
+            mpz_mul(qk, qk, qk);
+            mpz_mod(qk, qk, n);
+        }
+    }
+
+    mpz_clear(u);
+    mpz_clear(v);
+    mpz_clear(qk);
+    mpz_clear(d);
+    mpz_clear(t);
+    return rv;
+}
+
+#endif  /* __GMP_MP_RELEASE < 60200 */
+
+/*
+ * Return 2 if z is prime, 1 if it is probably prime, 0 if it is composite.
+ *
+ * The result is certain for |z| < 2^64. Larger numbers are tested by BPSW,
+ * followed by reps - PMPZ_BPSW_REPS Miller-Rabin rounds, if positive, to
+ * the fixed bases 3, 5, 7, 11... so that the result is repeatable.
+ */
+int
+mpz_bpsw_prime_p(mpz_srcptr z, int reps)
+{
+    mpz_t           n;
+#if __GMP_MP_RELEASE < 60200
+    unsigned long   b;
+    int             rv;
+#endif
+
+    /* the absolute value, as in mpz_probab_prime_p() */
+    LIMBS(n) = LIMBS(z);
+    SIZ(n) = NLIMBS(z);
+    ALLOC(n) = ALLOC(z);
+
+#ifdef __SIZEOF_INT128__
+    if (mpz_sizeinbase(n, 2) <= 64 && sizeof(unsigned long) >= 8) {
+        return _u64_prime_p(mpz_get_ui(n)) ? 2 : 0;
+    }
+#endif
+
+#if __GMP_MP_RELEASE >= 60200
+    return mpz_probab_prime_p(n, reps);
+#else
+    if (mpz_cmp_ui(n, 3) <= 0) {
+        return mpz_cmp_ui(n, 2) >= 0 ? 2 : 0;
+    }
+    if (mpz_even_p(n)) {
+        return 0;
+    }
+
+    if (!_strong_prp(n, 2) || mpz_perfect_square_p(n)
+            || !_strong_lucas_prp(n)) {
+        return 0;
+    }
+    rv = mpz_sizeinbase(n, 2) <= 64 ? 2 : 1;
+
+    for (b = 3; reps > PMPZ_BPSW_REPS; b += 2)
+    {
+        if (b > 3 && (b % 3 == 0 || (b > 5 && b % 5 == 0)
+                || (b > 7 && b % 7 == 0))) {
+            continue;
+        }
+        if (!_strong_prp(n, b)) {
+            return 0;
+        }
+        reps--;
+    }
+
+    return rv;
+#endif
+}
+
+/*
+ * Same as mpz_bpsw_prime_p(), but rejecting first the numbers with a factor
+ * in the table of the small primes.
+ */
+int
+mpz_probab_prime_p_table(mpz_srcptr z, int reps)
+{
+    size_t      nbits = mpz_sizeinbase(z, 2);
+
+    /* z > limit^2, so a factor found is not z itself */
+    if (nbits >= PMPZ_TRIAL_MIN_BITS
+            && pmpz_small_factor(z, pmpz_trial_limit(nbits))) {
+        return 0;
+    }
+
+    return mpz_bpsw_prime_p(z, reps);
+}
+
+
+/*
+ * Segmented sieve of Eratosthenes on the odd numbers.
+ *
+ * The range is sieved a segment at a time by the odd primes up to sqrt(hi),
+ * each one remembering the position of its next multiple, so the memory used
+ * doesn't depend on the size of the range. If sqrt(hi) is larger than
+ * PMPZ_SIEVE_MAX_BASE the sieve only removes the numbers with a small factor
+ * and the survivors are tested by mpz_bpsw_prime_p().
+ */
+
+/* Number of odd numbers in a segment */
+#define PMPZ_SIEVE_SEGMENT (1 << 18)
+
+/* Largest prime used to sieve: about 300K primes, 3.5MB of state */
+#define PMPZ_SIEVE_MAX_BASE (1 << 22)
+
+/* Repetitions of the probabilistic test of the survivors */
+#define PMPZ_SIEVE_REPS 25
+
+typedef struct
+{
+    mpz_t           segstart;   /* the odd number at the start of a segment */
+    mpz_t           hi;
+    uint32          *base;      /* the odd sieving primes */
+    uint64          *next;      /* index of their next multiple to mark */
+    int             nbase;
+    bool            test;       /* survivors must be tested */
+    bool            two;        /* 2 is in range and not returned yet */
+    uint64          segoff;     /* index of segstart from the first odd */
+    unsigned long   len;        /* number of odd numbers in the segment */
+    unsigned long   pos;        /* next index in the segment to check */
+    uint8           *seg;       /* seg[i] set if segstart + 2i is composite */
+    bool            done;
+    MemoryContext   ctx;        /* where the sieve is allocated */
+
+} pmpz_sieve;
+
+
+/* Sieve the segment starting at segstart */
+static void
+_sieve_segment(pmpz_sieve *s)
+{
+    unsigned long   len = PMPZ_SIEVE_SEGMENT;
+    uint64          i, end;
+    uint32          p;
+    int             j;
+    mpz_t           rem;
+
+    if (mpz_cmp(s->segstart, s->hi) > 0) {
+        s->done = true;
+        return;
+    }
+
+    /* the odd numbers left up to hi */
+    mpz_init(rem);
+    mpz_sub(rem, s->hi, s->segstart);
+    mpz_tdiv_q_2exp(rem, rem, 1);
+    if (mpz_cmp_ui(rem, len) < 0) {
+        len = mpz_get_ui(rem) + 1;
+    }
+    mpz_clear(rem);
+
+    s->len = len;
+    s->pos = 0;
+    memset(s->seg, 0, len);
+
+    end = s->segoff + len;
+    for (j = 0; j < s->nbase; j++)
+    {
+        p = s->base[j];
+        for (i = s->next[j]; i < end; i += p) {
+            s->seg[i - s->segoff] = 1;
+        }
+        s->next[j] = i;
+    }
+}
+
+/* Move to the next segment */
+static void
+_sieve_advance(pmpz_sieve *s)
+{
+    MemoryContext   oldctx;
+
+    CHECK_FOR_INTERRUPTS();
+    oldctx = MemoryContextSwitchTo(s->ctx);
+    mpz_add_ui(s->segstart, s->segstart, 2 * s->len);
+    s->segoff += s->len;
+    _sieve_segment(s);
+    MemoryContextSwitchTo(oldctx);
+}
+
+static void
+_sieve_init(pmpz_sieve *s, mpz_srcptr lo, mpz_srcptr hi)
+{
+    unsigned long   limit, i, p;
+    uint8           *odd;
+    mpz_t           t;
+    uint64          pp, r;
+
+    s->ctx = CurrentMemoryContext;
+    mpz_init_set(s->hi, hi);
+    s->two = mpz_cmp_ui(lo, 2) <= 0 && mpz_cmp_ui(hi, 2) >= 0;
+    s->done = false;
+
+    /* the first odd number >= max(lo, 3) */
+    mpz_init(s->segstart);
+    if (mpz_cmp_ui(lo, 3) < 0) {
+        mpz_set_ui(s->segstart, 3);
+    }
+    else {
+        mpz_add_ui(s->segstart, lo, mpz_even_p(lo) ? 1 : 0);
+    }
+    s->segoff = 0;
+
+    /* the sieving primes */
+    mpz_init(t);
+    if (SIZ(hi) > 0) {
+        mpz_sqrt(t, hi);
+    }
+    if (mpz_cmp_ui(t, PMPZ_SIEVE_MAX_BASE) <= 0) {
+        limit = mpz_get_ui(t);
+        s->test = false;
+    }
+    else {
+        limit = PMPZ_SIEVE_MAX_BASE;
+        s->test = true;
+    }
+
+    odd = pmpz_odd_sieve(limit);
+    s->base = (uint32 *)palloc((limit / 2 + 1) * sizeof(uint32));
+    s->nbase = 0;
+    for (i = 1; 2 * i + 1 <= limit; i++) {
+        if (!(odd[i / 8] & (1 << (i % 8)))) {
+            s->base[s->nbase++] = 2 * i + 1;
+        }
+    }
+    pfree(odd);
+
+    /* the first multiple of every prime to mark, skipping the prime */
+    s->next = (uint64 *)palloc(Max(s->nbase, 1) * sizeof(uint64));
+    for (i = 0; i < s->nbase; i++)
+    {
+        p = s->base[i];
+        pp = (uint64)p * p;
+        if (mpz_cmp_ui(s->segstart, pp) <= 0) {
+            s->next[i] = (pp - mpz_get_ui(s->segstart)) / 2;
+        }
+        else {
+            /* segstart + 2k = 0 mod p: k = -segstart / 2 mod p */
+            r = mpz_fdiv_ui(s->segstart, p);
+            s->next[i] = (p - r) % p * ((p + 1) / 2) % p;
+        }
+    }
+    mpz_clear(t);
+
+    s->seg = (uint8 *)palloc(PMPZ_SIEVE_SEGMENT);
+    _sieve_segment(s);
+}
+
+/* Set z to the next prime in the range; return false at the end */
+static bool
+_sieve_next(pmpz_sieve *s, mpz_ptr z)
+{
+    if (s->two) {
+        s->two = false;
+        mpz_set_ui(z, 2);
+        return true;
+    }
+
+    while (!s->done)
+    {
+        for (; s->pos < s->len; s->pos++)
+        {
+            if (s->seg[s->pos]) {
+                continue;
+            }
+            mpz_add_ui(z, s->segstart, 2 * s->pos);
+            if (!s->test || mpz_bpsw_prime_p(z, PMPZ_SIEVE_REPS)) {
+                s->pos++;
+                return true;
+            }
+        }
+
+        _sieve_advance(s);
+    }
+
+    return false;
+}
+
+/* Return the number of primes left in the range */
+static int64
+_sieve_count(pmpz_sieve *s)
+{
+    int64           count = 0;
+    mpz_t           z;
+
+    if (s->test)
+    {
+        mpz_init(z);
+        while (_sieve_next(s, z)) {
+            count++;
+        }
+        mpz_clear(z);
+        return count;
+    }
+
+    if (s->two) {
+        count++;
+    }
+    while (!s->done)
+    {
+        for (; s->pos < s->len; s->pos++) {
+            count += !s->seg[s->pos];
+        }
+        _sieve_advance(s);
+    }
+
+    return count;
+}
+
+
+PGMP_PG_FUNCTION(pmpz_primes)
+{
+    FuncCallContext *funcctx;
+    MemoryContext   oldctx;
+    pmpz_sieve      *s;
+    mpz_t           zf;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        const mpz_t     lo = {0};
+        const mpz_t     hi = {0};
+
+        PGMP_GETARG_MPZ(lo, 0);
+        PGMP_GETARG_MPZ(hi, 1);
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        s = (pmpz_sieve *)palloc(sizeof(pmpz_sieve));
+        _sieve_init(s, lo, hi);
+        funcctx->user_fctx = s;
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    s = (pmpz_sieve *)funcctx->user_fctx;
+
+    mpz_init(zf);
+    if (!_sieve_next(s, zf)) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(pmpz_from_mpz(zf)));
+}
+
+PGMP_PG_FUNCTION(pmpz_prime_count)
+{
+    const mpz_t     lo = {0};
+    const mpz_t     hi = {0};
+    pmpz_sieve      s;
+    int64           count;
+
+    PGMP_GETARG_MPZ(lo, 0);
+    PGMP_GETARG_MPZ(hi, 1);
+
+    _sieve_init(&s, lo, hi);
+    count = _sieve_count(&s);
+
+    PG_RETURN_INT64(count);
+}
@@ -0,0 +1,267 @@
+/* pmpz_series -- set returning functions generating mpz sequences
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+
+#include <math.h>
+
+
+/*
+ * Every row of a sequence is computed from the previous one with a single
+ * addition or a multiplication by a small number, instead of calling fac()
+ * or bin() from scratch for every row. The state lives in the multi-call
+ * memory context and is updated in place; each row returned is a copy.
+ */
+
+#define LOG2_E 1.4426950408889634
+
+typedef struct
+{
+    mpz_t           cur;
+    mpz_t           prev;       /* F[k-1] for fib_series */
+    mpz_t           stop;       /* only for generate_series */
+    mpz_t           step;       /* only for generate_series */
+    unsigned long   n;
+
+} pmpz_series;
+
+
+/* Initialize a series in the multi-call context and return it */
+static pmpz_series *
+_series_init(FuncCallContext *funcctx, uint64 ncalls)
+{
+    pmpz_series     *s;
+
+    s = (pmpz_series *)palloc(sizeof(pmpz_series));
+    mpz_init(s->cur);
+    mpz_init(s->prev);
+    mpz_init(s->stop);
+    mpz_init(s->step);
+    s->n = 0;
+
+    funcctx->user_fctx = s;
+    funcctx->max_calls = ncalls;
+    return s;
+}
+
+
+/*
+ * binomial_row(n): bin(n, k) for k from 0 to n.
+ *
+ *      bin(n, k+1) = bin(n, k) * (n-k) / (k+1)
+ */
+PGMP_PG_FUNCTION(pmpz_binomial_row)
+{
+    FuncCallContext *funcctx;
+    MemoryContext   oldctx;
+    pmpz_series     *s;
+    unsigned long   n, k;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        PGMP_GETARG_ULONG(n, 0);
+        /* the central coefficient has about n bits */
+        pgmp_check_result_bits(n);
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        s = _series_init(funcctx, (uint64)n + 1);
+        s->n = n;
+        mpz_set_ui(s->cur, 1);
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    s = (pmpz_series *)funcctx->user_fctx;
+
+    if (funcctx->call_cntr >= funcctx->max_calls) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    if (funcctx->call_cntr > 0)
+    {
+        k = funcctx->call_cntr - 1;
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        mpz_mul_ui(s->cur, s->cur, s->n - k);
+        mpz_divexact_ui(s->cur, s->cur, k + 1);
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(pmpz_copy_mpz(s->cur)));
+}
+
+
+/*
+ * fib_series(a, b): F[k] for k from a to b.
+ */
+PGMP_PG_FUNCTION(pmpz_fib_series)
+{
+    FuncCallContext *funcctx;
+    MemoryContext   oldctx;
+    pmpz_series     *s;
+    unsigned long   a, b;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        PGMP_GETARG_ULONG(a, 0);
+        PGMP_GETARG_ULONG(b, 1);
+        if (b >= a) {
+            pgmp_check_result_bits(PMPZ_FIB_BITS(b));
+        }
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        s = _series_init(funcctx, b >= a ? (uint64)(b - a) + 1 : 0);
+        if (b >= a) {
+            mpz_fib2_ui_cached(s->cur, s->prev, a);
+        }
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    s = (pmpz_series *)funcctx->user_fctx;
+
+    if (funcctx->call_cntr >= funcctx->max_calls) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    if (funcctx->call_cntr > 0)
+    {
+        /* F[k+1] = F[k] + F[k-1] */
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        mpz_add(s->prev, s->prev, s->cur);
+        mpz_swap(s->cur, s->prev);
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(pmpz_copy_mpz(s->cur)));
+}
+
+
+/*
+ * fac_series(a, b): k! for k from a to b.
+ */
+PGMP_PG_FUNCTION(pmpz_fac_series)
+{
+    FuncCallContext *funcctx;
+    MemoryContext   oldctx;
+    pmpz_series     *s;
+    unsigned long   a, b;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        PGMP_GETARG_ULONG(a, 0);
+        PGMP_GETARG_ULONG(b, 1);
+        if (b >= a) {
+            pgmp_check_result_bits(lgamma(b + 1.0) * LOG2_E);
+        }
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        s = _series_init(funcctx, b >= a ? (uint64)(b - a) + 1 : 0);
+        s->n = a;
+        if (b >= a) {
+            mpz_fac_ui_cached(s->cur, a);
+        }
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    s = (pmpz_series *)funcctx->user_fctx;
+
+    if (funcctx->call_cntr >= funcctx->max_calls) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    if (funcctx->call_cntr > 0)
+    {
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        mpz_mul_ui(s->cur, s->cur, s->n + funcctx->call_cntr);
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(pmpz_copy_mpz(s->cur)));
+}
+
+
+/*
+ * generate_series(start, stop [, step]): the numbers from start to stop
+ * included, with the given step (1 if omitted).
+ */
+PGMP_PG_FUNCTION(pmpz_generate_series)
+{
+    FuncCallContext *funcctx;
+    MemoryContext   oldctx;
+    pmpz_series     *s;
+    Datum           res;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        const mpz_t     start = {0};
+        const mpz_t     stop = {0};
+        const mpz_t     step = {0};
+
+        PGMP_GETARG_MPZ(start, 0);
+        PGMP_GETARG_MPZ(stop, 1);
+        if (PG_NARGS() > 2) {
+            PGMP_GETARG_MPZ(step, 2);
+            if (UNLIKELY(SIZ(step) == 0)) {
+                ereport(ERROR, (
+                    errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("step size cannot equal zero")));
+            }
+        }
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        s = _series_init(funcctx, 0);
+        mpz_set(s->cur, start);
+        mpz_set(s->stop, stop);
+        if (PG_NARGS() > 2) {
+            mpz_set(s->step, step);
+        }
+        else {
+            mpz_set_ui(s->step, 1);
+        }
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    s = (pmpz_series *)funcctx->user_fctx;
+
+    if (SIZ(s->step) > 0
+            ? mpz_cmp(s->cur, s->stop) > 0
+            : mpz_cmp(s->cur, s->stop) < 0) {
+        SRF_RETURN_DONE(funcctx);
+    }
+
+    res = PointerGetDatum(pmpz_copy_mpz(s->cur));
+
+    oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    mpz_add(s->cur, s->cur, s->step);
+    MemoryContextSwitchTo(oldctx);
+
+    SRF_RETURN_NEXT(funcctx, res);
+}
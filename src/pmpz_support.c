@@ -0,0 +1,460 @@
+/* pmpz_support -- planner support for the mpz functions
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "nodes/primnodes.h"
+#if PG_VERSION_NUM >= 120000
+#include "nodes/supportnodes.h"
+#include "optimizer/optimizer.h"    /* for cpu_operator_cost */
+#endif
+
+#include <math.h>
+
+
+/*
+ * The planner only knows the COST declared for a function, the same for
+ * fac(10) and fac(1000000). The support function estimates the cost of the
+ * most expensive functions from the size of their constant arguments, and
+ * removes the operations with no effect, such as z + 0 or z ^ 1. For the set
+ * returning functions it estimates the number of rows.
+ *
+ * The functions are recognised by the address of their C implementation.
+ */
+
+Datum pmpz_add(PG_FUNCTION_ARGS);
+Datum pmpz_sub(PG_FUNCTION_ARGS);
+Datum pmpz_mul(PG_FUNCTION_ARGS);
+Datum pmpz_tdiv_q(PG_FUNCTION_ARGS);
+Datum pmpz_cdiv_q(PG_FUNCTION_ARGS);
+Datum pmpz_fdiv_q(PG_FUNCTION_ARGS);
+Datum pmpz_divexact(PG_FUNCTION_ARGS);
+Datum pmpz_mul_2exp(PG_FUNCTION_ARGS);
+Datum pmpz_tdiv_q_2exp(PG_FUNCTION_ARGS);
+Datum pmpz_cdiv_q_2exp(PG_FUNCTION_ARGS);
+Datum pmpz_fdiv_q_2exp(PG_FUNCTION_ARGS);
+Datum pmpz_pow_ui(PG_FUNCTION_ARGS);
+Datum pmpz_powm(PG_FUNCTION_ARGS);
+Datum pmpz_bin_ui(PG_FUNCTION_ARGS);
+Datum pmpz_fac_ui(PG_FUNCTION_ARGS);
+Datum pmpz_fib_ui(PG_FUNCTION_ARGS);
+Datum pmpz_lucnum_ui(PG_FUNCTION_ARGS);
+Datum pmpz_probab_prime_p(PG_FUNCTION_ARGS);
+Datum pmpz_nextprime(PG_FUNCTION_ARGS);
+Datum pmpz_binomial_row(PG_FUNCTION_ARGS);
+Datum pmpz_fib_series(PG_FUNCTION_ARGS);
+Datum pmpz_fac_series(PG_FUNCTION_ARGS);
+Datum pmpz_generate_series(PG_FUNCTION_ARGS);
+Datum pmpz_primes(PG_FUNCTION_ARGS);
+
+/* Sizes assumed for the arguments not known at plan time */
+#define PMPZ_COST_DEFAULT_BITS 256
+#define PMPZ_COST_DEFAULT_ULONG 1000
+
+
+#if PG_VERSION_NUM >= 120000
+
+static PGFunction
+_support_func_addr(Oid funcid)
+{
+    FmgrInfo    flinfo;
+
+    fmgr_info(funcid, &flinfo);
+    return flinfo.fn_addr;
+}
+
+/* Return the n-th argument if it is a non-null constant, else NULL */
+static Const *
+_support_const_arg(List *args, int n)
+{
+    Node        *arg;
+
+    if (list_length(args) <= n) {
+        return NULL;
+    }
+
+    arg = (Node *)list_nth(args, n);
+    if (!IsA(arg, Const) || ((Const *)arg)->constisnull) {
+        return NULL;
+    }
+    return (Const *)arg;
+}
+
+/* Return the number of bits of an mpz argument */
+static double
+_support_arg_bits(List *args, int n)
+{
+    Const       *c;
+    const mpz_t z = {0};
+
+    if (!(c = _support_const_arg(args, n))) {
+        return PMPZ_COST_DEFAULT_BITS;
+    }
+    mpz_from_datum(z, c->constvalue);
+    return mpz_sizeinbase(z, 2);
+}
+
+/* Return the value of an integer argument */
+static double
+_support_arg_int(List *args, int n)
+{
+    Const       *c;
+    int64       v;
+
+    if (!(c = _support_const_arg(args, n))) {
+        return PMPZ_COST_DEFAULT_ULONG;
+    }
+    switch (c->consttype)
+    {
+        case INT8OID:
+            v = DatumGetInt64(c->constvalue);
+            break;
+        case INT4OID:
+            v = DatumGetInt32(c->constvalue);
+            break;
+        default:
+            return PMPZ_COST_DEFAULT_ULONG;
+    }
+    return Max(v, 0);
+}
+
+/* Return true if the argument is a constant mpz equal to v */
+static bool
+_support_arg_is(List *args, int n, long v)
+{
+    Const       *c;
+    const mpz_t z = {0};
+
+    if (!(c = _support_const_arg(args, n))) {
+        return false;
+    }
+    mpz_from_datum(z, c->constvalue);
+    return mpz_cmp_si(z, v) == 0;
+}
+
+/* Return true if the argument is a constant integer equal to v */
+static bool
+_support_arg_int_is(List *args, int n, int64 v)
+{
+    return _support_const_arg(args, n) && _support_arg_int(args, n) == v;
+}
+
+
+/*
+ * Cost model.
+ *
+ * The costs are expressed in multiples of cpu_operator_cost, which is about
+ * the cost of a call on small numbers. Multiplying one limb takes a fraction
+ * of it; larger numbers grow as in Toom-Cook up to the FFT range, then about
+ * linearly.
+ */
+
+#define PMPZ_COST_FFT_LIMBS 2000.0
+
+static double
+_cost_mul(double bits)
+{
+    double      limbs = ceil(bits / GMP_NUMB_BITS);
+
+    if (limbs <= PMPZ_COST_FFT_LIMBS) {
+        return 0.1 * pow(limbs, 1.585);
+    }
+    return 0.1 * pow(PMPZ_COST_FFT_LIMBS, 1.585)
+        * (limbs / PMPZ_COST_FFT_LIMBS)
+        * (log2(limbs) / log2(PMPZ_COST_FFT_LIMBS));
+}
+
+/* An exponentiation with a modulus: a squaring and a reduction per bit */
+static double
+_cost_powm(double ebits, double mbits)
+{
+    return 3.0 * ebits * _cost_mul(mbits);
+}
+
+/* Return the cost of a call, or -1 if the function is not known */
+static double
+_support_cost(PGFunction fn, List *args)
+{
+    double      bits, n, r;
+
+    if (fn == pmpz_powm) {
+        return 1.0 + _cost_powm(
+            _support_arg_bits(args, 1), _support_arg_bits(args, 2));
+    }
+    if (fn == pmpz_probab_prime_p) {
+        /* most numbers are composite and rejected by the first test */
+        bits = _support_arg_bits(args, 0);
+        return 1.0 + _cost_powm(bits, bits);
+    }
+    if (fn == pmpz_nextprime) {
+        /* the candidates not sieved are about one in bits/16, and the
+         * prime found is fully tested */
+        bits = _support_arg_bits(args, 0);
+        return 1.0 + (bits / 16.0 + 3.0) * _cost_powm(bits, bits);
+    }
+    if (fn == pmpz_fac_ui) {
+        /* the result has about n log2(n) bits */
+        n = _support_arg_int(args, 0);
+        r = n * log2(n + 1.0);
+        return 1.0 + 4.0 * _cost_mul(r);
+    }
+    if (fn == pmpz_fib_ui || fn == pmpz_lucnum_ui) {
+        /* the result has about 0.69 n bits */
+        r = 0.6942 * _support_arg_int(args, 0);
+        return 1.0 + 2.0 * _cost_mul(r);
+    }
+    if (fn == pmpz_pow_ui) {
+        n = _support_arg_int(args, 1);
+        r = n * _support_arg_bits(args, 0);
+        return 1.0 + 2.0 * _cost_mul(r);
+    }
+    if (fn == pmpz_bin_ui) {
+        n = _support_arg_int(args, 1);
+        r = n * _support_arg_bits(args, 0);
+        return 1.0 + 2.0 * _cost_mul(r);
+    }
+
+    return -1;
+}
+
+
+/* Return the number of rows returned by a call, or -1 if not known */
+static double
+_support_rows(PGFunction fn, List *args)
+{
+    Const       *c;
+    const mpz_t start = {0};
+    const mpz_t stop = {0};
+    const mpz_t step = {0};
+    mpz_t       n;
+    double      rows;
+
+    if (fn == pmpz_binomial_row)
+    {
+        if (!_support_const_arg(args, 0)) {
+            return -1;
+        }
+        return _support_arg_int(args, 0) + 1;
+    }
+    if (fn == pmpz_fib_series || fn == pmpz_fac_series)
+    {
+        if (!_support_const_arg(args, 0) || !_support_const_arg(args, 1)) {
+            return -1;
+        }
+        return Max(_support_arg_int(args, 1) - _support_arg_int(args, 0) + 1,
+            0);
+    }
+    if (fn == pmpz_generate_series)
+    {
+        if (!(c = _support_const_arg(args, 0))) {
+            return -1;
+        }
+        mpz_from_datum(start, c->constvalue);
+        if (!(c = _support_const_arg(args, 1))) {
+            return -1;
+        }
+        mpz_from_datum(stop, c->constvalue);
+        if (list_length(args) > 2)
+        {
+            if (!(c = _support_const_arg(args, 2))) {
+                return -1;
+            }
+            mpz_from_datum(step, c->constvalue);
+            if (SIZ(step) == 0) {
+                return -1;
+            }
+        }
+
+        /* (stop - start) / step + 1, if not negative */
+        mpz_init(n);
+        mpz_sub(n, stop, start);
+        if (list_length(args) > 2) {
+            mpz_fdiv_q(n, n, step);
+        }
+        rows = SIZ(n) < 0 ? 0 : mpz_get_d(n) + 1;
+        mpz_clear(n);
+        return rows;
+    }
+    if (fn == pmpz_primes)
+    {
+        if (!(c = _support_const_arg(args, 0))) {
+            return -1;
+        }
+        mpz_from_datum(start, c->constvalue);
+        if (!(c = _support_const_arg(args, 1))) {
+            return -1;
+        }
+        mpz_from_datum(stop, c->constvalue);
+
+        /* the density of the primes around x is 1 / log(x) */
+        if (mpz_cmp(stop, start) < 0 || mpz_cmp_ui(stop, 2) < 0) {
+            return 0;
+        }
+        mpz_init(n);
+        mpz_sub(n, stop, start);
+        rows = (mpz_get_d(n) + 1) / Max(log(mpz_get_d(stop)), 1.0);
+        mpz_clear(n);
+        return Max(rows, 1);
+    }
+
+    return -1;
+}
+
+
+/* Return an expression equivalent to the call, or NULL if not simplified */
+static Node *
+_support_simplify(PGFunction fn, List *args)
+{
+    if (list_length(args) != 2) {
+        return NULL;
+    }
+
+    if (fn == pmpz_add)
+    {
+        if (_support_arg_is(args, 1, 0)) {
+            return (Node *)linitial(args);
+        }
+        if (_support_arg_is(args, 0, 0)) {
+            return (Node *)lsecond(args);
+        }
+    }
+    else if (fn == pmpz_mul)
+    {
+        if (_support_arg_is(args, 1, 1)) {
+            return (Node *)linitial(args);
+        }
+        if (_support_arg_is(args, 0, 1)) {
+            return (Node *)lsecond(args);
+        }
+    }
+    else if (fn == pmpz_sub)
+    {
+        if (_support_arg_is(args, 1, 0)) {
+            return (Node *)linitial(args);
+        }
+    }
+    else if (fn == pmpz_tdiv_q || fn == pmpz_cdiv_q
+        || fn == pmpz_fdiv_q || fn == pmpz_divexact)
+    {
+        if (_support_arg_is(args, 1, 1)) {
+            return (Node *)linitial(args);
+        }
+    }
+    else if (fn == pmpz_pow_ui)
+    {
+        if (_support_arg_int_is(args, 1, 1)) {
+            return (Node *)linitial(args);
+        }
+    }
+    else if (fn == pmpz_mul_2exp || fn == pmpz_tdiv_q_2exp
+        || fn == pmpz_cdiv_q_2exp || fn == pmpz_fdiv_q_2exp)
+    {
+        if (_support_arg_int_is(args, 1, 0)) {
+            return (Node *)linitial(args);
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Handle the cost, rows and simplification support requests.
+ *
+ * Return the result of the support function, or NULL if the request is not
+ * handled.
+ */
+Node *
+pmpz_support_plan(Node *rawreq)
+{
+    if (IsA(rawreq, SupportRequestSimplify))
+    {
+        SupportRequestSimplify *req = (SupportRequestSimplify *)rawreq;
+
+        return _support_simplify(
+            _support_func_addr(req->fcall->funcid), req->fcall->args);
+    }
+
+    if (IsA(rawreq, SupportRequestCost))
+    {
+        SupportRequestCost *req = (SupportRequestCost *)rawreq;
+        List        *args = NIL;
+        double      cost;
+
+        if (req->node && IsA(req->node, FuncExpr)) {
+            args = ((FuncExpr *)req->node)->args;
+        }
+        else if (req->node && IsA(req->node, OpExpr)) {
+            args = ((OpExpr *)req->node)->args;
+        }
+
+        cost = _support_cost(_support_func_addr(req->funcid), args);
+        if (cost < 0) {
+            return NULL;
+        }
+        req->startup = 0;
+        req->per_tuple = cost * cpu_operator_cost;
+        return (Node *)req;
+    }
+
+    if (IsA(rawreq, SupportRequestRows))
+    {
+        SupportRequestRows *req = (SupportRequestRows *)rawreq;
+        double      rows;
+
+        if (!req->node || !IsA(req->node, FuncExpr)) {
+            return NULL;
+        }
+
+        rows = _support_rows(_support_func_addr(req->funcid),
+            ((FuncExpr *)req->node)->args);
+        if (rows < 0) {
+            return NULL;
+        }
+        req->rows = rows;
+        return (Node *)req;
+    }
+
+    return NULL;
+}
+
+#else
+
+/* Planner support functions are only available from PostgreSQL 12 */
+Node *
+pmpz_support_plan(Node *rawreq)
+{
+    return NULL;
+}
+
+#endif
+
+
+/*
+ * Planner support function for the mpz functions not working in place.
+ */
+PGMP_PG_FUNCTION(pmpz_plan_support)
+{
+    PG_RETURN_POINTER(pmpz_support_plan((Node *)PG_GETARG_POINTER(0)));
+}
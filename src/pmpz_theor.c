@@ -37,7 +37,7 @@ PGMP_PG_FUNCTION(pmpz_probab_prime_p)
     PGMP_GETARG_MPZ(z1, 0);
     reps = PG_GETARG_INT32(1);
 
-    PG_RETURN_INT32(mpz_probab_prime_p(z1, reps));
+    PG_RETURN_INT32(mpz_probab_prime_p_table(z1, reps));
 }
 
 PGMP_PG_FUNCTION(pmpz_nextprime)
@@ -56,7 +56,7 @@ PGMP_PG_FUNCTION(pmpz_nextprime)
     else
 #endif
     {
-        mpz_nextprime(zf, z1);
+        mpz_nextprime_intr(zf, z1);
     }
 
     PGMP_RETURN_MPZ(zf);
@@ -133,7 +133,7 @@ PGMP_PG_FUNCTION(pmpz_ ## f) \
     CHECK(op);    \
  \
     mpz_init(ret); \
-    mpz_ ## f (ret, op); \
+    mpz_ ## f ## _cached (ret, op); \
  \
     PGMP_RETURN_MPZ(ret); \
 }
@@ -155,7 +155,7 @@ PGMP_PG_FUNCTION(pmpz_ ## f) \
  \
     mpz_init(ret1); \
     mpz_init(ret2); \
-    mpz_ ## f (ret1, ret2, op); \
+    mpz_ ## f ## _cached (ret1, ret2, op); \
  \
     PGMP_RETURN_MPZ_MPZ(ret1, ret2); \
 }
@@ -0,0 +1,490 @@
+/* pmpz_tree -- functions based on product and remainder trees
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"              /* for CHECK_FOR_INTERRUPTS */
+#include "utils/array.h"
+
+
+/*
+ * Product tree of n values.
+ *
+ * The level 0 is made of the values themselves (not owned by the tree), every
+ * node of the level k is the product of two nodes of the level k-1 (or a copy
+ * of the last one if the level has an odd number of nodes). The top level has
+ * a single node, the product of all the values.
+ *
+ * Operating on the tree, the multiplications are balanced and are performed
+ * by GMP on numbers of the same size, where its asymptotically fast
+ * algorithms pay off.
+ */
+
+/* Enough levels for any number of elements in an array */
+#define PMPZ_TREE_MAX_LEVELS 32
+
+typedef struct
+{
+    int             nlevels;
+    int             size[PMPZ_TREE_MAX_LEVELS];
+    mpz_t           *level[PMPZ_TREE_MAX_LEVELS];
+
+} pmpz_tree;
+
+
+/* Build the product tree of the n > 0 values zs */
+static void
+_tree_build(pmpz_tree *t, mpz_t *zs, int n)
+{
+    int             k, j, m;
+
+    t->nlevels = 1;
+    t->size[0] = n;
+    t->level[0] = zs;
+
+    for (k = 1; t->size[k - 1] > 1; k++)
+    {
+        m = t->size[k - 1];
+        t->size[k] = (m + 1) / 2;
+        t->level[k] = (mpz_t *)palloc(t->size[k] * sizeof(mpz_t));
+        for (j = 0; j < m / 2; j++) {
+            CHECK_FOR_INTERRUPTS();
+            mpz_init(t->level[k][j]);
+            mpz_mul(t->level[k][j],
+                t->level[k - 1][2 * j], t->level[k - 1][2 * j + 1]);
+        }
+        if (m % 2) {
+            mpz_init_set(t->level[k][j], t->level[k - 1][2 * j]);
+        }
+        t->nlevels++;
+    }
+}
+
+/*
+ * Compute the sum of vs[i] * P / zs[i] for every value zs[i] of the tree, P
+ * being the product of all of them.
+ *
+ * The sums are combined going up the tree: the sum of a node is the sum of
+ * each child multiplied by the product of the other child. vs is overwritten.
+ */
+static void
+_tree_cofactor_sum(pmpz_tree *t, mpz_t *vs, mpz_ptr res)
+{
+    int             k, j, m;
+
+    for (k = 0; k < t->nlevels - 1; k++)
+    {
+        m = t->size[k];
+        for (j = 0; j < m / 2; j++) {
+            CHECK_FOR_INTERRUPTS();
+            mpz_mul(vs[2 * j], vs[2 * j], t->level[k][2 * j + 1]);
+            mpz_addmul(vs[2 * j], vs[2 * j + 1], t->level[k][2 * j]);
+            mpz_swap(vs[j], vs[2 * j]);
+        }
+        if (m % 2) {
+            mpz_swap(vs[j], vs[2 * j]);
+        }
+    }
+
+    mpz_set(res, vs[0]);
+}
+
+/* Release the levels of the tree owned by it */
+static void
+_tree_free(pmpz_tree *t)
+{
+    int             k, j;
+
+    for (k = 1; k < t->nlevels; k++) {
+        for (j = 0; j < t->size[k]; j++) {
+            mpz_clear(t->level[k][j]);
+        }
+        pfree(t->level[k]);
+    }
+}
+
+/*
+ * Compute the remainders of the product of the tree modulo the square of
+ * every value, pushing the remainder of each node down to its children.
+ *
+ * rems must have room for the level 0 values. The remainders of the upper
+ * levels are freed as soon as the ones of the level below are computed.
+ */
+static void
+_tree_square_rems(pmpz_tree *t, mpz_t *rems)
+{
+    mpz_t           *prev, *cur;
+    mpz_t           sq;
+    int             k, j;
+
+    /* the root modulo its square is the root itself */
+    k = t->nlevels - 1;
+    if (k == 0) {
+        mpz_init_set(rems[0], t->level[0][0]);
+        return;
+    }
+    prev = (mpz_t *)palloc(sizeof(mpz_t));
+    mpz_init_set(prev[0], t->level[k][0]);
+
+    mpz_init(sq);
+    for (k--; k >= 0; k--)
+    {
+        cur = k ? (mpz_t *)palloc(t->size[k] * sizeof(mpz_t)) : rems;
+        for (j = 0; j < t->size[k]; j++) {
+            CHECK_FOR_INTERRUPTS();
+            mpz_mul(sq, t->level[k][j], t->level[k][j]);
+            mpz_init(cur[j]);
+            mpz_tdiv_r(cur[j], prev[j / 2], sq);
+        }
+
+        for (j = 0; j < t->size[k + 1]; j++) {
+            mpz_clear(prev[j]);
+        }
+        pfree(prev);
+        prev = cur;
+    }
+
+    mpz_clear(sq);
+}
+
+
+/*
+ * batch_gcd(mpz[]): for each element, its gcd with the product of all the
+ * other elements.
+ *
+ * Bernstein's algorithm: with P the product of all the values, the gcd of z
+ * with P / z is the gcd of z with (P mod z^2) / z. The remainders are
+ * computed by descending the product tree, so the whole computation takes
+ * a few multiplications of the size of P instead of n^2 gcd.
+ *
+ * The null elements are ignored and return null.
+ */
+PGMP_PG_FUNCTION(pmpz_batch_gcd)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    mpz_t           *zs, *vs, *rems, *zf;
+    bool            *nulls;
+    int             *idx;
+    int             n, nv = 0, nzeros = 0, i;
+    pmpz_tree       tree;
+
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+
+    /* the absolute values of the non-null, non-zero elements */
+    vs = (mpz_t *)palloc((n + 1) * sizeof(mpz_t));
+    idx = (int *)palloc((n + 1) * sizeof(int));
+    for (i = 0; i < n; i++)
+    {
+        if (nulls[i]) {
+            continue;
+        }
+        if (MPZ_IS_ZERO(zs[i])) {
+            nzeros++;
+            continue;
+        }
+        *(vs[nv]) = *(zs[i]);
+        SIZ(vs[nv]) = NLIMBS(zs[i]);
+        idx[nv++] = i;
+    }
+
+    /* gcd(0, P) = P: 0 if there is another zero, 1 if there is nothing else */
+    zf = (mpz_t *)palloc((n + 1) * sizeof(mpz_t));
+    for (i = 0; i < n; i++) {
+        if (!nulls[i] && MPZ_IS_ZERO(zs[i])) {
+            mpz_init_set_ui(zf[i], nzeros == 1 && !nv);
+        }
+    }
+
+    if (nv && nzeros)
+    {
+        /* gcd(z, 0) = |z| */
+        for (i = 0; i < nv; i++) {
+            mpz_init_set(zf[idx[i]], vs[i]);
+        }
+        if (nzeros == 1)
+        {
+            _tree_build(&tree, vs, nv);
+            for (i = 0; i < n; i++) {
+                if (!nulls[i] && MPZ_IS_ZERO(zs[i])) {
+                    mpz_set(zf[i], tree.level[tree.nlevels - 1][0]);
+                }
+            }
+            _tree_free(&tree);
+        }
+    }
+    else if (nv)
+    {
+        rems = (mpz_t *)palloc(nv * sizeof(mpz_t));
+        _tree_build(&tree, vs, nv);
+        _tree_square_rems(&tree, rems);
+        _tree_free(&tree);
+
+        for (i = 0; i < nv; i++) {
+            mpz_divexact(rems[i], rems[i], vs[i]);
+            mpz_init(zf[idx[i]]);
+            mpz_gcd(zf[idx[i]], rems[i], vs[i]);
+            mpz_clear(rems[i]);
+        }
+    }
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, ARR_ELEMTYPE(a),
+        zf, nulls, n, ARR_NDIM(a), ARR_DIMS(a), ARR_LBOUND(a)));
+}
+
+
+/*
+ * crt(residue, modulus) aggregate: the number x in [0, M) such that
+ * x = residue mod modulus for every row, M being the product of the moduli.
+ *
+ * The pairs are only collected in the transition state; the reconstruction
+ * happens at the end with the product tree of the moduli:
+ *
+ *      x = sum(c[i] * M / m[i]) mod M,  c[i] = r[i] / (M / m[i]) mod m[i]
+ *
+ * where M / m[i] mod m[i] is obtained from the remainders of M modulo m[i]^2.
+ * Merging two states is only a concatenation, so the aggregate can be
+ * computed in parallel.
+ */
+
+typedef struct
+{
+    int             n;
+    int             size;
+    mpz_t           *r;         /* residues, reduced modulo m */
+    mpz_t           *m;         /* moduli, positive */
+
+} pmpz_crt_state;
+
+
+/* Create an empty state in the current memory context */
+static pmpz_crt_state *
+_crt_state_new(int size)
+{
+    pmpz_crt_state  *s;
+
+    s = (pmpz_crt_state *)palloc(sizeof(pmpz_crt_state));
+    s->n = 0;
+    s->size = Max(size, 8);
+    s->r = (mpz_t *)palloc(s->size * sizeof(mpz_t));
+    s->m = (mpz_t *)palloc(s->size * sizeof(mpz_t));
+    return s;
+}
+
+/* Add a pair to the state, in the current memory context */
+static void
+_crt_state_add(pmpz_crt_state *s, mpz_srcptr r, mpz_srcptr m)
+{
+    if (s->n >= s->size) {
+        s->size *= 2;
+        s->r = (mpz_t *)repalloc(s->r, s->size * sizeof(mpz_t));
+        s->m = (mpz_t *)repalloc(s->m, s->size * sizeof(mpz_t));
+    }
+
+    mpz_init(s->r[s->n]);
+    mpz_fdiv_r(s->r[s->n], r, m);
+    mpz_init_set(s->m[s->n], m);
+    s->n++;
+}
+
+static MemoryContext
+_crt_agg_context(FunctionCallInfo fcinfo, const char *fname)
+{
+    MemoryContext   aggctx;
+
+    if (UNLIKELY(!AggCheckCallContext(fcinfo, &aggctx)))
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_DATA_EXCEPTION),
+            errmsg("%s can only be called in aggregation", fname)));
+    }
+
+    return aggctx;
+}
+
+
+PGMP_PG_FUNCTION(_pmpz_agg_crt)
+{
+    pmpz_crt_state  *s;
+    const mpz_t     r = {0};
+    const mpz_t     m = {0};
+    MemoryContext   oldctx;
+    MemoryContext   aggctx;
+
+    aggctx = _crt_agg_context(fcinfo, "_mpz_agg_crt");
+
+    s = PG_ARGISNULL(0) ? NULL : (pmpz_crt_state *)PG_GETARG_POINTER(0);
+    if (PG_ARGISNULL(1) || PG_ARGISNULL(2)) {
+        if (!s) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(s);
+    }
+
+    PGMP_GETARG_MPZ(r, 1);
+    PGMP_GETARG_MPZ(m, 2);
+    if (UNLIKELY(SIZ(m) <= 0)) {
+        ereport(ERROR, (
+            errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("crt modulus must be positive")));
+    }
+
+    oldctx = MemoryContextSwitchTo(aggctx);
+    if (!s) {
+        s = _crt_state_new(0);
+    }
+    _crt_state_add(s, r, m);
+    MemoryContextSwitchTo(oldctx);
+
+    PG_RETURN_POINTER(s);
+}
+
+PGMP_PG_FUNCTION(_pmpz_agg_crt_combine)
+{
+    pmpz_crt_state  *s1, *s2;
+    MemoryContext   oldctx;
+    MemoryContext   aggctx;
+    int             i;
+
+    aggctx = _crt_agg_context(fcinfo, "_mpz_agg_crt_combine");
+
+    s1 = PG_ARGISNULL(0) ? NULL : (pmpz_crt_state *)PG_GETARG_POINTER(0);
+    s2 = PG_ARGISNULL(1) ? NULL : (pmpz_crt_state *)PG_GETARG_POINTER(1);
+    if (!s2) {
+        if (!s1) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(s1);
+    }
+
+    oldctx = MemoryContextSwitchTo(aggctx);
+    if (!s1) {
+        s1 = _crt_state_new(s2->n);
+    }
+    for (i = 0; i < s2->n; i++) {
+        _crt_state_add(s1, s2->r[i], s2->m[i]);
+    }
+    MemoryContextSwitchTo(oldctx);
+
+    PG_RETURN_POINTER(s1);
+}
+
+/*
+ * The state is serialized as the number of pairs followed by the pmpz
+ * representation of every residue and modulus. The first pmpz starts at a
+ * maxaligned offset and the pmpz sizes keep the limbs aligned, so the values
+ * can be read in place from a copy of the bytea (the datum received may be
+ * less aligned than the allocated copy).
+ */
+#define PMPZ_CRT_DATA_OFFSET MAXALIGN(VARHDRSZ + sizeof(int32))
+
+PGMP_PG_FUNCTION(_pmpz_agg_crt_serialize)
+{
+    pmpz_crt_state  *s = (pmpz_crt_state *)PG_GETARG_POINTER(0);
+    Size            nbytes = PMPZ_CRT_DATA_OFFSET;
+    bytea           *res;
+    char            *p;
+    int             i;
+
+    for (i = 0; i < s->n; i++) {
+        nbytes += PMPZ_SIZE(s->r[i]) + PMPZ_SIZE(s->m[i]);
+    }
+
+    res = (bytea *)palloc(nbytes);
+    SET_VARSIZE(res, nbytes);
+    *(int32 *)VARDATA(res) = s->n;
+    p = (char *)res + PMPZ_CRT_DATA_OFFSET;
+    for (i = 0; i < s->n; i++) {
+        pmpz_write_mpz((pmpz *)p, s->r[i]);
+        p += PMPZ_SIZE(s->r[i]);
+        pmpz_write_mpz((pmpz *)p, s->m[i]);
+        p += PMPZ_SIZE(s->m[i]);
+    }
+
+    PG_RETURN_BYTEA_P(res);
+}
+
+PGMP_PG_FUNCTION(_pmpz_agg_crt_deserialize)
+{
+    bytea           *b = PG_GETARG_BYTEA_P_COPY(0);
+    pmpz_crt_state  *s;
+    const mpz_t     r = {0};
+    const mpz_t     m = {0};
+    MemoryContext   oldctx;
+    MemoryContext   aggctx;
+    char            *p;
+    int             n, i;
+
+    aggctx = _crt_agg_context(fcinfo, "_mpz_agg_crt_deserialize");
+
+    n = *(int32 *)VARDATA(b);
+    p = (char *)b + PMPZ_CRT_DATA_OFFSET;
+
+    oldctx = MemoryContextSwitchTo(aggctx);
+    s = _crt_state_new(n);
+    for (i = 0; i < n; i++) {
+        mpz_from_pmpz(r, (pmpz *)p);
+        p += PMPZ_SIZE(r);
+        mpz_from_pmpz(m, (pmpz *)p);
+        p += PMPZ_SIZE(m);
+        _crt_state_add(s, r, m);
+    }
+    MemoryContextSwitchTo(oldctx);
+    pfree(b);
+
+    PG_RETURN_POINTER(s);
+}
+
+PGMP_PG_FUNCTION(_pmpz_agg_crt_final)
+{
+    pmpz_crt_state  *s = (pmpz_crt_state *)PG_GETARG_POINTER(0);
+    mpz_t           *cs;
+    mpz_t           zf;
+    pmpz_tree       tree;
+    int             i;
+
+    cs = (mpz_t *)palloc(s->n * sizeof(mpz_t));
+    _tree_build(&tree, s->m, s->n);
+    _tree_square_rems(&tree, cs);
+
+    /* c[i] = r[i] / (M / m[i]) mod m[i] */
+    for (i = 0; i < s->n; i++)
+    {
+        mpz_divexact(cs[i], cs[i], s->m[i]);
+        if (mpz_cmp_ui(s->m[i], 1) == 0) {
+            mpz_set_ui(cs[i], 0);
+        }
+        else if (!mpz_invert(cs[i], cs[i], s->m[i])) {
+            ereport(ERROR, (
+                errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                errmsg("crt moduli must be pairwise coprime")));
+        }
+        mpz_mul(cs[i], cs[i], s->r[i]);
+        mpz_mod(cs[i], cs[i], s->m[i]);
+    }
+
+    mpz_init(zf);
+    _tree_cofactor_sum(&tree, cs, zf);
+    mpz_mod(zf, zf, tree.level[tree.nlevels - 1][0]);
+
+    PGMP_RETURN_MPZ(zf);
+}
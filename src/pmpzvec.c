@@ -0,0 +1,376 @@
+/* pmpzvec -- packed vectors of mpz
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#include "pmpzvec.h"
+#include "pmpz.h"
+#include "pgmp-impl.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"        /* for get_element_type */
+#include "utils/memutils.h"         /* for AllocSizeIsValid */
+
+#include <ctype.h>                  /* for isspace */
+
+
+/*
+ * Initialize a mpz from the i-th element of a mpzvec
+ *
+ * As in mpz_from_pmpz() the structure populated doesn't own the data, which
+ * must not be changed nor cleared.
+ */
+void
+mpz_from_pmpzvec(mpz_srcptr z, const pmpzvec *pv, int i)
+{
+    int nlimbs;
+    mpz_ptr wz;
+
+    if (UNLIKELY(0 != (PMPZVEC_VERSION(pv)))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_DATA_EXCEPTION),
+            errmsg("unsupported mpzvec version: %d", PMPZVEC_VERSION(pv))));
+    }
+
+    /* discard the const qualifier */
+    wz = (mpz_ptr)z;
+
+    nlimbs = pv->offs[i + 1] - pv->offs[i];
+    if (LIKELY(nlimbs != 0))
+    {
+        ALLOC(wz) = nlimbs;
+        SIZ(wz) = PMPZVEC_NEGATIVE(pv, i) ? -nlimbs : nlimbs;
+        LIMBS(wz) = PMPZVEC_LIMBS(pv) + pv->offs[i];
+    }
+    else
+    {
+        ALLOC(wz) = 1;
+        SIZ(wz) = 0;
+        LIMBS(wz) = (mp_limb_t *)&_pgmp_limb_0;
+    }
+}
+
+
+/*
+ * Build a mpzvec from a vector of mpz
+ */
+static pmpzvec *
+_pmpzvec_build(mpz_t *zs, int n)
+{
+    pmpzvec     *res;
+    bits8       *signs;
+    mp_limb_t   *limbs;
+    Size        size;
+    Size        nlimbs = 0;
+    uint32      off = 0;
+    int         i;
+
+    for (i = 0; i < n; i++) {
+        nlimbs += NLIMBS(zs[i]);
+    }
+
+    size = PMPZVEC_DATA_OFFSET(n) + nlimbs * sizeof(mp_limb_t);
+    if (UNLIKELY(!AllocSizeIsValid(size))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+            errmsg("mpzvec size exceeds the maximum allowed (%d)",
+                (int)MaxAllocSize)));
+    }
+
+    res = (pmpzvec *)palloc0(size);
+    SET_VARSIZE(res, size);
+    res->nelems = n;                    /* version: 0 */
+
+    signs = PMPZVEC_SIGNS(res);
+    limbs = PMPZVEC_LIMBS(res);
+    for (i = 0; i < n; i++)
+    {
+        res->offs[i] = off;
+        memcpy(limbs + off, LIMBS(zs[i]), NLIMBS(zs[i]) * sizeof(mp_limb_t));
+        off += NLIMBS(zs[i]);
+        if (SIZ(zs[i]) < 0) {
+            signs[i / 8] |= 1 << (i % 8);
+        }
+    }
+    res->offs[n] = off;
+
+    return res;
+}
+
+
+/*
+ * Input/Output functions
+ *
+ * The text representation is the same of a one-dimensional mpz[].
+ */
+
+#define PMPZVEC_INVALID_INPUT(str) \
+do { \
+    const char *ell; \
+    const int maxchars = 50; \
+    ell = (strlen(str) > maxchars) ? "..." : ""; \
+ \
+    ereport(ERROR, ( \
+        errcode(ERRCODE_INVALID_TEXT_REPRESENTATION), \
+        errmsg("invalid input for mpzvec: \"%.*s%s\"", \
+            maxchars, str, ell))); \
+} while (0)
+
+PGMP_PG_FUNCTION(pmpzvec_in)
+{
+    char        *str;
+    char        *p, *tok;
+    mpz_t       *zs;
+    int         n = 0, size = 8;
+
+    str = PG_GETARG_CSTRING(0);
+    zs = (mpz_t *)palloc(size * sizeof(mpz_t));
+
+    p = str;
+    while (isspace((unsigned char)*p)) { p++; }
+    if (*p++ != '{') {
+        PMPZVEC_INVALID_INPUT(str);
+    }
+    while (isspace((unsigned char)*p)) { p++; }
+
+    if (*p == '}') {
+        p++;
+    }
+    else for (;;)
+    {
+        char    sep;
+
+        tok = p;
+        while (*p && *p != ',' && *p != '}') { p++; }
+        if (!*p) {
+            PMPZVEC_INVALID_INPUT(str);
+        }
+
+        if (n >= size) {
+            size *= 2;
+            zs = (mpz_t *)repalloc(zs, size * sizeof(mpz_t));
+        }
+
+        /* mpz_set_str ignores the whitespaces but not an empty string */
+        sep = *p;
+        *p = '\0';
+        if (0 != mpz_init_set_str(zs[n++], tok, 0)) {
+            *p = sep;
+            PMPZVEC_INVALID_INPUT(str);
+        }
+        *p++ = sep;
+
+        if (sep == '}') {
+            break;
+        }
+    }
+
+    while (isspace((unsigned char)*p)) { p++; }
+    if (*p) {
+        PMPZVEC_INVALID_INPUT(str);
+    }
+
+    PG_RETURN_POINTER(_pmpzvec_build(zs, n));
+}
+
+PGMP_PG_FUNCTION(pmpzvec_out)
+{
+    pmpzvec     *pv = PGMP_GETARG_PMPZVEC(0);
+    mpz_t       *zs;
+    char        *buf, *p;
+    Size        size = 3;               /* braces and null */
+    int         i;
+
+    zs = (mpz_t *)palloc(Max(pv->nelems, 1) * sizeof(mpz_t));
+    for (i = 0; i < pv->nelems; i++) {
+        mpz_from_pmpzvec(zs[i], pv, i);
+        size += mpz_sizeinbase(zs[i], 10) + 2;      /* sign and comma */
+    }
+
+    /* Allocate the output buffer manually - see pmpz_out to know why */
+    p = buf = palloc(size);
+    *p++ = '{';
+    for (i = 0; i < pv->nelems; i++) {
+        if (i) { *p++ = ','; }
+        mpz_get_str(p, 10, zs[i]);
+        p += strlen(p);
+    }
+    *p++ = '}';
+    *p = '\0';
+
+    PG_RETURN_CSTRING(buf);
+}
+
+
+/*
+ * Conversion from/to mpz[]
+ */
+
+PGMP_PG_FUNCTION(pmpzvec_from_array)
+{
+    ArrayType       *a = PG_GETARG_ARRAYTYPE_P(0);
+    mpz_t           *zs;
+    bool            *nulls;
+    int             n, i;
+
+    n = mpz_array_unpack(fcinfo, a, &zs, &nulls);
+    for (i = 0; i < n; i++) {
+        if (UNLIKELY(nulls[i])) {
+            ereport(ERROR, (
+                errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                errmsg("mpzvec can't contain null elements")));
+        }
+    }
+
+    PG_RETURN_POINTER(_pmpzvec_build(zs, n));
+}
+
+PGMP_PG_FUNCTION(pmpzvec_to_array)
+{
+    pmpzvec         *pv = PGMP_GETARG_PMPZVEC(0);
+    Oid             elemtype;
+    mpz_t           *zs;
+    int             n = pv->nelems;
+    int             lb = 1;
+    int             i;
+
+    elemtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+    if (UNLIKELY(!OidIsValid(elemtype))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_DATATYPE_MISMATCH),
+            errmsg("could not determine the mpz array type")));
+    }
+
+    zs = (mpz_t *)palloc(Max(n, 1) * sizeof(mpz_t));
+    for (i = 0; i < n; i++) {
+        mpz_from_pmpzvec(zs[i], pv, i);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(pmpz_array_build(fcinfo, elemtype,
+        zs, NULL, n, 1, &n, &lb));
+}
+
+
+/*
+ * Elements access
+ */
+
+PGMP_PG_FUNCTION(pmpzvec_length)
+{
+    pmpzvec         *pv = PGMP_GETARG_PMPZVEC(0);
+
+    PG_RETURN_INT32(pv->nelems);
+}
+
+PGMP_PG_FUNCTION(pmpzvec_elem)
+{
+    pmpzvec         *pv = PGMP_GETARG_PMPZVEC(0);
+    int32           i = PG_GETARG_INT32(1);
+    const mpz_t     z = {0};
+
+    /* out of bounds elements are null, as in arrays */
+    if (i < 1 || i > pv->nelems) {
+        PG_RETURN_NULL();
+    }
+
+    mpz_from_pmpzvec(z, pv, i - 1);
+    PG_RETURN_POINTER(pmpz_copy_mpz(z));
+}
+
+/* Return the elements between lo and hi (included, 1-based) */
+PGMP_PG_FUNCTION(pmpzvec_slice)
+{
+    pmpzvec         *pv = PGMP_GETARG_PMPZVEC(0);
+    int32           lo = PG_GETARG_INT32(1);
+    int32           hi = PG_GETARG_INT32(2);
+    pmpzvec         *res;
+    bits8           *signs, *rsigns;
+    uint32          first;
+    Size            size, nlimbs;
+    int             n, i;
+
+    if (UNLIKELY(0 != (PMPZVEC_VERSION(pv)))) {
+        ereport(ERROR, (
+            errcode(ERRCODE_DATA_EXCEPTION),
+            errmsg("unsupported mpzvec version: %d", PMPZVEC_VERSION(pv))));
+    }
+
+    lo = Max(lo, 1);
+    hi = Min(hi, pv->nelems);
+    n = (lo <= hi) ? hi - lo + 1 : 0;
+    lo -= 1;                            /* 0-based from here */
+
+    first = n ? pv->offs[lo] : 0;
+    nlimbs = n ? pv->offs[lo + n] - first : 0;
+    size = PMPZVEC_DATA_OFFSET(n) + nlimbs * sizeof(mp_limb_t);
+
+    res = (pmpzvec *)palloc0(size);
+    SET_VARSIZE(res, size);
+    res->nelems = n;
+
+    /* The limbs are contiguous: we can just copy them in one go */
+    signs = PMPZVEC_SIGNS(pv);
+    rsigns = PMPZVEC_SIGNS(res);
+    for (i = 0; i < n; i++) {
+        res->offs[i] = pv->offs[lo + i] - first;
+        if (signs[(lo + i) / 8] & (1 << ((lo + i) % 8))) {
+            rsigns[i / 8] |= 1 << (i % 8);
+        }
+    }
+    res->offs[n] = nlimbs;
+    memcpy(PMPZVEC_LIMBS(res), PMPZVEC_LIMBS(pv) + first,
+        nlimbs * sizeof(mp_limb_t));
+
+    PG_RETURN_POINTER(res);
+}
+
+/* Return the elements of a mpzvec as a set */
+PGMP_PG_FUNCTION(pmpzvec_unnest)
+{
+    FuncCallContext *funcctx;
+    pmpzvec         *pv;
+    const mpz_t     z = {0};
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        MemoryContext   oldctx;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+
+        /* detoast the value only once, in a context surviving the calls */
+        oldctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        pv = PGMP_GETARG_PMPZVEC(0);
+        funcctx->user_fctx = pv;
+        funcctx->max_calls = pv->nelems;
+        MemoryContextSwitchTo(oldctx);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    pv = (pmpzvec *)funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls)
+    {
+        mpz_from_pmpzvec(z, pv, funcctx->call_cntr);
+        SRF_RETURN_NEXT(funcctx, PointerGetDatum(pmpz_copy_mpz(z)));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
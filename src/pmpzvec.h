@@ -0,0 +1,75 @@
+/* pmpzvec -- PostgreSQL data type for packed vectors of GMP mpz
+ *
+ * Copyright (C) 2011 Daniele Varrazzo
+ *
+ * This file is part of the PostgreSQL GMP Module
+ *
+ * The PostgreSQL GMP Module is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The PostgreSQL GMP Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the PostgreSQL GMP Module.  If not, see
+ * https://www.gnu.org/licenses/.
+ */
+
+#ifndef __PMPZVEC_H__
+#define __PMPZVEC_H__
+
+#include <gmp.h>
+#include "postgres.h"
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+/* A vector of mpz stored with a single header.
+ *
+ * The header is followed by nelems + 1 offsets, in limbs, of the elements
+ * in the data area (the element i spans the limbs between offs[i] and
+ * offs[i+1]), then by a bitmap of the negative elements. The limbs of all
+ * the elements are stored contiguously, starting at the first maxaligned
+ * position after the bitmap.
+ */
+typedef struct
+{
+    char        vl_len_[4];     /* varlena header */
+    unsigned    mdata;          /* version number */
+    int32       nelems;         /* number of elements */
+    uint32      offs[1];        /* offsets, then signs bitmap, then limbs */
+
+} pmpzvec;
+
+/* Versions 0-7 allowed, as for pmpz */
+#define PMPZVEC_VERSION_MASK   0x07
+
+#define PMPZVEC_VERSION(mv) (((mv)->mdata) & PMPZVEC_VERSION_MASK)
+
+#define PMPZVEC_SIGNS_OFFSET(n) \
+    (offsetof(pmpzvec, offs) + ((n) + 1) * sizeof(uint32))
+#define PMPZVEC_DATA_OFFSET(n) \
+    MAXALIGN(PMPZVEC_SIGNS_OFFSET(n) + ((n) + 7) / 8)
+
+#define PMPZVEC_SIGNS(mv) \
+    ((bits8 *)((char *)(mv) + PMPZVEC_SIGNS_OFFSET((mv)->nelems)))
+#define PMPZVEC_LIMBS(mv) \
+    ((mp_limb_t *)((char *)(mv) + PMPZVEC_DATA_OFFSET((mv)->nelems)))
+
+#define PMPZVEC_NEGATIVE(mv,i) (PMPZVEC_SIGNS(mv)[(i) / 8] & (1 << ((i) % 8)))
+
+
+/* Macros to convert mpzvec arguments */
+
+#define PGMP_GETARG_PMPZVEC(n) \
+    ((pmpzvec*)(PG_DETOAST_DATUM(PG_GETARG_DATUM(n))))
+
+
+void mpz_from_pmpzvec(mpz_srcptr z, const pmpzvec *pv, int i);
+
+
+#endif  /* __PMPZVEC_H__ */
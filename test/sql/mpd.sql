@@ -0,0 +1,108 @@
+--
+--  Test mpd datatype
+--
+
+-- Compact output
+\t
+\a
+
+
+--
+-- mpd input and output functions
+--
+
+SELECT '0'::mpd;
+SELECT '-0.00'::mpd;
+SELECT '  -12.340 '::mpd;
+SELECT '.5'::mpd, '5.'::mpd, '+7'::mpd;
+SELECT '1e3'::mpd, '1.5e-3'::mpd, '1.25E+1'::mpd;
+SELECT '-0.000000000000000000000000000000000000001'::mpd;
+SELECT '123456789012345678901234567890.123456789012345678901234567890'::mpd;
+SELECT '1.2.3'::mpd;
+SELECT '.'::mpd;
+SELECT '1e'::mpd;
+
+
+--
+-- mpd type modifier
+--
+
+SELECT '3.14159'::mpd(10,2), '-2.675'::mpd(10,2), '7'::mpd(10,2);
+SELECT '1.5'::mpd(3);
+SELECT '1'::mpd(0);
+CREATE TABLE test_mpd (d mpd(10,2));
+INSERT INTO test_mpd VALUES ('3.14159'), (2), ('-1.005'), (99999999.994);
+SELECT d FROM test_mpd ORDER BY d;
+INSERT INTO test_mpd VALUES (99999999.995);
+SELECT format_type(atttypid, atttypmod) FROM pg_attribute
+    WHERE attrelid = 'test_mpd'::regclass AND attname = 'd';
+
+
+--
+-- mpd cast
+--
+
+SELECT 1.50::mpd, (-2)::int2::mpd, 12345678901::int8::mpd;
+SELECT 12345678901234567890.000012345::numeric::mpd;
+SELECT '12.3400'::mpd::numeric, '-0.001'::mpd::numeric, '1e3'::mpd::numeric;
+SELECT 'NaN'::numeric::mpd;
+SELECT 100::mpz::mpd, '-7.9'::mpd::mpz, '1.25'::mpd::float8;
+SELECT '1.25'::mpd::mpq, '-0.1'::mpd::mpq;
+SELECT mpd('2/3'::mpq, 5), mpd('-1/8'::mpq, 2), mpd('7'::mpq, 0);
+
+
+--
+-- mpd arithmetic
+--
+
+SELECT -('1.5'::mpd), +('1.5'::mpd), abs('-1.50'::mpd);
+SELECT '1.5'::mpd + '2.25', '1'::mpd - '0.001', '1.5'::mpd * '0.25';
+SELECT '1.5'::mpd + 1, '1.5'::mpd * 2.5;
+SELECT '123456789012345678901234567890.5'::mpd * 2;
+SELECT 1::mpd / 3, (-2)::mpd / 3, 10::mpd / 4;
+SELECT '1'::mpd / '0.000000000000000000003';
+SELECT div(1, 3, 3), div(2, 3, 0), div(-1, 8, 2);
+SELECT 1::mpd / 0;
+SELECT round('2.5'::mpd), round('-2.5'::mpd), trunc('-2.5'::mpd);
+SELECT round('1234.5678'::mpd, 2), round('1234.5678'::mpd, -2), round('1.5'::mpd, 3);
+SELECT trunc('-1.999'::mpd, 1), trunc('1299.5'::mpd, -2);
+
+
+--
+-- mpd comparisons
+--
+
+SELECT '1.50'::mpd = '1.5', '1.50'::mpd <> '1.5', '1.5'::mpd < '1.51';
+SELECT '-0.1'::mpd > '-0.01', '-0.1'::mpd >= '-0.10', 100::mpd <= '1e2';
+SELECT mpd_cmp('-0.1', '-0.01') < 0, mpd_cmp('2', '2.000'), mpd_cmp('1e3', '999.9') > 0;
+SELECT '1.5'::mpd = '3/2'::mpq;
+
+-- Can create btree and hash indexes
+create table test_mpd_idx (d mpd);
+insert into test_mpd_idx select generate_series(1, 10000);
+create index test_mpd_btree_idx on test_mpd_idx using btree (d);
+set client_min_messages = error;
+create index test_mpd_hash_idx on test_mpd_idx using hash (d);
+reset client_min_messages;
+
+-- Equal values have the same hash, integers the same of mpz
+select mpd_hash('1.5') = mpd_hash('1.500');
+select mpd_hash('2.00') = mpz_hash(2);
+select mpd_hash('1e3') = mpz_hash(1000);
+select mpd_hash('1.5') <> mpd_hash('15');
+
+
+--
+-- mpd aggregation
+--
+
+CREATE TABLE mpdagg(d mpd);
+
+SELECT sum(d) FROM mpdagg;      -- NULL sum
+INSERT INTO mpdagg VALUES ('1.5'), ('2.25'), ('-3'), (NULL);
+
+SELECT sum(d), avg(d), min(d), max(d) FROM mpdagg;
+
+-- check correct values when the sortop kicks in
+CREATE INDEX mpdagg_idx ON mpdagg(d);
+SELECT min(d), max(d) FROM mpdagg;
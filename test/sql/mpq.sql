@@ -321,3 +321,59 @@ SELECT max(q) FROM mpqagg;
 CREATE TABLE test_mpq_win(q mpq);
 INSERT INTO test_mpq_win SELECT mpq(1::mpz, i::mpz) from generate_series(1,500) i;
 SELECT DISTINCT den(q) % 5, prod(q) OVER (PARTITION BY den(q) % 5) FROM test_mpq_win ORDER BY 1;
+
+
+--
+-- mpq arrays
+--
+
+select array_add('{1/2,1/3}'::mpq[], '{1/2,1/6}');
+select array_mul('{2/3,null}'::mpq[], '{3/4,1}');
+select array_sub('{1}'::mpq[], '{1,2}');
+select array_scale('{1/2,-3/4,0}'::mpq[], '2/3');
+select array_dot('{1/2,1/3}'::mpq[], '{2,3}');
+select array_sum('{1/2,1/3,1/6,null}'::mpq[]);
+select array_prod('{2/3,3/4,0}'::mpq[]);
+select array_sort('{1/2,null,-1/3,1/3}'::mpq[]);
+
+--
+-- conversion between mpq and numeric
+--
+
+SELECT mpq(1,3)::numeric(20,6), mpq(-1,3)::numeric(20,6), mpq(-1,3000000)::numeric(20,6);
+SELECT ('1' || repeat('0', 40) || '/3')::mpq::numeric::text = repeat('3', 40) || '.' || repeat('3', 15);
+SELECT 0.000123::numeric::mpq, 1e30::numeric::mpq, (-1.5e-20)::numeric::mpq;
+SELECT count(*) FROM generate_series(-1000, 1000) i
+WHERE (i::numeric / 7)::mpq::numeric(30,20) <> (i::numeric / 7)::numeric(30,20);
+SELECT 5::mpq::numeric(20,0), 5::mpq::numeric(20,3), 5::mpq::numeric(20,4), 5::mpq::numeric(20,6), (-5)::mpq::numeric(20,8);
+SELECT 123456789::mpq::numeric(20,6), (10::mpz ^ 12)::mpq::numeric(21,8), 0::mpq::numeric(20,4);
+
+--
+-- input/output of small values
+--
+
+SELECT '-0/5'::mpq, '4/6'::mpq, '-40/100'::mpq, '340282366920938463463374607431768211455/5'::mpq;
+SELECT '1/00'::mpq;
+
+--
+-- arithmetic fast paths: integers, same denominator, single limb values
+--
+
+SELECT '1/6'::mpq + '1/10', '5/12'::mpq - '7/12', '5/12'::mpq + '7/12', '3/4'::mpq - '3/4';
+SELECT '-6/35'::mpq * '14/9', '-6/35'::mpq / '-9/14', '0'::mpq * '-5/7', '0'::mpq / '-5/7';
+SELECT -18446744073709551615::mpq - 18446744073709551615::mpq, 18446744073709551615::mpq * 18446744073709551615::mpq;
+SELECT a + b, a - b FROM (SELECT mpq(2::mpz ^ 64 - 1, 2::mpz ^ 64 - 59) a, mpq(2::mpz ^ 64 - 3, 2::mpz ^ 64 - 83) b) v;
+SELECT a * b, a / b FROM (SELECT mpq(2::mpz ^ 64 - 1, 2::mpz ^ 64 - 59) a, mpq(2::mpz ^ 64 - 3, 2::mpz ^ 64 - 83) b) v;
+SELECT mpq(10::mpz ^ 30 + 1, 7) + mpq(10::mpz ^ 20, 7), mpq(10::mpz ^ 30 + 1, 7) - mpq(10::mpz ^ 20, 7);
+SELECT '1/3'::mpq < '2/5', '-1/3'::mpq < '-2/5', '5/7'::mpq > '3/7', mpq_cmp('-3/7', '0') < 0, '0'::mpq = '0/5';
+SELECT mpq(2::mpz ^ 64 - 1, 2::mpz ^ 64 - 2) > mpq(2::mpz ^ 64 - 2, 2::mpz ^ 64 - 3), mpq(2::mpz ^ 100 + 1, 3) > mpq(2::mpz ^ 100, 3);
+SELECT mpq(6::mpz, 1::mpz), mpq(-6::mpz, 1::mpz), mpq(0::mpz, 1::mpz), mpq(6::mpz, -4::mpz);
+
+--
+-- results written in place: general path and shifts
+--
+
+SELECT a + b, a - b FROM (SELECT mpq(10::mpz ^ 25 + 3, 6::mpz ^ 30) a, mpq(10::mpz ^ 22 - 1, 6::mpz ^ 28 * 35) b) v;
+SELECT (a + b) - a - b FROM (SELECT mpq(10::mpz ^ 25 + 3, 6::mpz ^ 30) a, mpq(10::mpz ^ 22 - 1, 6::mpz ^ 28 * 35) b) v;
+SELECT c * d, c / d FROM (SELECT mpq(2::mpz ^ 80 - 1, 3::mpz ^ 50) c, mpq(-(3::mpz ^ 60), 2::mpz ^ 90 + 5) d) v;
+SELECT mpq(3, 2::mpz ^ 70) << 75, mpq(3, 2::mpz ^ 70) >> 5, mpq(-5 * 2::mpz ^ 70, 3) >> 72, mpq(-5 * 2::mpz ^ 70, 3) << 3;
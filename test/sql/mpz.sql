@@ -509,6 +509,8 @@ select fac(-1);
 select bin(0::mpz, 0);
 select bin(7::mpz, 2);
 select bin(-2::mpz, 1);
+select bin(-2::mpz, 5);
+select bin(-1::mpz, 3);
 select bin(2::mpz, -1);
 
 select fib(0);
@@ -636,3 +638,293 @@ SELECT urandomm(1000000::mpz);
 SELECT randseed(123456::mpz);
 SELECT urandomm(1000000::mpz);
 SELECT urandomm(1000000::mpz);
+
+
+--
+-- mpz in PL/pgSQL loops (expanded values)
+--
+
+CREATE FUNCTION test_inplace(n int) RETURNS mpz
+LANGUAGE plpgsql IMMUTABLE STRICT AS $$
+DECLARE
+    acc mpz := 1;
+    i mpz := 0;
+BEGIN
+    WHILE i < n LOOP
+        i := i + 1;
+        acc := acc * 3;
+        acc := acc - i;
+        acc := acc + acc;
+    END LOOP;
+    RETURN acc;
+END
+$$;
+
+SELECT test_inplace(100);
+SELECT test_inplace(100) = test_inplace(100);
+DROP FUNCTION test_inplace(int);
+
+
+--
+-- mpz arrays
+--
+
+select array_add('{1,2,3}'::mpz[], '{4,5,6}');
+select array_sub('{1,2,null}'::mpz[], '{1,5,6}');
+select array_mul('{{1,2},{3,4}}'::mpz[], '{{5,6},{7,8}}');
+select array_mul('[0:1]={1,2}'::mpz[], '{3,4}');
+select array_add('{1,2}'::mpz[], '{1,2,3}');
+select array_scale('{1,-2,null}'::mpz[], '100000000000000000000');
+select array_dot('{1,2,3}'::mpz[], '{4,null,6}');
+select array_sum('{1,2,null,30000000000000000000}'::mpz[]);
+select array_prod(array(select i::mpz from generate_series(1,30) i)) = fac(30);
+select array_sum('{}'::mpz[]) is null, array_prod('{null}'::mpz[]) is null;
+select array_sort('{{3,null},{-1,2}}'::mpz[]);
+select array_sort('{}'::mpz[]);
+
+
+--
+-- division by a constant divisor
+--
+
+SELECT count(*) FROM generate_series(-100, 100) i
+WHERE (i::mpz / 8)::int <> i / 8 OR (i::mpz % 8)::int <> i % 8
+OR (i::mpz / 7)::int <> i / 7 OR (i::mpz % 7)::int <> i % 7
+OR (i::mpz / -4)::int <> i / -4 OR (i::mpz % -4)::int <> i % -4
+OR (i::mpz -/ 8)::int <> floor(i / 8.0) OR (i::mpz +/ 7)::int <> ceil(i / 7.0)
+OR (i::mpz * 21 /! 7)::int <> i * 3 OR (i::mpz * 32 /! 16)::int <> i * 2;
+SELECT count(*) FROM generate_series(1, 1000) i WHERE divisible(i::mpz, 7);
+SELECT count(*) FROM generate_series(1, 1000) i WHERE i::mpz /? 16;
+SELECT count(*) FROM generate_series(1, 1000) i WHERE divisible(i::mpz << 64, 36893488147419103232::mpz);
+SELECT count(*) FROM generate_series(1, 1000) i WHERE congruent(i::mpz, 3, 8);
+SELECT count(*) FROM generate_series(1, 1000) i WHERE congruent(i::mpz, -1, 7);
+
+--
+-- modular exponentiation on arrays
+--
+
+select powm('{2,3,null,5}'::mpz[], 10, 1000);
+select powm('{3}'::mpz[], 2, -7);
+select powm(3, '{0,1,2,null}'::mpz[], 7);
+select powm(3, '{1,-1}'::mpz[], 8);
+select powm(3, '{1}'::mpz[], 0);
+select powm(7, ARRAY(select (i * 1000)::mpz from generate_series(0, 20) i), 1000000007)
+    = ARRAY(select (7::mpz ^ (i * 1000)) % 1000000007 from generate_series(0, 20) i);
+SELECT count(*) FROM generate_series(0, 50) i
+WHERE powm(7, (i * 1000)::mpz, 1000000007) <> (7::mpz ^ (i * 1000)) % 1000000007;
+
+--
+-- conversion between mpz and numeric
+--
+
+SELECT (10::mpz ^ 1000)::numeric::text = '1' || repeat('0', 1000);
+SELECT ('-1' || repeat('0', 1000) || '.5')::numeric::mpz = -(10::mpz ^ 1000);
+SELECT ('-' || repeat('1234567890', 30))::numeric::mpz::text = '-' || repeat('1234567890', 30);
+SELECT (-0.5::numeric)::mpz, 0.9999::numeric::mpz, 1e20::numeric::mpz;
+SELECT (12345::mpz)::numeric(10,2), (10::mpz ^ 20)::numeric(25,2);
+SELECT count(*) FROM generate_series(1, 1000) i
+WHERE (-i::mpz ^ 11)::numeric::mpz <> -i::mpz ^ 11
+OR (i::mpz ^ 11)::numeric::text <> (i::mpz ^ 11)::text;
+
+--
+-- input/output of small values
+--
+
+SELECT '-0'::mpz, '99999999999999999999999999999999999999'::mpz, '-100000000000000000000000000000000000000'::mpz;
+SELECT '0'::mpz, '010'::mpz, '0x1f'::mpz;
+SELECT '-'::mpz;
+SELECT count(*) FROM generate_series(-1000, 1000) i
+WHERE (i::mpz ^ 13)::text::mpz <> i::mpz ^ 13
+OR (i * 1000003)::mpz::text <> (i * 1000003)::text;
+SELECT repeat('1234567890', 100)::mpz::text = repeat('1234567890', 100);
+SELECT ('-' || repeat('9', 1000))::mpz = -(10::mpz ^ 1000) + 1;
+SELECT (repeat('1234567890', 10) || 'x')::mpz;
+
+--
+-- conversion between mpz and bytea or bit varying
+--
+
+SELECT 0::mpz::bytea, 255::mpz::bytea, 256::mpz::bytea;
+SELECT bytea(4660::mpz, 'little', false), bytea(-129::mpz, 'big', true), bytea(128::mpz, 'big', true);
+SELECT '\x0100'::bytea::mpz, mpz('\x0100'::bytea, 'little', false), mpz('\xff00'::bytea, 'big', true), mpz('\x00ff'::bytea, 'little', true);
+SELECT ''::bytea::mpz;
+SELECT (-1::mpz)::bytea;
+SELECT bytea(1::mpz, 'middle', false);
+SELECT B'1010'::varbit::mpz, B''::varbit::mpz, B'0000000011'::varbit::mpz;
+SELECT 0::mpz::varbit, 10::mpz::varbit, 256::mpz::varbit;
+SELECT (-1::mpz)::varbit;
+SELECT count(*) FROM generate_series(-1000, 1000) i
+WHERE mpz(int8send(i * 1000000007::int8), 'big', true) <> i * 1000000007::int8;
+SELECT count(*) FROM generate_series(-1000, 1000) i
+WHERE mpz(bytea(i::mpz ^ 7, 'little', true), 'little', true) <> i::mpz ^ 7
+OR (abs(i)::mpz ^ 7)::bytea::mpz <> abs(i)::mpz ^ 7
+OR (abs(i)::mpz ^ 7)::varbit::mpz <> abs(i)::mpz ^ 7;
+
+--
+-- planner support
+--
+
+CREATE TABLE test_mpz_support(z mpz);
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT z + 0, 0 + z, z - 0, z * 1, z / 1, z ^ 1, z << 0, z + 1 FROM test_mpz_support;
+-- the expensive test is evaluated last
+EXPLAIN (COSTS OFF)
+SELECT * FROM test_mpz_support WHERE probab_prime(z, 10) > 0 AND z * 2 + 1 < 100;
+SELECT fac(20) + 0, 0 + fib(10), 5::mpz ^ 1;
+
+--
+-- long computations
+--
+
+SELECT fac(70001) / fac(70000), fib(2000001) - fib(2000000) = fib(1999999);
+SELECT lucnum(2000000) = fib(1999999) + fib(2000001), 3::mpz ^ 700001 = 3 * 3::mpz ^ 700000;
+SET pgmp.max_bits = 1000;
+SELECT fac(100) > 0, 2::mpz ^ 999 > 0, 1::mpz << 999 > 0, bin(1000::mpz, 500) > 0;
+SELECT fac(1000);
+SELECT 2::mpz ^ 2000;
+SELECT fib(3000);
+SELECT lucnum(3000);
+SELECT bin(3000::mpz, 2500);
+SELECT 1::mpz << 1000;
+RESET pgmp.max_bits;
+SELECT fac(10000000000);
+
+--
+-- results cache
+--
+
+SELECT pgmp_cache_reset();
+SELECT fac(3000) = fac(3000), fac(3010) = fac(3009) * 3010;
+SELECT fib(10000) = fib(10000), fib(10100) = fib(10099) + fib(10098), lucnum(10100) = fib(10099) + fib(10101);
+SELECT bin(6000::mpz, 3000) = bin(6000::mpz, 3000), bin(6000::mpz, 3001) = bin(6000::mpz, 3000) * 3000 / 3001;
+SELECT hits, partial_hits, misses, entries FROM pgmp_cache_stats();
+SET pgmp.cache_size = 0;
+SELECT fac(3000) = fac(3000);
+SELECT hits, partial_hits, misses, entries, bytes FROM pgmp_cache_stats();
+RESET pgmp.cache_size;
+SELECT pgmp_cache_reset();
+
+--
+-- sequence functions
+--
+
+SELECT array_agg(b) FROM binomial_row(10) b;
+SELECT count(*) FROM binomial_row(300) WITH ORDINALITY AS b(z, k) WHERE z <> bin(300::mpz, k - 1);
+SELECT array_agg(f) FROM fib_series(0, 12) f;
+SELECT count(*) FROM fib_series(1000, 1200) WITH ORDINALITY AS f(z, k) WHERE z <> fib(999 + k);
+SELECT array_agg(f) FROM fac_series(0, 10) f;
+SELECT count(*) FROM fac_series(5, 4);
+SELECT array_agg(z) FROM generate_series(-3::mpz, 3::mpz) z;
+SELECT array_agg(z) FROM generate_series(10::mpz ^ 30, 10::mpz ^ 30 - 9, -3) z;
+SELECT generate_series(1::mpz, 10::mpz, 0::mpz);
+EXPLAIN SELECT * FROM binomial_row(9);
+EXPLAIN SELECT * FROM generate_series(1::mpz, 100::mpz, 10::mpz);
+
+--
+-- mathematical constants
+--
+
+SELECT pi_digits(50);
+SELECT e_digits(50);
+SELECT ln2_digits(50);
+SELECT sqrt_digits(2, 50);
+SELECT pi_digits(0), e_digits(0), ln2_digits(0), sqrt_digits(10, 0);
+-- computed from the digits kept or extending them
+SELECT pi_digits(1000) / 10::mpz ^ 950 = pi_digits(50), pi_digits(20), pi_digits(2000) / 10::mpz ^ 1000 = pi_digits(1000);
+SELECT e_digits(3000) / 10::mpz ^ 2990 = e_digits(10), ln2_digits(3000) / 10::mpz ^ 2990 = ln2_digits(10);
+SELECT sqrt_digits(-1, 10);
+
+--
+-- primes
+--
+
+SELECT array_agg(p) FROM primes(1, 50) p;
+SELECT array_agg(p) FROM primes(2::mpz ^ 64, 2::mpz ^ 64 + 200) p;
+SELECT count(*) FROM primes(-10, 1), primes(50, 10);
+SELECT count(*) FROM primes(1000000, 2000000) p WHERE p <> nextprime(p - 1);
+SELECT prime_count(1, 1000000), prime_count(2, 2), prime_count(1000000, 2000000);
+SELECT prime_count(10::mpz ^ 20, 10::mpz ^ 20 + 1000);
+EXPLAIN SELECT * FROM primes(1, 1000000);
+
+--
+-- trial division by the small primes
+--
+
+SELECT probab_prime(nextprime(2::mpz ^ 100) * 65521, 10), probab_prime(nextprime(2::mpz ^ 100) * 65537, 10), probab_prime(2::mpz ^ 127 - 1, 10);
+SELECT nextprime(2::mpz ^ 600) - 2::mpz ^ 600, nextprime(-(2::mpz ^ 600));
+SET pgmp.trial_division_limit = 0;
+SELECT probab_prime(nextprime(2::mpz ^ 100) * 65521, 10), probab_prime(2::mpz ^ 127 - 1, 10), nextprime(2::mpz ^ 600) - 2::mpz ^ 600;
+SET pgmp.trial_division_limit = 100;
+SELECT probab_prime(nextprime(2::mpz ^ 100) * 97, 10), probab_prime(nextprime(2::mpz ^ 100) * 101, 10), nextprime(2::mpz ^ 600) - 2::mpz ^ 600;
+RESET pgmp.trial_division_limit;
+
+--
+-- batch gcd
+--
+
+SELECT batch_gcd('{15,35,77,13,13,-6,null,1}'::mpz[]);
+SELECT batch_gcd('{{6,10},{15,7}}'::mpz[]);
+SELECT batch_gcd('{0,4,6}'::mpz[]), batch_gcd('{0,0,5}'::mpz[]), batch_gcd('{0,null}'::mpz[]), batch_gcd('{}'::mpz[]);
+SELECT count(*), min(g) = nextprime(2::mpz ^ 80 * 7) FROM unnest(batch_gcd(array(SELECT nextprime(2::mpz ^ 80 * i) * nextprime(3::mpz ^ 50 * i) FROM generate_series(1, 50) i) || nextprime(2::mpz ^ 80 * 7) * nextprime(5::mpz ^ 30))) g WHERE g <> 1;
+
+--
+-- chinese remainder theorem
+--
+
+SELECT crt(r, m) FROM (VALUES (2, 3), (3, 5), (2, 7)) v(r, m);
+SELECT crt(r, m) FROM (VALUES (2, 3), (null, 5), (3, null), (3, 5)) v(r, m);
+SELECT crt(r, m) FROM (VALUES (-1::mpz, 10::mpz ^ 20), (5, 7), (0, 1)) v(r, m);
+SELECT crt(1, 2) WHERE false;
+SELECT crt(fac(100) % p, p) = fac(100) FROM primes(2::mpz ^ 61, 2::mpz ^ 61 + 20000) p;
+SELECT crt(r, m) FROM (VALUES (1, 3), (1, 0)) v(r, m);
+SELECT crt(r, m) FROM (VALUES (1, 6), (1, 5), (1, 4)) v(r, m);
+CREATE TABLE test_crt AS SELECT '123456789012345678901234567890'::mpz % p AS r, p AS m FROM primes(3::mpz, 1000::mpz) p;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT set_config(CASE WHEN current_setting('server_version_num')::int >= 160000 THEN 'debug_parallel_query' ELSE 'force_parallel_mode' END, 'on', false);
+SELECT crt(r, m) FROM test_crt;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+SELECT set_config(CASE WHEN current_setting('server_version_num')::int >= 160000 THEN 'debug_parallel_query' ELSE 'force_parallel_mode' END, 'off', false);
+DROP TABLE test_crt;
+
+--
+-- batch modular inverse
+--
+
+SELECT invert('{1,2,3,4,7}'::mpz[], 7);
+SELECT invert('{{3,null},{-2,10}}'::mpz[], 10), invert('{}'::mpz[], 5);
+SELECT count(*) FROM unnest(invert(array(SELECT i::mpz FROM generate_series(1, 1000) i), 1009)) WITH ORDINALITY u(v, i) WHERE v <> invert(i::mpz, 1009);
+SELECT invert_agg(i, 11 ORDER BY i DESC) FROM generate_series(0, 5) i;
+SELECT invert_agg(1, 2) WHERE false;
+SELECT invert_agg(i, i) FROM generate_series(2, 3) i;
+
+--
+-- factorization
+--
+
+SELECT * FROM factor(-360);
+SELECT * FROM factor(0);
+SELECT count(*) FROM factor(1);
+SELECT * FROM factor(2::mpz ^ 64 + 1);
+SELECT * FROM factor(fac(30) + 1);
+SELECT * FROM factor(2::mpz ^ 128 + 1);
+SELECT array_agg(prime) = ARRAY[nextprime(10::mpz ^ 15), nextprime(10::mpz ^ 18)] FROM factor(nextprime(10::mpz ^ 15) * nextprime(10::mpz ^ 18));
+SELECT * FROM factor(1000003::mpz ^ 6 * 1000033 ^ 3 * 12);
+SELECT prod(prime ^ exponent) = fac(40) - 1, bool_and(probab_prime(prime, 10) > 0) FROM factor(fac(40) - 1);
+SELECT * FROM factor('{12,null,-7,1,0}'::mpz[]);
+SELECT a.i, f.* FROM generate_series(1, 3) a(i), LATERAL factor(ARRAY[a.i * 6, a.i * 10, a.i * 7]::mpz[]) f;
+
+--
+-- Baillie-PSW primality test
+--
+
+SELECT probab_prime(2047::mpz, 1), probab_prime(3215031751::mpz, 1), probab_prime(3825123056546413051::mpz, 1), probab_prime(561::mpz, 1);
+SELECT probab_prime(5459::mpz, 1), probab_prime(5777::mpz, 1), probab_prime(10877::mpz, 1);
+SELECT probab_prime(18446744073709551557::mpz, 1), probab_prime(2::mpz ^ 64 - 1, 1), probab_prime(-4294967291::mpz, 1), probab_prime(1::mpz, 1);
+SELECT probab_prime(318665857834031151167461::mpz, 1), probab_prime(3317044064679887385961981::mpz, 50);
+SELECT probab_prime(nextprime(2::mpz ^ 64), 1), probab_prime(2::mpz ^ 127 - 1, 30), probab_prime(nextprime(2::mpz ^ 64) ^ 2, 1);
@@ -0,0 +1,53 @@
+--
+--  Test mpzvec datatype
+--
+
+-- Compact output
+\t
+\a
+
+
+--
+-- mpzvec input and output functions
+--
+
+SELECT '{}'::mpzvec;
+SELECT '{0}'::mpzvec;
+SELECT ' { 1, -2 ,0 } '::mpzvec;
+SELECT '{18446744073709551616,-18446744073709551616,4294967295}'::mpzvec;
+SELECT '{1,}'::mpzvec;
+SELECT '{1,a}'::mpzvec;
+SELECT '{1} 2'::mpzvec;
+
+
+--
+-- mpzvec conversions
+--
+
+SELECT ARRAY[1, -2, 30000000000000000000]::mpz[]::mpzvec;
+SELECT '{{1,2},{3,4}}'::mpz[]::mpzvec;
+SELECT '{1,null}'::mpz[]::mpzvec;
+SELECT '{1,-2,30000000000000000000}'::mpzvec::mpz[];
+SELECT '{}'::mpzvec::mpz[];
+SELECT array_sum('{1,2,3}'::mpzvec::mpz[]);
+
+CREATE TABLE test_mpzvec (v mpzvec);
+INSERT INTO test_mpzvec VALUES (ARRAY(SELECT fac(i) FROM generate_series(1, 100) i));
+SELECT length(v), elem(v, 100) = fac(100) FROM test_mpzvec;
+SELECT v::mpz[] = ARRAY(SELECT fac(i) FROM generate_series(1, 100) i) FROM test_mpzvec;
+DROP TABLE test_mpzvec;
+
+
+--
+-- mpzvec elements access
+--
+
+SELECT length('{}'::mpzvec), length('{1,2,3}'::mpzvec);
+SELECT elem('{10,-20,30}'::mpzvec, 2);
+SELECT elem('{10,-20,30}'::mpzvec, 0) IS NULL, elem('{10,-20,30}'::mpzvec, 4) IS NULL;
+SELECT slice('{1,-2,0,18446744073709551616,-5}'::mpzvec, 2, 4);
+SELECT slice('{1,-2,0,18446744073709551616,-5}'::mpzvec, -10, 10);
+SELECT slice('{1,-2,0,18446744073709551616,-5}'::mpzvec, 4, 3);
+SELECT slice('{1,-2,0,18446744073709551616,-5}'::mpzvec, 5, 5);
+SELECT unnest('{1,-2,18446744073709551616}'::mpzvec);
+SELECT count(*) FROM unnest('{}'::mpzvec);